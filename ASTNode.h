@@ -24,9 +24,17 @@ public:
         NODE_LOCALS,
     };
 
-    ASTNode(int type = NODE_INVALID) : m_refs(), m_type(type), m_processed() { }
+    ASTNode(int type = NODE_INVALID) : m_refs(), m_type(type), m_processed()
+    {
+        if (alloc_stats_enabled())
+            alloc_object_constructed(ALLOC_AST, type);
+    }
+
     virtual ~ASTNode() { }
 
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
+
     int type() const { return internalGetType(this); }
 
     bool processed() const { return m_processed; }
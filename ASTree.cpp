@@ -1,10 +1,18 @@
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stack>
 #include <stdexcept>
 #include "ASTree.h"
+#include "codediff.h"
+#include "codeflow.h"
 #include "FastStack.h"
 #include "pyc_numeric.h"
 #include "bytecode.h"
+#include "disasm.h"
 
 // This must be a triple quote (''' or """), to handle interpolated string literals containing the opposite quote style.
 // E.g. f'''{"interpolated "123' literal"}'''    -> valid.
@@ -17,19 +25,143 @@
 static void append_to_chain_store(const PycRef<ASTNode>& chainStore,
         PycRef<ASTNode> item, FastStack& stack, const PycRef<ASTBlock>& curblock);
 
+/* The decompiler state below is thread_local so that independent modules
+ * can be decompiled concurrently (e.g. the entries of a PyInstaller bundle). */
+
 /* Use this to determine if an error occurred (and therefore, if we should
  * avoid cleaning the output tree) */
-static bool cleanBuild;
+static thread_local bool cleanBuild;
 
 /* Use this to prevent printing return keywords and newlines in lambdas. */
-static bool inLambda = false;
+static thread_local bool inLambda = false;
 
 /* Use this to keep track of whether we need to print out any docstring and
  * the list of global variables that we are using (such as inside a function). */
-static bool printDocstringAndGlobals = false;
+static thread_local bool printDocstringAndGlobals = false;
 
 /* Use this to keep track of whether we need to print a class or module docstring */
-static bool printClassDocstring = true;
+static thread_local bool printClassDocstring = true;
+
+/* Number of code objects flagged as incomplete in the current module */
+static thread_local int incompleteCount = 0;
+
+/* Failures of the current module, see decompyle_failures */
+static thread_local std::vector<DecompyleFailure> failures;
+
+/* See decompyle_set_fail_fast */
+static bool failFast = false;
+static bool failFastDisasm = false;
+
+/* Thrown to abandon a code object in fail-fast mode */
+class BuildAborted { };
+
+/* See decompyle_set_timeout */
+static thread_local bool hasDeadline = false;
+static thread_local std::chrono::steady_clock::time_point deadline;
+
+/* Buffers of BuildFromCode(), kept for the next code object built on the
+ * same thread, so that they are cleared instead of allocated again.  A
+ * workspace that grew past the limits on a giant function is freed. */
+struct BuildWorkspace {
+    enum {
+        MAX_KEPT_INSTRUCTIONS = 1 << 16,
+        MAX_KEPT_STACK = 1 << 12,
+        MAX_KEPT_STACKS = 64,
+    };
+
+    BuildWorkspace() : stack(0), inUse(false) { }
+
+    size_t stackBytes() const { return stack.bytes() + stackHist.bytes(); }
+
+    bool oversized() const
+    {
+        return instructions.capacity() > MAX_KEPT_INSTRUCTIONS
+                || stack.capacity() > MAX_KEPT_STACK
+                || stackHist.capacity() > MAX_KEPT_STACKS;
+    }
+
+    std::vector<Instruction> instructions;
+    std::vector<ExceptionTableEntry> handlers;
+    CodeFlowScratch scratch;
+    StackDepth depth;
+    JumpMap jumps;
+    std::vector<CodeRange> junk;
+    FastStack stack;
+    stackhist_t stackHist;
+    std::stack<PycRef<ASTBlock>, std::vector<PycRef<ASTBlock>>> blocks;
+    bool inUse;
+};
+
+static thread_local std::unique_ptr<BuildWorkspace> s_workspace;
+
+/* The workspace of the calling thread for one BuildFromCode() call, which
+ * drops the references left in it at the end */
+class WorkspaceLease {
+public:
+    WorkspaceLease()
+    {
+        if (!s_workspace)
+            s_workspace.reset(new BuildWorkspace);
+        if (s_workspace->inUse) {
+            m_private.reset(new BuildWorkspace);
+            m_workspace = m_private.get();
+        } else {
+            m_workspace = s_workspace.get();
+        }
+        m_workspace->inUse = true;
+
+        // Buffers kept from earlier code objects are lent to this one, so
+        // they are counted for every file that uses them
+        if (alloc_stats_enabled())
+            alloc_track(ALLOC_STACK, (int64_t)m_workspace->stackBytes());
+    }
+
+    ~WorkspaceLease()
+    {
+        m_workspace->stack.clear();
+        while (!m_workspace->stackHist.empty())
+            m_workspace->stackHist.pop();
+        while (!m_workspace->blocks.empty())
+            m_workspace->blocks.pop();
+        m_workspace->inUse = false;
+        if (alloc_stats_enabled())
+            alloc_track(ALLOC_STACK, -(int64_t)m_workspace->stackBytes());
+
+        // Returned above, so freeing them is not counted again
+        AllocScope unaccounted(nullptr);
+        if (m_workspace == s_workspace.get() && s_workspace->oversized())
+            s_workspace.reset();
+        m_private.reset();
+    }
+
+    BuildWorkspace* operator->() const { return m_workspace; }
+
+private:
+    WorkspaceLease(const WorkspaceLease&) = delete;
+    WorkspaceLease& operator=(const WorkspaceLease&) = delete;
+
+    BuildWorkspace* m_workspace;
+    std::unique_ptr<BuildWorkspace> m_private;
+};
+
+/* Records a construct BuildFromCode() can't handle (after the message
+ * about it has been printed).  Decompilation goes on unless in fail-fast
+ * mode. */
+static void build_failure(PycRef<PycCode> code, int offset, int opcode, const char* reason)
+{
+    PycRef<PycString> name = code->qualName();
+    if (name == nullptr || name->length() == 0)
+        name = code->name();
+    failures.push_back({ name->strValue(), code->firstLine(), offset, opcode, reason });
+    if (failFast)
+        throw BuildAborted();
+}
+
+static void check_deadline()
+{
+    if (hasDeadline && std::chrono::steady_clock::now() > deadline)
+        throw DecompyleTimeout();
+}
 
 // shortcut for all top/pop calls
 static PycRef<ASTNode> StackPopTop(FastStack& stack)
@@ -74,12 +206,36 @@ static void CheckIfExpr(FastStack& stack, PycRef<ASTBlock> curblock)
 
 PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 {
+    WorkspaceLease workspace;
+
+    // Size the stack from the code itself rather than trusting the header.
+    // Code that is proven to pop from an empty stack can't have come from
+    // source, so it is given up on as in fail-fast mode.
+    std::vector<Instruction>& code_instructions = workspace->instructions;
+    decode_instructions(code, mod, code_instructions);
+    parse_exception_table(code, mod, workspace->handlers);
+    StackDepth& depth = workspace->depth;
+    analyze_stack_depth(code_instructions, workspace->handlers, mod, workspace->scratch, depth);
+    if (depth.bounded && depth.underflowPos >= 0) {
+        fprintf(stderr, "Invalid bytecode in %s: stack underflow at offset %d\n",
+                code->name()->value(), depth.underflowPos);
+        auto inst = std::find_if(code_instructions.begin(), code_instructions.end(),
+                                 [&](const Instruction& inst) {
+                                     return inst.pos == depth.underflowPos;
+                                 });
+        build_failure(code, depth.underflowPos,
+                      inst != code_instructions.end() ? inst->opcode : -1, "Stack underflow");
+        throw BuildAborted();
+    }
+
     PycBuffer source(code->code()->value(), code->code()->length());
 
-    FastStack stack((mod->majorVer() == 1) ? 20 : code->stackSize());
-    stackhist_t stack_hist;
+    FastStack& stack = workspace->stack;
+    stack.reset(depth.bounded ? depth.maxDepth
+                           : (mod->majorVer() == 1) ? 20 : code->stackSize());
+    stackhist_t& stack_hist = workspace->stackHist;
 
-    std::stack<PycRef<ASTBlock> > blocks;
+    auto& blocks = workspace->blocks;
     PycRef<ASTBlock> defblock = new ASTBlock(ASTBlock::BLK_MAIN);
     defblock->init();
     PycRef<ASTBlock> curblock = defblock;
@@ -92,8 +248,34 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
     bool else_pop = false;
     bool need_try = false;
     bool variable_annotations = false;
+    unsigned instructions = 0;
+
+    // Unreachable code that cannot be compiled source (e.g. junk inserted
+    // by an obfuscator) is skipped; other dead code is still decompiled,
+    // as it usually holds statements following a return or raise
+    JumpMap& jumps = workspace->jumps;
+    jumps.build(code_instructions, workspace->handlers, code->code()->length(), mod);
+
+    std::vector<CodeRange>& junk = workspace->junk;
+    find_dead_ranges(code_instructions, workspace->handlers, mod, workspace->scratch, junk);
+    junk.erase(std::remove_if(junk.begin(), junk.end(),
+                              [](const CodeRange& range) { return !range.malformed; }),
+               junk.end());
+    auto next_junk = junk.cbegin();
 
     while (!source.atEof()) {
+        if ((++instructions & 0x3FF) == 0)
+            check_deadline();
+        // Handlers may have stepped over the start of a range (such as the
+        // jump skipped after a return)
+        while (next_junk != junk.cend() && next_junk->end <= pos)
+            ++next_junk;
+        if (next_junk != junk.cend() && next_junk->start <= pos) {
+            source.skip(next_junk->end - pos);
+            pos = next_junk->end;
+            ++next_junk;
+            continue;
+        }
 #if defined(BLOCK_DEBUG) || defined(STACK_DEBUG)
         fprintf(stderr, "%-7d", pos);
     #ifdef STACK_DEBUG
@@ -163,8 +345,10 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
         case Pyc::BINARY_OP_A:
             {
                 ASTBinary::BinOp op = ASTBinary::from_binary_op(operand);
-                if (op == ASTBinary::BIN_INVALID)
+                if (op == ASTBinary::BIN_INVALID) {
                     fprintf(stderr, "Unsupported `BINARY_OP` operand value: %d\n", operand);
+                    build_failure(code, curpos, opcode, "Unsupported BINARY_OP operand");
+                }
                 PycRef<ASTNode> right = stack.top();
                 stack.pop();
                 PycRef<ASTNode> left = stack.top();
@@ -838,8 +1022,10 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                             curblock = blocks.top();
                             stack = stack_hist.top();
                             stack_hist.pop();
-                            if (!curblock->inited())
+                            if (!curblock->inited()) {
                                 fprintf(stderr, "Error when decompiling 'async for'.\n");
+                                build_failure(code, curpos, opcode, "Uninitialized 'async for' block");
+                            }
                         } else {
                             blocks.push(container);
                         }
@@ -972,6 +1158,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     stack.push(nullptr);
                 } else {
                      fprintf(stderr, "Unsupported use of GET_AITER outside of SETUP_LOOP\n");
+                     build_failure(code, curpos, opcode, "GET_AITER outside of SETUP_LOOP");
                 }
             }
             break;
@@ -1458,6 +1645,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                             }
                         } else {
                             fprintf(stderr, "Something TERRIBLE happened!!\n");
+                            build_failure(code, curpos, opcode, "Unexpected block before exception handler");
                         }
                         prev = nil;
                     } else {
@@ -1504,6 +1692,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
                 if (rhs.type() != ASTNode::NODE_OBJECT) {
                     fprintf(stderr, "Unsupported argument found for SET_UPDATE\n");
+                    build_failure(code, curpos, opcode, "Unsupported argument for SET_UPDATE");
                     break;
                 }
 
@@ -1511,6 +1700,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 PycRef<PycObject> obj = rhs.cast<ASTObject>()->object();
                 if (obj->type() != PycObject::TYPE_FROZENSET) {
                     fprintf(stderr, "Unsupported argument type found for SET_UPDATE\n");
+                    build_failure(code, curpos, opcode, "Unsupported argument type for SET_UPDATE");
                     break;
                 }
 
@@ -1531,6 +1721,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
                 if (rhs.type() != ASTNode::NODE_OBJECT) {
                     fprintf(stderr, "Unsupported argument found for LIST_EXTEND\n");
+                    build_failure(code, curpos, opcode, "Unsupported argument for LIST_EXTEND");
                     break;
                 }
 
@@ -1538,6 +1729,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 PycRef<PycObject> obj = rhs.cast<ASTObject>()->object();
                 if (obj->type() != PycObject::TYPE_TUPLE && obj->type() != PycObject::TYPE_SMALL_TUPLE) {
                     fprintf(stderr, "Unsupported argument type found for LIST_EXTEND\n");
+                    build_failure(code, curpos, opcode, "Unsupported argument type for LIST_EXTEND");
                     break;
                 }
 
@@ -1694,6 +1886,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                         stack_hist.pop();
                     } else {
                         fprintf(stderr, "Warning: Stack history is empty, something wrong might have happened\n");
+                        build_failure(code, curpos, opcode, "Stack history is empty");
                     }
                 }
                 PycRef<ASTBlock> tmp = curblock;
@@ -1875,7 +2068,10 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     curblock = blocks.top();
                     curblock->append(prev.cast<ASTNode>());
 
-                    bc_next(source, mod, opcode, operand, pos);
+                    // Skip the jump over the rest of the statement, unless
+                    // something else jumps to it
+                    if (!jumps.isTarget(pos))
+                        bc_next(source, mod, opcode, operand, pos);
                 }
             }
             break;
@@ -1898,7 +2094,10 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                     curblock = blocks.top();
                     curblock->append(prev.cast<ASTNode>());
 
-                    bc_next(source, mod, opcode, operand, pos);
+                    // Skip the jump over the rest of the statement, unless
+                    // something else jumps to it
+                    if (!jumps.isTarget(pos))
+                        bc_next(source, mod, opcode, operand, pos);
                 }
             }
             break;
@@ -1978,6 +2177,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
                 if (none != NULL) {
                     fprintf(stderr, "Something TERRIBLE happened!\n");
+                    build_failure(code, curpos, opcode, "Unexpected value on the stack");
                     break;
                 }
 
@@ -1990,6 +2190,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
                 }
                 else {
                     fprintf(stderr, "Something TERRIBLE happened! No matching with block found for WITH_CLEANUP at %d\n", curpos);
+                    build_failure(code, curpos, opcode, "No with block for WITH_CLEANUP");
                 }
             }
             break;
@@ -2562,6 +2763,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
             break;
         default:
             fprintf(stderr, "Unsupported opcode: %s (%d)\n", Pyc::OpcodeName(opcode), opcode);
+            build_failure(code, curpos, opcode, "Unsupported opcode");
             cleanBuild = false;
             return new ASTNodeList(defblock->nodes());
         }
@@ -2574,6 +2776,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
     if (stack_hist.size()) {
         fputs("Warning: Stack history is not empty!\n", stderr);
+        build_failure(code, pos, -1, "Stack history is not empty");
 
         while (stack_hist.size()) {
             stack_hist.pop();
@@ -2582,6 +2785,7 @@ PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod)
 
     if (blocks.size() > 1) {
         fputs("Warning: block stack is not empty!\n", stderr);
+        build_failure(code, pos, -1, "Block stack is not empty");
 
         while (blocks.size() > 1) {
             PycRef<ASTBlock> tmp = blocks.top();
@@ -2708,7 +2912,7 @@ static void end_line(std::ostream& pyc_output)
     pyc_output << "\n";
 }
 
-int cur_indent = -1;
+thread_local int cur_indent = -1;
 static void print_block(PycRef<ASTBlock> blk, PycModule* mod,
                         std::ostream& pyc_output)
 {
@@ -2756,6 +2960,26 @@ void print_formatted_value(PycRef<ASTFormattedValue> formatted_value, PycModule*
     pyc_output << "}";
 }
 
+/* A list or set display of constants (built from one constant by
+ * LIST_EXTEND or SET_UPDATE) that is over the item limit of const_limits(),
+ * as a constant print_const() can cut short.  Null if it is printed in full. */
+template <class _Values>
+static PycRef<PycObject> elided_display(const _Values& values, PycSimpleSequence* seq)
+{
+    PycRef<PycSimpleSequence> result = seq;
+    if (const_items_shown(values.size()) == values.size())
+        return nullptr;
+
+    PycSimpleSequence::value_t objects;
+    for (const auto& val : values) {
+        if (val.type() != ASTNode::NODE_OBJECT)
+            return nullptr;
+        objects.push_back(val.template cast<ASTObject>()->object());
+    }
+    result->setValues(std::move(objects));
+    return result.cast<PycObject>();
+}
+
 void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
 {
     if (node == NULL) {
@@ -2874,6 +3098,11 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
         break;
     case ASTNode::NODE_LIST:
         {
+            PycRef<PycObject> elided = elided_display(node.cast<ASTList>()->values(), new PycList);
+            if (elided != nullptr) {
+                print_const(pyc_output, elided, mod);
+                break;
+            }
             pyc_output << "[";
             bool first = true;
             cur_indent++;
@@ -2892,6 +3121,11 @@ void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output)
         break;
     case ASTNode::NODE_SET:
         {
+            PycRef<PycObject> elided = elided_display(node.cast<ASTSet>()->values(), new PycSet);
+            if (elided != nullptr) {
+                print_const(pyc_output, elided, mod);
+                break;
+            }
             pyc_output << "{";
             bool first = true;
             cur_indent++;
@@ -3432,16 +3666,60 @@ bool print_docstring(PycRef<PycObject> obj, int indent, PycModule* mod,
     auto doc = obj.try_cast<PycString>();
     if (doc != nullptr) {
         start_line(indent, pyc_output);
-        doc->print(pyc_output, mod, true);
+        if (!print_elided_string(pyc_output, doc, mod))
+            doc->print(pyc_output, mod, true);
         pyc_output << "\n";
         return true;
     }
     return false;
 }
 
-void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+/* The body printed for a code object given up on, in fail-fast mode or
+ * because its stack underflows */
+static void print_aborted(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
+{
+    printDocstringAndGlobals = false;
+    printClassDocstring = false;
+    cleanBuild = false;
+    if (inLambda) {
+        pyc_output << "None";
+        return;
+    }
+
+    const DecompyleFailure& failure = failures.back();
+    start_line(cur_indent + 1, pyc_output);
+    pyc_output << "pass\n";
+    start_line(cur_indent + 1, pyc_output);
+    pyc_output << "# " << failure.reason << " at offset " << failure.offset;
+    if (failure.opcode >= 0)
+        pyc_output << " (" << Pyc::OpcodeName(failure.opcode) << ")";
+    pyc_output << "\n";
+
+    if (failFastDisasm) {
+        std::ostringstream disasm;
+        output_object(code.cast<PycObject>(), mod, 0, Pyc::DISASM_CODE_REFS, disasm);
+        std::istringstream lines(disasm.str());
+        std::string line;
+        while (std::getline(lines, line)) {
+            start_line(cur_indent + 1, pyc_output);
+            pyc_output << "# " << line << "\n";
+        }
+    }
+}
+
+static void decompyle_code(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
 {
-    PycRef<ASTNode> source = BuildFromCode(code, mod);
+    check_deadline();
+    PycRef<ASTNode> source;
+    try {
+        source = BuildFromCode(code, mod);
+    } catch (BuildAborted&) {
+        print_aborted(code, mod, pyc_output);
+        start_line(cur_indent, pyc_output);
+        pyc_output << "# WARNING: Decompyle incomplete\n";
+        ++incompleteCount;
+        return;
+    }
 
     PycRef<ASTNodeList> clean = source.cast<ASTNodeList>();
     if (cleanBuild) {
@@ -3533,5 +3811,155 @@ void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output)
     if (!cleanBuild || !part1clean) {
         start_line(cur_indent, pyc_output);
         pyc_output << "# WARNING: Decompyle incomplete\n";
+        ++incompleteCount;
+    }
+}
+
+void DecompyleCache::clear()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_previous.clear();
+    m_current.clear();
+    m_hits = m_misses = 0;
+}
+
+/* Cache of the module being decompiled on this thread, if any */
+static thread_local DecompyleCache* s_cache = nullptr;
+
+/* Everything the output of a nested code object depends on, besides the
+ * code object itself */
+static unsigned decompyle_entry_state(PycModule* mod)
+{
+    return (inLambda ? 0x1 : 0) | (printDocstringAndGlobals ? 0x2 : 0)
+         | (printClassDocstring ? 0x4 : 0) | (mod->isUnicode() ? 0x8 : 0)
+         | ((mod->majorVer() * 100 + mod->minorVer()) << 4)
+         | ((unsigned)(cur_indent + 1) << 16);
+}
+
+/* Decompiler state left behind by a nested code object */
+static unsigned decompyle_exit_state()
+{
+    return (cleanBuild ? 0x1 : 0) | (inLambda ? 0x2 : 0)
+         | (printDocstringAndGlobals ? 0x4 : 0) | (printClassDocstring ? 0x8 : 0);
+}
+
+static void restore_exit_state(unsigned state)
+{
+    cleanBuild = (state & 0x1) != 0;
+    inLambda = (state & 0x2) != 0;
+    printDocstringAndGlobals = (state & 0x4) != 0;
+    printClassDocstring = (state & 0x8) != 0;
+}
+
+void decompyle_set_timeout(double seconds)
+{
+    hasDeadline = (seconds > 0);
+    if (hasDeadline) {
+        deadline = std::chrono::steady_clock::now()
+                 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double>(seconds));
+    }
+}
+
+const std::vector<DecompyleFailure>& decompyle_failures()
+{
+    return failures;
+}
+
+void decompyle_set_fail_fast(bool enabled, bool disassemble)
+{
+    failFast = enabled;
+    failFastDisasm = enabled && disassemble;
+}
+
+bool decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output,
+               DecompyleCache* cache)
+{
+    if (code.isIdent(mod->code())) {
+        // Starting a new module -- forget anything left over from a previous
+        // one decompiled on this thread (possibly aborted by an exception)
+        cur_indent = -1;
+        inLambda = false;
+        printDocstringAndGlobals = false;
+        printClassDocstring = true;
+        incompleteCount = 0;
+        failures.clear();
+
+        s_cache = cache;
+        if (cache) {
+            std::lock_guard<std::mutex> guard(cache->m_lock);
+            cache->m_previous.swap(cache->m_current);
+            cache->m_current.clear();
+            cache->m_hits = cache->m_misses = 0;
+        }
+        decompyle_code(code, mod, pyc_output);
+        return incompleteCount == 0;
+    }
+
+    if (!s_cache) {
+        decompyle_code(code, mod, pyc_output);
+        return incompleteCount == 0;
+    }
+
+    DecompyleCache* nested = s_cache;
+    DecompyleCache::key_t key(code_fingerprint(code, mod, true),
+                              decompyle_entry_state(mod));
+    {
+        std::lock_guard<std::mutex> guard(nested->m_lock);
+        auto iter = nested->m_current.find(key);
+        if (iter == nested->m_current.end()) {
+            auto prev = nested->m_previous.find(key);
+            if (prev != nested->m_previous.end()) {
+                iter = nested->m_current.emplace(key, std::move(prev->second)).first;
+                nested->m_previous.erase(prev);
+            }
+        }
+        if (iter != nested->m_current.end()) {
+            pyc_output << iter->second.text;
+            restore_exit_state(iter->second.exitState);
+            incompleteCount += iter->second.incomplete;
+            failures.insert(failures.end(), iter->second.failures.begin(),
+                            iter->second.failures.end());
+            ++nested->m_hits;
+            return incompleteCount == 0;
+        }
+    }
+
+    int incompleteBefore = incompleteCount;
+    size_t failuresBefore = failures.size();
+    std::ostringstream text;
+    decompyle_code(code, mod, text);
+    pyc_output << text.str();
+
+    std::lock_guard<std::mutex> guard(nested->m_lock);
+    nested->m_current[key] = { text.str(), decompyle_exit_state(),
+                               incompleteCount - incompleteBefore,
+                               std::vector<DecompyleFailure>(failures.begin() + failuresBefore,
+                                                             failures.end()) };
+    ++nested->m_misses;
+    return incompleteCount == 0;
+}
+
+void predecompyle(PycRef<PycCode> code, PycModule* mod, int indent, bool classBody,
+                  DecompyleCache* cache)
+{
+    // The state print_src() sets up before printing a def or class body
+    cur_indent = indent;
+    inLambda = false;
+    printDocstringAndGlobals = !classBody;
+    printClassDocstring = classBody;
+
+    failures.clear();
+
+    s_cache = cache;
+    std::ostringstream discard;
+    try {
+        decompyle(code, mod, discard);
+    } catch (DecompyleTimeout&) {
+        s_cache = nullptr;
+        throw;
+    } catch (std::exception&) {
+        // Reported when the module itself is decompiled
     }
+    s_cache = nullptr;
 }
@@ -2,10 +2,95 @@
 #define _PYC_ASTREE_H
 
 #include "ASTNode.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 PycRef<ASTNode> BuildFromCode(PycRef<PycCode> code, PycModule* mod);
 void print_src(PycRef<ASTNode> node, PycModule* mod, std::ostream& pyc_output);
 
-void decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output);
+/* A construct BuildFromCode() could not decompile */
+struct DecompyleFailure {
+    std::string code;       // Qualified name of the code object
+    int firstLine;
+    int offset;             // Of the instruction, in bytes
+    int opcode;             // Pyc::Opcode, or -1
+    std::string reason;
+};
+
+/* Output of the nested code objects of one module, kept between successive
+ * decompilations of (versions of) that module.  A code object whose deep
+ * fingerprint and printing context are unchanged is not decompiled again.
+ * Entries not used by the latest decompilation are dropped.  The cache may
+ * be filled from several threads at once (see predecompyle). */
+class DecompyleCache {
+public:
+    DecompyleCache() : m_hits(), m_misses() { }
+
+    /* Statistics of the latest decompilation */
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
+    void clear();
+
+private:
+    DecompyleCache(const DecompyleCache&) = delete;
+    DecompyleCache& operator=(const DecompyleCache&) = delete;
+
+    friend bool decompyle(PycRef<PycCode> code, PycModule* mod,
+                          std::ostream& pyc_output, DecompyleCache* cache);
+
+    struct Entry {
+        std::string text;
+        unsigned exitState;
+        int incomplete;     // Number of incomplete code objects in text
+        std::vector<DecompyleFailure> failures;
+    };
+    typedef std::pair<uint64_t, unsigned> key_t;   // Fingerprint, entry state
+
+    std::mutex m_lock;
+    std::map<key_t, Entry> m_previous, m_current;
+    int m_hits, m_misses;
+};
+
+/* Returns false if any part of the module could not be decompiled, i.e. the
+ * output contains a "Decompyle incomplete" warning */
+bool decompyle(PycRef<PycCode> code, PycModule* mod, std::ostream& pyc_output,
+               DecompyleCache* cache = nullptr);
+
+/* The failures found by the latest decompyle() of a whole module on the
+ * calling thread; those of a code object come before those of the code
+ * objects nested in it */
+const std::vector<DecompyleFailure>& decompyle_failures();
+
+/* Fail-fast mode, for triage runs: give up on a code object at its first
+ * failure, instead of going on with a stack that is likely wrong, and print
+ * only "pass" and the failure (as a comment) for its body.  With
+ * disassemble, the body also gets the disassembly of the code object, in
+ * comments.  Applies to all threads. */
+void decompyle_set_fail_fast(bool enabled, bool disassemble);
+
+/* Thrown by decompyle() once the timeout of the calling thread has passed */
+class DecompyleTimeout : public std::runtime_error {
+public:
+    DecompyleTimeout() : std::runtime_error("Decompilation timed out") { }
+};
+
+/* Limit the following decompyle() calls on the calling thread to the given
+ * number of seconds from now.  0 removes the limit. */
+void decompyle_set_timeout(double seconds);
+
+/* Decompile a nested code object of mod ahead of time into cache, for a
+ * following decompyle() of the whole module with the same cache.  The result
+ * is only used if the object is printed as a function or class body at the
+ * given indentation, so a wrong guess costs time but never changes the
+ * output.  Used to spread one large module over several threads.  Errors
+ * are left for decompyle() to report, except DecompyleTimeout, which is
+ * thrown so the caller can stop starting more work. */
+void predecompyle(PycRef<PycCode> code, PycModule* mod, int indent, bool classBody,
+                  DecompyleCache* cache);
 
 #endif
@@ -0,0 +1,127 @@
+#ifndef _PYC_BOUNDEDQUEUE_H
+#define _PYC_BOUNDEDQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+/* Bounded multi-producer multi-consumer queue (D. Vyukov's array-based
+ * algorithm).  tryPush and tryPop never lock; push and pop back off by
+ * spinning, yielding and finally sleeping while the queue is full or empty,
+ * so a full queue applies backpressure to its producers. */
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity)
+        : m_enqueuePos(0), m_dequeuePos(0), m_closed(false)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+    bool tryPush(T& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // Full
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;   // Empty
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* Blocks while the queue is full */
+    void push(T value)
+    {
+        for (unsigned attempt = 0; !tryPush(value); ++attempt)
+            backoff(attempt);
+    }
+
+    /* Blocks while the queue is empty.  Returns false once the queue is
+     * closed and drained. */
+    bool pop(T& value)
+    {
+        for (unsigned attempt = 0; !tryPop(value); ++attempt) {
+            if (m_closed.load(std::memory_order_acquire))
+                return tryPop(value);
+            backoff(attempt);
+        }
+        return true;
+    }
+
+    /* No more items will be pushed */
+    void close() { m_closed.store(true, std::memory_order_release); }
+
+private:
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    static void backoff(unsigned attempt)
+    {
+        if (attempt < 64)
+            return;
+        if (attempt < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(attempt < 256 ? 50 : 500));
+    }
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Keep the producer and consumer positions on separate cache lines
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueuePos;
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeuePos;
+    char m_pad2[64];
+    std::atomic<bool> m_closed;
+};
+
+#endif
@@ -2,7 +2,8 @@
 #define _PYC_FASTSTACK_H
 
 #include "ASTNode.h"
-#include <stack>
+#include "allocstats.h"
+#include <vector>
 
 class FastStack {
 public:
@@ -45,11 +46,69 @@ public:
         return m_ptr == -1;
     }
 
+    /* Empties the stack and sizes it for size entries.  The buffer is kept,
+     * but copies (see FastStackHistory) only take the new size. */
+    void reset(int size)
+    {
+        clear();
+        m_stack.resize(size);
+    }
+
+    void clear()
+    {
+        while (m_ptr > -1)
+            m_stack[m_ptr--] = nullptr;
+    }
+
+    size_t capacity() const { return m_stack.capacity(); }
+    size_t bytes() const { return m_stack.capacity() * sizeof(PycRef<ASTNode>); }
+
 private:
-    std::vector<PycRef<ASTNode>> m_stack;
+    std::vector<PycRef<ASTNode>, CountingAllocator<PycRef<ASTNode>, ALLOC_STACK>> m_stack;
     int m_ptr;
 };
 
-typedef std::stack<FastStack> stackhist_t;
+/* Saved copies of a FastStack, like a std::stack<FastStack>, except that
+ * popped stacks keep their buffers for the next push to copy into */
+class FastStackHistory {
+public:
+    FastStackHistory() : m_size(0) { }
+
+    void push(const FastStack& stack)
+    {
+        if (m_size == m_stacks.size())
+            m_stacks.push_back(stack);
+        else
+            m_stacks[m_size] = stack;
+        ++m_size;
+    }
+
+    void pop()
+    {
+        if (m_size > 0)
+            m_stacks[--m_size].clear();
+    }
+
+    const FastStack& top() const { return m_stacks[m_size - 1]; }
+    bool empty() const { return m_size == 0; }
+    size_t size() const { return m_size; }
+
+    /* Number of stacks kept allocated */
+    size_t capacity() const { return m_stacks.size(); }
+
+    size_t bytes() const
+    {
+        size_t bytes = m_stacks.capacity() * sizeof(FastStack);
+        for (const FastStack& stack : m_stacks)
+            bytes += stack.bytes();
+        return bytes;
+    }
+
+private:
+    std::vector<FastStack, CountingAllocator<FastStack, ALLOC_STACK>> m_stacks;
+    size_t m_size;
+};
+
+typedef FastStackHistory stackhist_t;
 
 #endif
@@ -0,0 +1,182 @@
+#include "allocstats.h"
+#include "ASTNode.h"
+#include "pyc_object.h"
+
+bool g_alloc_stats_enabled = false;
+
+static thread_local AllocStats* s_current = nullptr;
+
+/* Sizes of objects allocated but not constructed yet.  New-expressions
+ * nest (an argument of a constructor may be allocated after the object
+ * itself), and the innermost object is always constructed first. */
+static const int MAX_PENDING = 32;
+static thread_local size_t s_pending[MAX_PENDING];
+static thread_local int s_pendingCount = 0;
+
+static AllocTypeStats s_typeStats[2];
+
+const char* alloc_subsystem_name(int subsystem)
+{
+    static const char* names[] = { "loader", "object", "ast", "stack", "printer" };
+    return (subsystem >= 0 && subsystem < ALLOC_SUBSYSTEMS) ? names[subsystem] : "unknown";
+}
+
+void set_alloc_stats_enabled(bool enabled)
+{
+    g_alloc_stats_enabled = enabled;
+}
+
+void AllocStats::update(AllocCounter& counter, int64_t bytes)
+{
+    int64_t live = counter.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (bytes <= 0)
+        return;
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    int64_t peak = counter.peak.load(std::memory_order_relaxed);
+    while (live > peak && !counter.peak.compare_exchange_weak(peak, live,
+                                                              std::memory_order_relaxed))
+        ;
+}
+
+void AllocStats::add(int subsystem, int64_t bytes)
+{
+    update(m_subsystems[subsystem], bytes);
+    update(m_total, bytes);
+}
+
+AllocScope::AllocScope(AllocStats* stats) : m_previous(s_current)
+{
+    s_current = stats;
+}
+
+AllocScope::~AllocScope()
+{
+    s_current = m_previous;
+}
+
+AllocStats* current_alloc_stats()
+{
+    return s_current;
+}
+
+void alloc_track(int subsystem, int64_t bytes)
+{
+    if (g_alloc_stats_enabled && s_current && bytes != 0)
+        s_current->add(subsystem, bytes);
+}
+
+void alloc_object_new(int subsystem, size_t size)
+{
+    alloc_track(subsystem, (int64_t)size);
+    if (s_pendingCount < MAX_PENDING)
+        s_pending[s_pendingCount] = size;
+    ++s_pendingCount;
+}
+
+void alloc_object_constructed(int subsystem, int type)
+{
+    // Objects that were not allocated with new (such as the immortal
+    // singletons) find nothing pending
+    if (s_pendingCount == 0)
+        return;
+    --s_pendingCount;
+    if (s_pendingCount >= MAX_PENDING || type < 0 || type >= AllocTypeStats::MAX_TYPES)
+        return;
+    AllocTypeStats& stats = s_typeStats[subsystem == ALLOC_AST];
+    stats.count[type].fetch_add(1, std::memory_order_relaxed);
+    stats.bytes[type].fetch_add(s_pending[s_pendingCount], std::memory_order_relaxed);
+}
+
+void alloc_object_delete(int subsystem, size_t size)
+{
+    alloc_track(subsystem, -(int64_t)size);
+}
+
+/* The class allocators live here rather than next to the classes, so the
+ * compiler can't inline them into the new-expressions of those files and
+ * then take the operator delete of a failed constructor for a mismatch */
+void* PycObject::operator new(size_t size)
+{
+    void* ptr = ::operator new(size);
+    if (alloc_stats_enabled())
+        alloc_object_new(ALLOC_OBJECT, size);
+    return ptr;
+}
+
+void PycObject::operator delete(void* ptr, size_t size)
+{
+    if (alloc_stats_enabled())
+        alloc_object_delete(ALLOC_OBJECT, size);
+    ::operator delete(ptr);
+}
+
+void* ASTNode::operator new(size_t size)
+{
+    void* ptr = ::operator new(size);
+    if (alloc_stats_enabled())
+        alloc_object_new(ALLOC_AST, size);
+    return ptr;
+}
+
+void ASTNode::operator delete(void* ptr, size_t size)
+{
+    if (alloc_stats_enabled())
+        alloc_object_delete(ALLOC_AST, size);
+    ::operator delete(ptr);
+}
+
+const AllocTypeStats& alloc_type_stats(int subsystem)
+{
+    return s_typeStats[subsystem == ALLOC_AST];
+}
+
+const char* alloc_type_name(int subsystem, int type)
+{
+    if (subsystem == ALLOC_AST) {
+        static const char* names[] = {
+            "invalid", "nodelist", "object", "unary", "binary", "compare", "slice",
+            "store", "return", "name", "delete", "function", "class", "call", "import",
+            "tuple", "list", "set", "map", "subscr", "print", "convert", "keyword",
+            "raise", "exec", "block", "comprehension", "loadbuildclass", "awaitable",
+            "formattedvalue", "joinedstr", "const_map", "annotated_var", "chainstore",
+            "ternary", "kw_names_map", "locals",
+        };
+        static_assert(sizeof(names) / sizeof(names[0]) == ASTNode::NODE_LOCALS + 1,
+                      "Node type names out of date");
+        return (type >= 0 && type <= ASTNode::NODE_LOCALS) ? names[type] : "unknown";
+    }
+
+    // Objects by marshal type, named as in the CPython marshal module
+    switch (type) {
+    case PycObject::TYPE_NULL: return "null";
+    case PycObject::TYPE_NONE: return "none";
+    case PycObject::TYPE_FALSE: return "false";
+    case PycObject::TYPE_TRUE: return "true";
+    case PycObject::TYPE_STOPITER: return "stopiter";
+    case PycObject::TYPE_ELLIPSIS: return "ellipsis";
+    case PycObject::TYPE_INT: return "int";
+    case PycObject::TYPE_INT64: return "int64";
+    case PycObject::TYPE_FLOAT: return "float";
+    case PycObject::TYPE_BINARY_FLOAT: return "binary_float";
+    case PycObject::TYPE_COMPLEX: return "complex";
+    case PycObject::TYPE_BINARY_COMPLEX: return "binary_complex";
+    case PycObject::TYPE_LONG: return "long";
+    case PycObject::TYPE_STRING: return "string";
+    case PycObject::TYPE_INTERNED: return "interned";
+    case PycObject::TYPE_UNICODE: return "unicode";
+    case PycObject::TYPE_ASCII: return "ascii";
+    case PycObject::TYPE_ASCII_INTERNED: return "ascii_interned";
+    case PycObject::TYPE_SHORT_ASCII: return "short_ascii";
+    case PycObject::TYPE_SHORT_ASCII_INTERNED: return "short_ascii_interned";
+    case PycObject::TYPE_TUPLE: return "tuple";
+    case PycObject::TYPE_SMALL_TUPLE: return "small_tuple";
+    case PycObject::TYPE_LIST: return "list";
+    case PycObject::TYPE_DICT: return "dict";
+    case PycObject::TYPE_SET: return "set";
+    case PycObject::TYPE_FROZENSET: return "frozenset";
+    case PycObject::TYPE_CODE: return "code";
+    case PycObject::TYPE_CODE2: return "code2";
+    case PycObject::TYPE_UNKNOWN: return "unknown";
+    default: return "other";
+    }
+}
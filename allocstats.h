@@ -0,0 +1,133 @@
+#ifndef _PYC_ALLOCSTATS_H
+#define _PYC_ALLOCSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/* Optional accounting of the memory used by each part of the decompiler,
+ * to tell where the memory of a large input goes.  PycObjects and ASTNodes
+ * are counted by their class allocators, the other subsystems where their
+ * buffers are sized.  Allocations are charged to the AllocStats made
+ * current on the allocating thread by an AllocScope, and frees to the one
+ * current on the freeing thread.  Accounting is off unless enabled before
+ * any threads start; while off, each hook only tests a flag. */
+
+enum AllocSubsystem {
+    ALLOC_LOADER,       // Input file buffers
+    ALLOC_OBJECT,       // PycObjects unmarshalled from them
+    ALLOC_AST,          // ASTNodes
+    ALLOC_STACK,        // FastStack buffers and their history
+    ALLOC_PRINTER,      // Output buffers
+    ALLOC_SUBSYSTEMS
+};
+
+const char* alloc_subsystem_name(int subsystem);
+
+extern bool g_alloc_stats_enabled;
+
+inline bool alloc_stats_enabled() { return g_alloc_stats_enabled; }
+void set_alloc_stats_enabled(bool enabled);
+
+struct AllocCounter {
+    AllocCounter() : live(0), peak(0), count(0) { }
+
+    std::atomic<int64_t> live;      // Bytes
+    std::atomic<int64_t> peak;
+    std::atomic<uint64_t> count;    // Allocations
+};
+
+/* The counters of one file, or any other unit of work */
+class AllocStats {
+public:
+    /* Allocates (positive) or frees (negative) bytes of the subsystem */
+    void add(int subsystem, int64_t bytes);
+
+    /* Totals, where the peak is the highest of all subsystems together */
+    const AllocCounter& total() const { return m_total; }
+    const AllocCounter& subsystem(int subsystem) const { return m_subsystems[subsystem]; }
+
+private:
+    static void update(AllocCounter& counter, int64_t bytes);
+
+    AllocCounter m_total;
+    AllocCounter m_subsystems[ALLOC_SUBSYSTEMS];
+};
+
+/* Makes stats (which may be NULL) current on the calling thread for the
+ * lifetime of the scope */
+class AllocScope {
+public:
+    explicit AllocScope(AllocStats* stats);
+    ~AllocScope();
+
+private:
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+    AllocStats* m_previous;
+};
+
+/* The stats current on the calling thread, or NULL */
+AllocStats* current_alloc_stats();
+
+/* Charges bytes to the current stats, if accounting is enabled */
+void alloc_track(int subsystem, int64_t bytes);
+
+/* Hooks of the class allocators of PycObject and ASTNode, only called while
+ * accounting is enabled.  The size of each object is also counted for its
+ * type (marshal type or node type) once its base constructor runs. */
+void alloc_object_new(int subsystem, size_t size);
+void alloc_object_constructed(int subsystem, int type);
+void alloc_object_delete(int subsystem, size_t size);
+
+/* Objects and bytes allocated per type since accounting was enabled, for
+ * ALLOC_OBJECT and ALLOC_AST, over all threads */
+struct AllocTypeStats {
+    enum { MAX_TYPES = 128 };
+
+    std::atomic<uint64_t> count[MAX_TYPES];
+    std::atomic<uint64_t> bytes[MAX_TYPES];
+};
+
+const AllocTypeStats& alloc_type_stats(int subsystem);
+const char* alloc_type_name(int subsystem, int type);
+
+/* A std::allocator that charges its allocations to a subsystem, e.g. for
+ * the buffer of a string stream */
+template <typename T, int Subsystem>
+struct CountingAllocator {
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind { typedef CountingAllocator<U, Subsystem> other; };
+
+    CountingAllocator() { }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U, Subsystem>&) { }
+
+    T* allocate(size_t count)
+    {
+        T* ptr = std::allocator<T>().allocate(count);
+        if (alloc_stats_enabled())
+            alloc_track(Subsystem, (int64_t)(count * sizeof(T)));
+        return ptr;
+    }
+
+    void deallocate(T* ptr, size_t count)
+    {
+        if (alloc_stats_enabled())
+            alloc_track(Subsystem, -(int64_t)(count * sizeof(T)));
+        std::allocator<T>().deallocate(ptr, count);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U, Subsystem>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U, Subsystem>&) const { return false; }
+};
+
+#endif
@@ -1,8 +1,15 @@
 #include "pyc_numeric.h"
 #include "bytecode.h"
+#include "codeflow.h"
+#include <algorithm>
 #include <stdexcept>
 #include <cstdint>
 #include <cmath>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <streambuf>
+#include <vector>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -63,7 +70,7 @@ const char* Pyc::OpcodeName(int opcode)
     if (opcode < PYC_LAST_OPCODE)
         return opcode_names[opcode];
 
-    static char badcode[16];
+    static thread_local char badcode[16];
     snprintf(badcode, sizeof(badcode), "<%d>", opcode);
     return badcode;
 };
@@ -115,8 +122,393 @@ int Pyc::ByteToOpcode(int maj, int min, int opcode)
     return PYC_INVALID_OPCODE;
 }
 
+namespace {
+
+enum { ARG = Pyc::STACK_ARG, SPECIAL = Pyc::STACK_SPECIAL };
+
+/* Every Python version gets a complete table, so that looking up an opcode
+ * does not need to search the version overrides */
+struct OpcodeTables {
+    static const int VERSIONS = 48;     // (major - 1) * 16 + minor
+
+    static int versionIndex(int major, int minor)
+    {
+        int index = (major - 1) * 16 + minor;
+        return index < 0 ? 0 : (index >= VERSIONS ? VERSIONS - 1 : index);
+    }
+
+    OpcodeTables()
+    {
+        using namespace Pyc;
+
+        struct Override {
+            int version;
+            int opcode;
+            OpcodeInfo info;
+        };
+        std::vector<Override> overrides;
+
+        for (int op = 0; op < PYC_LAST_OPCODE; ++op) {
+            unsigned char operand = op >= PYC_HAVE_ARG ? ARG_NUMBER : ARG_NONE;
+            tables[0][op] = { operand, 0, 0, 0, 0, 0 };
+        }
+
+        #define OPINFO(op, operand, pops, pushes, flags) \
+            tables[0][op] = { operand, 0, pops, pushes, flags, 0 };
+        #define OPINFO_SINCE(maj, min, op, operand, shift, pops, pushes, flags, caches) \
+            overrides.push_back({ versionIndex(maj, min), op, \
+                                  { operand, shift, pops, pushes, flags, caches } });
+        #include "bytecode_info.inl"
+        #undef OPINFO_SINCE
+        #undef OPINFO
+
+        for (int version = VERSIONS - 1; version >= 0; --version) {
+            std::copy(tables[0], tables[0] + PYC_LAST_OPCODE, tables[version]);
+            for (const Override& entry : overrides) {
+                if (entry.version <= version)
+                    tables[version][entry.opcode] = entry.info;
+            }
+        }
+    }
+
+    Pyc::OpcodeInfo tables[VERSIONS][Pyc::PYC_LAST_OPCODE];
+};
+
+}
+
+const Pyc::OpcodeInfo& Pyc::GetOpcodeInfo(int opcode, PycModule* mod)
+{
+    static const OpcodeTables opcode_tables;
+    static const OpcodeInfo invalid = { ARG_NONE, 0, 0, 0, 0, 0 };
+
+    if (opcode < 0 || opcode >= PYC_LAST_OPCODE)
+        return invalid;
+    int version = OpcodeTables::versionIndex(mod->majorVer(), mod->minorVer());
+    return opcode_tables.tables[version][opcode];
+}
+
+void Pyc::StackEffect(int opcode, int operand, PycModule* mod, bool jump,
+                      int& pops, int& pushes)
+{
+    const OpcodeInfo& info = GetOpcodeInfo(opcode, mod);
+    pops = info.pops == STACK_ARG ? operand : info.pops;
+    pushes = info.pushes == STACK_ARG ? operand : info.pushes;
+
+    if (info.pops == STACK_SPECIAL || info.pushes == STACK_SPECIAL) {
+        switch (opcode) {
+        case BUILD_MAP_A:
+            // Before Python 3.5, the operand is only a size hint
+            pops = mod->verCompare(3, 5) >= 0 ? 2 * operand : 0;
+            break;
+        case LOAD_ATTR_A:
+        case LOAD_GLOBAL_A:
+        case LOAD_SUPER_ATTR_A:
+        case INSTRUMENTED_LOAD_SUPER_ATTR_A:
+            // The low bit requests NULL or self for a following call
+            pushes = 1 + (operand & 1);
+            break;
+        case CALL_FUNCTION_A:
+        case CALL_FUNCTION_VAR_A:
+        case CALL_FUNCTION_KW_A:
+        case CALL_FUNCTION_VAR_KW_A:
+            if (mod->verCompare(3, 6) >= 0) {
+                pops = operand + (opcode == CALL_FUNCTION_KW_A ? 2 : 1);
+            } else {
+                pops = 1 + (operand & 0xFF) + 2 * ((operand >> 8) & 0xFF);
+                if (opcode == CALL_FUNCTION_VAR_KW_A)
+                    pops += 2;
+                else if (opcode != CALL_FUNCTION_A)
+                    pops += 1;
+            }
+            break;
+        case CALL_FUNCTION_EX_A:
+        case INSTRUMENTED_CALL_FUNCTION_EX_A:
+            pops = (mod->verCompare(3, 11) >= 0 ? 3 : 2) + (operand & 1);
+            break;
+        case CALL_METHOD_A:
+        case CALL_A:
+        case INSTRUMENTED_CALL_A:
+            pops = operand + 2;
+            break;
+        case CALL_KW_A:
+        case INSTRUMENTED_CALL_KW_A:
+            pops = operand + 3;
+            break;
+        case MAKE_FUNCTION_A:
+        case MAKE_CLOSURE_A:
+            if (mod->verCompare(3, 6) >= 0) {
+                // Code (and qualified name before 3.11), plus one value per flag
+                pops = mod->verCompare(3, 11) >= 0 ? 1 : 2;
+                for (int flag = 0x1; flag <= 0x8; flag <<= 1) {
+                    if (operand & flag)
+                        ++pops;
+                }
+            } else if (mod->majorVer() >= 3) {
+                pops = 1 + (operand & 0xFF) + 2 * ((operand >> 8) & 0xFF)
+                         + ((operand >> 16) & 0x7FFF);
+                if (mod->verCompare(3, 3) >= 0)
+                    pops += 1;
+            } else {
+                pops = 1 + operand;
+            }
+            if (opcode == MAKE_CLOSURE_A)
+                pops += 1;
+            break;
+        case DUP_TOPX_A:
+            pushes = 2 * operand;
+            break;
+        case UNPACK_EX_A:
+            pushes = (operand & 0xFF) + (operand >> 8) + 1;
+            break;
+        case BUILD_MAP_UNPACK_WITH_CALL_A:
+            pops = mod->verCompare(3, 6) >= 0 ? operand : (operand & 0xFF);
+            break;
+        case FORMAT_VALUE_A:
+            pops = (operand & 0x4) ? 2 : 1;
+            break;
+        case BUILD_CONST_KEY_MAP_A:
+            pops = operand + 1;
+            break;
+        case BUILD_SLICE_A:
+            pops = operand == 3 ? 3 : 2;
+            break;
+        case END_FINALLY:
+            // Only pops None when reached normally, but unwinds the whole
+            // frame pushed for the handler (which is the deeper path)
+            pops = mod->majorVer() >= 3 ? 6 : 3;
+            break;
+        case COPY_A:
+            pushes = operand + 1;
+            break;
+        }
+    }
+
+    if (!jump)
+        return;
+    switch (opcode) {
+    case FOR_ITER_A:
+    case INSTRUMENTED_FOR_ITER_A:
+        // Since 3.12, the iterator is popped by the END_FOR at the target
+        if (mod->verCompare(3, 12) < 0) {
+            pops = 1;
+            pushes = 0;
+        }
+        break;
+    case FOR_LOOP_A:
+        pops = 2;
+        pushes = 0;
+        break;
+    case JUMP_IF_FALSE_OR_POP_A:
+    case JUMP_IF_TRUE_OR_POP_A:
+        pops = pushes = 1;
+        break;
+    case SETUP_EXCEPT_A:
+    case SETUP_FINALLY_A:
+        // Handlers start with the exception on the stack
+        pushes = mod->majorVer() >= 3 ? 6 : 3;
+        break;
+    case SETUP_WITH_A:
+        pushes = mod->majorVer() >= 3 ? 7 : 4;
+        break;
+    case SETUP_ASYNC_WITH_A:
+        pushes = 5;
+        break;
+    case SEND_A:
+        if (mod->verCompare(3, 12) < 0)
+            pushes = 1;
+        break;
+    case CALL_FINALLY_A:
+        pushes = 1;
+        break;
+    }
+}
+
+int Pyc::JumpTarget(int opcode, int operand, int pos, PycModule* mod)
+{
+    const OpcodeInfo& info = GetOpcodeInfo(opcode, mod);
+    // BPO-27129: Jumps count 16-bit code units since Python 3.10
+    int unit = mod->verCompare(3, 10) >= 0 ? (int)sizeof(uint16_t) : 1;
+    int next = pos + info.caches * (int)sizeof(uint16_t);
+
+    switch (info.operand) {
+    case ARG_JUMP_ABS:
+        return operand * unit;
+    case ARG_JUMP_REL:
+        return next + operand * unit;
+    case ARG_JUMP_BACK:
+        return next - operand * unit;
+    default:
+        return -1;
+    }
+}
+
+static ConstLimits s_constLimits;
+
+void set_const_limits(const ConstLimits& limits)
+{
+    s_constLimits = limits;
+}
+
+const ConstLimits& const_limits()
+{
+    return s_constLimits;
+}
+
+size_t const_items_shown(size_t count)
+{
+    if (s_constLimits.maxItems == 0)
+        return count;
+    return std::min(count, s_constLimits.maxItems);
+}
+
+static void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
+                        const char* parent_f_string_quote, bool limit);
+
+/* 64-bit FNV-1a of everything written to it, which saves building a
+ * string for a rendering that is only hashed */
+class FnvHashBuf : public std::streambuf {
+public:
+    FnvHashBuf() : m_hash(14695981039346656037ULL) { }
+
+    uint64_t hash() const { return m_hash; }
+
+    void add(const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) {
+            m_hash ^= (unsigned char)data[i];
+            m_hash *= 1099511628211ULL;
+        }
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            char value = traits_type::to_char_type(ch);
+            add(&value, 1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize size) override
+    {
+        add(data, (size_t)size);
+        return size;
+    }
+
+private:
+    uint64_t m_hash;
+};
+
+/* Hash of the whole of an elided value, which is also the name it is dumped
+ * under.  Each value is only written once per run. */
+static uint64_t elided_hash(PycRef<PycObject> obj, PycModule* mod)
+{
+    static std::mutex dumpLock;
+    static std::set<uint64_t> dumped;
+
+    PycRef<PycString> str = obj.try_cast<PycString>();
+    FnvHashBuf hashBuf;
+    if (str != nullptr) {
+        hashBuf.add(str->strValue().data(), str->strValue().size());
+    } else {
+        std::ostream text(&hashBuf);
+        print_const(text, obj, mod, nullptr, false);
+    }
+    uint64_t hash = hashBuf.hash();
+
+    if (!s_constLimits.dumpDir.empty()) {
+        std::lock_guard<std::mutex> locker(dumpLock);
+        if (dumped.insert(hash).second) {
+            char name[24];
+            snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+            std::string filename = s_constLimits.dumpDir + "/" + name
+                                 + (str != nullptr ? ".bin" : ".txt");
+            std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+            if (str != nullptr)
+                out.write(str->strValue().data(), str->strValue().size());
+            else
+                print_const(out, obj, mod, nullptr, false);
+            out.close();
+            if (out.fail())
+                fprintf(stderr, "Error writing file %s\n", filename.c_str());
+        }
+    }
+    return hash;
+}
+
+void print_elided_items(std::ostream& pyc_output, PycRef<PycObject> obj, size_t count,
+                        PycModule* mod)
+{
+    formatted_print(pyc_output, "__elided__(%zu, 0x%016llx)", count - const_items_shown(count),
+                    (unsigned long long)elided_hash(obj, mod));
+}
+
+bool print_elided_string(std::ostream& pyc_output, PycRef<PycString> str, PycModule* mod)
+{
+    const std::string& value = str->strValue();
+    if (s_constLimits.maxBytes == 0 || value.size() <= s_constLimits.maxBytes)
+        return false;
+
+    // Don't split a UTF-8 sequence
+    size_t length = s_constLimits.maxBytes;
+    if (str->type() == PycObject::TYPE_UNICODE) {
+        while (length > 0 && (value[length] & 0xC0) == 0x80)
+            --length;
+    }
+    PycRef<PycString> start = new PycString(str->type());
+    start->setValue(value.substr(0, length));
+
+    pyc_output << "__elided__(";
+    start->print(pyc_output, mod);
+    formatted_print(pyc_output, ", %zu, 0x%016llx)", value.size(),
+                    (unsigned long long)elided_hash(str.cast<PycObject>(), mod));
+    return true;
+}
+
+static void print_const_items(std::ostream& pyc_output, PycRef<PycObject> obj,
+                              const PycSimpleSequence::value_t& values, PycModule* mod,
+                              bool limit)
+{
+    size_t shown = limit ? const_items_shown(values.size()) : values.size();
+    for (size_t i = 0; i < shown; ++i) {
+        if (i > 0)
+            pyc_output << ", ";
+        print_const(pyc_output, values[i], mod, nullptr, limit);
+    }
+    if (shown < values.size()) {
+        pyc_output << ", ";
+        print_elided_items(pyc_output, obj, values.size(), mod);
+    }
+}
+
 void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
                  const char* parent_f_string_quote)
+{
+    print_const(pyc_output, obj, mod, parent_f_string_quote, true);
+}
+
+static void render_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
+                         const char* parent_f_string_quote, bool limit);
+
+static void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
+                        const char* parent_f_string_quote, bool limit)
+{
+    // Strings keep their own renderings, in PycString::print(), and full
+    // renderings are only hashed (and dumped once), so aren't worth keeping
+    if (obj == NULL || parent_f_string_quote || !limit
+            || obj.try_cast<PycString>() != nullptr) {
+        render_const(pyc_output, obj, mod, parent_f_string_quote, limit);
+        return;
+    }
+    mod->renderCache().print(pyc_output, obj, PycRenderCache::RENDER_CONST,
+                             [&](std::ostream& text) {
+                                 render_const(text, obj, mod, nullptr, limit);
+                             });
+}
+
+static void render_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
+                         const char* parent_f_string_quote, bool limit)
 {
     if (obj == NULL) {
         pyc_output << "<NULL>";
@@ -131,21 +523,18 @@ void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod
     case PycObject::TYPE_ASCII_INTERNED:
     case PycObject::TYPE_SHORT_ASCII:
     case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        // Parts of f-strings are printed without quotes, and can't be cut
+        if (limit && !parent_f_string_quote
+                && print_elided_string(pyc_output, obj.cast<PycString>(), mod))
+            break;
         obj.cast<PycString>()->print(pyc_output, mod, false, parent_f_string_quote);
         break;
     case PycObject::TYPE_TUPLE:
     case PycObject::TYPE_SMALL_TUPLE:
         {
+            const PycTuple::value_t& values = obj.cast<PycTuple>()->values();
             pyc_output << "(";
-            PycTuple::value_t values = obj.cast<PycTuple>()->values();
-            auto it = values.cbegin();
-            if (it != values.cend()) {
-                print_const(pyc_output, *it, mod);
-                while (++it != values.cend()) {
-                    pyc_output << ", ";
-                    print_const(pyc_output, *it, mod);
-                }
-            }
+            print_const_items(pyc_output, obj, values, mod, limit);
             if (values.size() == 1)
                 pyc_output << ",)";
             else
@@ -153,68 +542,38 @@ void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod
         }
         break;
     case PycObject::TYPE_LIST:
-        {
-            pyc_output << "[";
-            PycList::value_t values = obj.cast<PycList>()->values();
-            auto it = values.cbegin();
-            if (it != values.cend()) {
-                print_const(pyc_output, *it, mod);
-                while (++it != values.cend()) {
-                    pyc_output << ", ";
-                    print_const(pyc_output, *it, mod);
-                }
-            }
-            pyc_output << "]";
-        }
+        pyc_output << "[";
+        print_const_items(pyc_output, obj, obj.cast<PycList>()->values(), mod, limit);
+        pyc_output << "]";
         break;
     case PycObject::TYPE_DICT:
         {
+            const PycDict::value_t& values = obj.cast<PycDict>()->values();
+            size_t shown = limit ? const_items_shown(values.size()) : values.size();
             pyc_output << "{";
-            PycDict::value_t values = obj.cast<PycDict>()->values();
-            auto it = values.cbegin();
-            if (it != values.cend()) {
-                print_const(pyc_output, std::get<0>(*it), mod);
-                pyc_output << ": ";
-                print_const(pyc_output, std::get<1>(*it), mod);
-                while (++it != values.cend()) {
+            for (size_t i = 0; i < shown; ++i) {
+                if (i > 0)
                     pyc_output << ", ";
-                    print_const(pyc_output, std::get<0>(*it), mod);
-                    pyc_output << ": ";
-                    print_const(pyc_output, std::get<1>(*it), mod);
-                }
+                print_const(pyc_output, std::get<0>(values[i]), mod, nullptr, limit);
+                pyc_output << ": ";
+                print_const(pyc_output, std::get<1>(values[i]), mod, nullptr, limit);
+            }
+            if (shown < values.size()) {
+                pyc_output << ", **";
+                print_elided_items(pyc_output, obj, values.size(), mod);
             }
             pyc_output << "}";
         }
         break;
     case PycObject::TYPE_SET:
-        {
-            pyc_output << "{";
-            PycSet::value_t values = obj.cast<PycSet>()->values();
-            auto it = values.cbegin();
-            if (it != values.cend()) {
-                print_const(pyc_output, *it, mod);
-                while (++it != values.cend()) {
-                    pyc_output << ", ";
-                    print_const(pyc_output, *it, mod);
-                }
-            }
-            pyc_output << "}";
-        }
+        pyc_output << "{";
+        print_const_items(pyc_output, obj, obj.cast<PycSet>()->values(), mod, limit);
+        pyc_output << "}";
         break;
     case PycObject::TYPE_FROZENSET:
-        {
-            pyc_output << "frozenset({";
-            PycSet::value_t values = obj.cast<PycSet>()->values();
-            auto it = values.cbegin();
-            if (it != values.cend()) {
-                print_const(pyc_output, *it, mod);
-                while (++it != values.cend()) {
-                    pyc_output << ", ";
-                    print_const(pyc_output, *it, mod);
-                }
-            }
-            pyc_output << "})";
-        }
+        pyc_output << "frozenset({";
+        print_const_items(pyc_output, obj, obj.cast<PycSet>()->values(), mod, limit);
+        pyc_output << "})";
         break;
     case PycObject::TYPE_NONE:
         pyc_output << "None";
@@ -282,9 +641,10 @@ void bc_next(PycBuffer& source, PycModule* mod, int& opcode, int& operand, int&
     if (mod->verCompare(3, 6) >= 0) {
         operand = source.getByte();
         pos += 2;
-        if (opcode == Pyc::EXTENDED_ARG_A) {
+        // Operands above 0xFFFF take several prefixes
+        while (opcode == Pyc::EXTENDED_ARG_A) {
             opcode = Pyc::ByteToOpcode(mod->majorVer(), mod->minorVer(), source.getByte());
-            operand = (operand << 8) | source.getByte();
+            operand = (int)(((unsigned int)operand << 8) | (unsigned int)source.getByte());
             pos += 2;
         }
     } else {
@@ -338,19 +698,45 @@ void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
     };
     static const size_t format_value_names_len = sizeof(format_value_names) / sizeof(format_value_names[0]);
 
+    std::vector<Instruction> instructions = decode_instructions(code, mod);
+    JumpMap jumps(instructions, code, mod);
+    std::vector<CodeRange> dead_ranges = find_dead_ranges(instructions, code, mod);
+    auto next_dead = dead_ranges.cbegin();
+
+    StackDepth stack_depth;
+    if (flags & Pyc::DISASM_STACK_DEPTH)
+        stack_depth = analyze_stack_depth(instructions, code, mod);
+
     PycBuffer source(code->code()->value(), code->code()->length());
 
     int opcode, operand;
     int pos = 0;
-    while (!source.atEof()) {
+    for (size_t index = 0; !source.atEof(); ++index) {
         int start_pos = pos;
         bc_next(source, mod, opcode, operand, pos);
+        if (next_dead != dead_ranges.cend() && next_dead->start == start_pos) {
+            for (int i=0; i<indent; i++)
+                pyc_output << "    ";
+            formatted_print(pyc_output, "[Unreachable %d-%d%s]\n", next_dead->start,
+                            next_dead->end, next_dead->malformed ? ", malformed" : "");
+            ++next_dead;
+        }
         if (opcode == Pyc::CACHE && (flags & Pyc::DISASM_SHOW_CACHES) == 0)
             continue;
 
         for (int i=0; i<indent; i++)
             pyc_output << "    ";
-        formatted_print(pyc_output, "%-7d %-30s  ", start_pos, Pyc::OpcodeName(opcode));
+        // Mark jump targets like CPython's dis
+        formatted_print(pyc_output, "%s%-7d ", jumps.isTarget(start_pos) ? ">> " : "   ", start_pos);
+        if (flags & Pyc::DISASM_STACK_DEPTH) {
+            if (!stack_depth.bounded)
+                pyc_output << "?    ";
+            else if (stack_depth.depth[index] >= 0)
+                formatted_print(pyc_output, "%-4d ", stack_depth.depth[index]);
+            else
+                pyc_output << "-    ";
+        }
+        formatted_print(pyc_output, "%-30s  ", Pyc::OpcodeName(opcode));
 
         if (opcode >= Pyc::PYC_HAVE_ARG) {
             switch (opcode) {
@@ -440,7 +826,6 @@ void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
             case Pyc::STORE_DEREF_A:
             case Pyc::DELETE_DEREF_A:
             case Pyc::MAKE_CELL_A:
-            case Pyc::CALL_FINALLY_A:
             case Pyc::LOAD_FROM_DICT_OR_DEREF_A:
                 try {
                     formatted_print(pyc_output, "%d: %s", operand, code->getCellVar(mod, operand)->value());
@@ -448,67 +833,6 @@ void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
                     formatted_print(pyc_output, "%d <INVALID>", operand);
                 }
                 break;
-            case Pyc::JUMP_FORWARD_A:
-            case Pyc::JUMP_IF_FALSE_A:
-            case Pyc::JUMP_IF_TRUE_A:
-            case Pyc::SETUP_LOOP_A:
-            case Pyc::SETUP_FINALLY_A:
-            case Pyc::SETUP_EXCEPT_A:
-            case Pyc::FOR_LOOP_A:
-            case Pyc::FOR_ITER_A:
-            case Pyc::SETUP_WITH_A:
-            case Pyc::SETUP_ASYNC_WITH_A:
-            case Pyc::POP_JUMP_FORWARD_IF_FALSE_A:
-            case Pyc::POP_JUMP_FORWARD_IF_TRUE_A:
-            case Pyc::SEND_A:
-            case Pyc::POP_JUMP_FORWARD_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_FORWARD_IF_NONE_A:
-            case Pyc::POP_JUMP_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_IF_NONE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_NOT_NONE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_NONE_A:
-            case Pyc::INSTRUMENTED_JUMP_FORWARD_A:
-            case Pyc::INSTRUMENTED_FOR_ITER_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_FALSE_A:
-            case Pyc::INSTRUMENTED_POP_JUMP_IF_TRUE_A:
-                {
-                    int offs = operand;
-                    if (mod->verCompare(3, 10) >= 0)
-                        offs *= sizeof(uint16_t); // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos+offs);
-                }
-                break;
-            case Pyc::JUMP_BACKWARD_NO_INTERRUPT_A:
-            case Pyc::JUMP_BACKWARD_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_NOT_NONE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_NONE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_FALSE_A:
-            case Pyc::POP_JUMP_BACKWARD_IF_TRUE_A:
-            case Pyc::INSTRUMENTED_JUMP_BACKWARD_A:
-                {
-                    // BACKWARD jumps were only introduced in Python 3.11
-                    int offs = operand * sizeof(uint16_t); // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos-offs);
-                }
-                break;
-            case Pyc::POP_JUMP_IF_FALSE_A:
-            case Pyc::POP_JUMP_IF_TRUE_A:
-            case Pyc::JUMP_IF_FALSE_OR_POP_A:
-            case Pyc::JUMP_IF_TRUE_OR_POP_A:
-            case Pyc::JUMP_ABSOLUTE_A:
-            case Pyc::JUMP_IF_NOT_EXC_MATCH_A:
-                if (mod->verCompare(3, 12) >= 0) {
-                    // These are now relative as well
-                    int offs = operand * sizeof(uint16_t);
-                    formatted_print(pyc_output, "%d (to %d)", operand, pos+offs);
-                } else if (mod->verCompare(3, 10) >= 0) {
-                    // BPO-27129
-                    formatted_print(pyc_output, "%d (to %d)", operand,
-                                    int(operand * sizeof(uint16_t)));
-                } else {
-                    formatted_print(pyc_output, "%d", operand);
-                }
-                break;
             case Pyc::COMPARE_OP_A:
                 {
                     auto arg = operand;
@@ -589,7 +913,16 @@ void bc_disasm(std::ostream& pyc_output, PycRef<PycCode> code, PycModule* mod,
                 }
                 break;
             default:
-                formatted_print(pyc_output, "%d", operand);
+                {
+                    const Pyc::OpcodeInfo& info = Pyc::GetOpcodeInfo(opcode, mod);
+                    if (info.isJump() && (info.operand != Pyc::ARG_JUMP_ABS
+                                          || mod->verCompare(3, 10) >= 0)) {
+                        formatted_print(pyc_output, "%d (to %d)", operand,
+                                        Pyc::JumpTarget(opcode, operand, pos, mod));
+                    } else {
+                        formatted_print(pyc_output, "%d", operand);
+                    }
+                }
                 break;
             }
         }
@@ -20,13 +20,92 @@ enum Opcode {
 enum DisassemblyFlags {
     DISASM_PYCODE_VERBOSE = 0x1,
     DISASM_SHOW_CACHES = 0x2,
+    DISASM_CODE_REFS = 0x4,     // Show nested code objects by name only
+    DISASM_STACK_DEPTH = 0x8,   // Show the stack depth before each instruction
 };
 
 const char* OpcodeName(int opcode);
 int ByteToOpcode(int maj, int min, int opcode);
 
+/* What the operand of an instruction refers to */
+enum OperandKind {
+    ARG_NONE,           // No operand
+    ARG_NUMBER,         // A count, flags or other plain value
+    ARG_CONST,          // consts[A]
+    ARG_NAME,           // names[A]
+    ARG_LOCAL,          // locals[A]
+    ARG_LOCAL_PAIR,     // locals[A >> 4] and locals[A & 0xF]
+    ARG_CELL,           // Cell or free variable A
+    ARG_COMPARE,        // Comparison operator A
+    ARG_JUMP_ABS,       // Jump to A
+    ARG_JUMP_REL,       // Jump forward by A from the next instruction
+    ARG_JUMP_BACK,      // Jump backward by A from the next instruction
+};
+
+enum OpcodeFlags {
+    OP_TERMINATOR = 0x1,    // Never continues with the next instruction
+    OP_BLOCK_SETUP = 0x2,   // Jump target is the handler or end of a new block
+};
+
+/* Placeholders for OpcodeInfo::pops and pushes */
+enum { STACK_ARG = -1, STACK_SPECIAL = -2 };
+
+/* Static properties of an opcode in one Python version, from
+ * bytecode_info.inl */
+struct OpcodeInfo {
+    unsigned char operand;  // OperandKind
+    unsigned char shift;    // Flag bits below the index in the operand
+    signed char pops;       // Stack effect when continuing with the next
+    signed char pushes;     // instruction, or STACK_ARG / STACK_SPECIAL
+    unsigned char flags;    // OpcodeFlags
+    unsigned char caches;   // CACHE entries following the instruction
+
+    bool isJump() const { return operand >= ARG_JUMP_ABS; }
+};
+
+const OpcodeInfo& GetOpcodeInfo(int opcode, PycModule* mod);
+
+/* Number of values the instruction pops and pushes, when continuing with
+ * the next instruction or when taking its jump */
+void StackEffect(int opcode, int operand, PycModule* mod, bool jump,
+                 int& pops, int& pushes);
+
+/* Target offset of a jump instruction ending at pos (not counting its
+ * CACHE entries), or -1 if the opcode does not jump */
+int JumpTarget(int opcode, int operand, int pos, PycModule* mod);
+
 }
 
+/* Limits on how much of a large constant print_const() and pycdas show.
+ * The part of a string beyond maxBytes, or of a container beyond maxItems,
+ * is replaced by an __elided__(...) marker with its size and a hash of the
+ * whole value: of the bytes of a string, or of the complete rendering of a
+ * container.  0 means no limit.  With dumpDir, every elided value is also
+ * written there, to <hash>.bin or <hash>.txt.  Set before decompiling
+ * anything, as they are shared by all threads. */
+struct ConstLimits {
+    ConstLimits() : maxBytes(0), maxItems(0) { }
+
+    size_t maxBytes;
+    size_t maxItems;
+    std::string dumpDir;
+};
+
+void set_const_limits(const ConstLimits& limits);
+const ConstLimits& const_limits();
+
+/* Number of items of a container with count items to show */
+size_t const_items_shown(size_t count);
+
+/* The marker for the items of a container that are not shown, as the last
+ * item: __elided__(<count not shown>, 0x<hash>) */
+void print_elided_items(std::ostream& pyc_output, PycRef<PycObject> obj, size_t count,
+                        PycModule* mod);
+
+/* Prints str as __elided__(<start>, <size>, 0x<hash>) if it is over the
+ * limit, and returns false otherwise */
+bool print_elided_string(std::ostream& pyc_output, PycRef<PycString> str, PycModule* mod);
+
 void print_const(std::ostream& pyc_output, PycRef<PycObject> obj, PycModule* mod,
                  const char* parent_f_string_quote = nullptr);
 void bc_next(PycBuffer& source, PycModule* mod, int& opcode, int& operand, int& pos);
@@ -0,0 +1,332 @@
+/* Opcode metadata, expanded into the tables behind Pyc::GetOpcodeInfo().
+ *
+ *   OPINFO(opcode, operand, pops, pushes, flags)
+ *   OPINFO_SINCE(major, minor, opcode, operand, shift, pops, pushes, flags, caches)
+ *
+ * OPINFO gives the behavior of an opcode in the first Python version that
+ * has it; OPINFO_SINCE replaces it from the given version on, and must come
+ * after the OPINFO of the same opcode, with later versions last.  Opcodes
+ * not listed take no operand (or a plain number) and leave the stack alone.
+ *
+ * pops and pushes are the stack effect when execution continues with the
+ * next instruction; ARG stands for the operand, and SPECIAL for anything
+ * more involved (both are resolved by Pyc::StackEffect(), which also knows
+ * the effect of taking a jump where that differs).  shift is the number of
+ * flag bits below the index in the operand, and caches the number of
+ * CACHE entries following the instruction.
+ */
+
+/* No parameter word */
+OPINFO(STOP_CODE,                   ARG_NONE,       0, 0, OP_TERMINATOR)
+OPINFO(POP_TOP,                     ARG_NONE,       1, 0, 0)
+OPINFO(ROT_TWO,                     ARG_NONE,       2, 2, 0)
+OPINFO(ROT_THREE,                   ARG_NONE,       3, 3, 0)
+OPINFO(DUP_TOP,                     ARG_NONE,       1, 2, 0)
+OPINFO(DUP_TOP_TWO,                 ARG_NONE,       2, 4, 0)
+OPINFO(UNARY_POSITIVE,              ARG_NONE,       1, 1, 0)
+OPINFO(UNARY_NEGATIVE,              ARG_NONE,       1, 1, 0)
+OPINFO(UNARY_NOT,                   ARG_NONE,       1, 1, 0)
+OPINFO(UNARY_CONVERT,               ARG_NONE,       1, 1, 0)
+OPINFO(UNARY_CALL,                  ARG_NONE,       1, 1, 0)
+OPINFO(UNARY_INVERT,                ARG_NONE,       1, 1, 0)
+OPINFO(BINARY_POWER,                ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_MULTIPLY,             ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_DIVIDE,               ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_MODULO,               ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_ADD,                  ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_SUBTRACT,             ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_SUBSCR,               ARG_NONE,       2, 1, 0)
+OPINFO_SINCE(3, 11, BINARY_SUBSCR,  ARG_NONE,   0,  2, 1, 0, 4)
+OPINFO_SINCE(3, 12, BINARY_SUBSCR,  ARG_NONE,   0,  2, 1, 0, 1)
+OPINFO(BINARY_CALL,                 ARG_NONE,       2, 1, 0)
+OPINFO(SLICE_0,                     ARG_NONE,       1, 1, 0)
+OPINFO(SLICE_1,                     ARG_NONE,       2, 1, 0)
+OPINFO(SLICE_2,                     ARG_NONE,       2, 1, 0)
+OPINFO(SLICE_3,                     ARG_NONE,       3, 1, 0)
+OPINFO(STORE_SLICE_0,               ARG_NONE,       2, 0, 0)
+OPINFO(STORE_SLICE_1,               ARG_NONE,       3, 0, 0)
+OPINFO(STORE_SLICE_2,               ARG_NONE,       3, 0, 0)
+OPINFO(STORE_SLICE_3,               ARG_NONE,       4, 0, 0)
+OPINFO(DELETE_SLICE_0,              ARG_NONE,       1, 0, 0)
+OPINFO(DELETE_SLICE_1,              ARG_NONE,       2, 0, 0)
+OPINFO(DELETE_SLICE_2,              ARG_NONE,       2, 0, 0)
+OPINFO(DELETE_SLICE_3,              ARG_NONE,       3, 0, 0)
+OPINFO(STORE_SUBSCR,                ARG_NONE,       3, 0, 0)
+OPINFO_SINCE(3, 11, STORE_SUBSCR,   ARG_NONE,   0,  3, 0, 0, 1)
+OPINFO(DELETE_SUBSCR,               ARG_NONE,       2, 0, 0)
+OPINFO(BINARY_LSHIFT,               ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_RSHIFT,               ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_AND,                  ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_XOR,                  ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_OR,                   ARG_NONE,       2, 1, 0)
+OPINFO(PRINT_EXPR,                  ARG_NONE,       1, 0, 0)
+OPINFO(PRINT_ITEM,                  ARG_NONE,       1, 0, 0)
+OPINFO(BREAK_LOOP,                  ARG_NONE,       0, 0, OP_TERMINATOR)
+OPINFO(RAISE_EXCEPTION,             ARG_NONE,       2, 0, OP_TERMINATOR)
+OPINFO(LOAD_LOCALS,                 ARG_NONE,       0, 1, 0)
+OPINFO(RETURN_VALUE,                ARG_NONE,       1, 0, OP_TERMINATOR)
+OPINFO(LOAD_GLOBALS,                ARG_NONE,       0, 1, 0)
+OPINFO(EXEC_STMT,                   ARG_NONE,       3, 0, 0)
+OPINFO(BUILD_FUNCTION,              ARG_NONE,       1, 1, 0)
+OPINFO(END_FINALLY,                 ARG_NONE,       SPECIAL, 0, 0)
+OPINFO(BUILD_CLASS,                 ARG_NONE,       3, 1, 0)
+OPINFO(ROT_FOUR,                    ARG_NONE,       4, 4, 0)
+OPINFO(LIST_APPEND,                 ARG_NONE,       2, 0, 0)
+OPINFO(BINARY_FLOOR_DIVIDE,         ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_TRUE_DIVIDE,          ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_FLOOR_DIVIDE,        ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_TRUE_DIVIDE,         ARG_NONE,       2, 1, 0)
+OPINFO(GET_LEN,                     ARG_NONE,       1, 2, 0)
+OPINFO(MATCH_MAPPING,               ARG_NONE,       1, 2, 0)
+OPINFO(MATCH_SEQUENCE,              ARG_NONE,       1, 2, 0)
+OPINFO(MATCH_KEYS,                  ARG_NONE,       2, 4, 0)
+OPINFO_SINCE(3, 11, MATCH_KEYS,     ARG_NONE,   0,  2, 3, 0, 0)
+OPINFO(COPY_DICT_WITHOUT_KEYS,      ARG_NONE,       2, 2, 0)
+OPINFO(STORE_MAP,                   ARG_NONE,       3, 1, 0)
+OPINFO(INPLACE_ADD,                 ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_SUBTRACT,            ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_MULTIPLY,            ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_DIVIDE,              ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_MODULO,              ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_POWER,               ARG_NONE,       2, 1, 0)
+OPINFO(GET_ITER,                    ARG_NONE,       1, 1, 0)
+OPINFO(PRINT_ITEM_TO,               ARG_NONE,       2, 0, 0)
+OPINFO(PRINT_NEWLINE_TO,            ARG_NONE,       1, 0, 0)
+OPINFO(INPLACE_LSHIFT,              ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_RSHIFT,              ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_AND,                 ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_XOR,                 ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_OR,                  ARG_NONE,       2, 1, 0)
+OPINFO(WITH_CLEANUP,                ARG_NONE,       1, 0, 0)
+OPINFO(WITH_CLEANUP_START,          ARG_NONE,       1, 2, 0)
+OPINFO(WITH_CLEANUP_FINISH,         ARG_NONE,       2, 0, 0)
+OPINFO(IMPORT_STAR,                 ARG_NONE,       1, 0, 0)
+OPINFO(YIELD_VALUE,                 ARG_NONE,       1, 0, 0)
+OPINFO_SINCE(2, 5, YIELD_VALUE,     ARG_NONE,   0,  1, 1, 0, 0)
+OPINFO(LOAD_BUILD_CLASS,            ARG_NONE,       0, 1, 0)
+OPINFO(STORE_LOCALS,                ARG_NONE,       1, 0, 0)
+OPINFO(POP_EXCEPT,                  ARG_NONE,       3, 0, 0)
+OPINFO_SINCE(3, 11, POP_EXCEPT,     ARG_NONE,   0,  1, 0, 0, 0)
+OPINFO(SET_ADD,                     ARG_NONE,       2, 0, 0)
+OPINFO(YIELD_FROM,                  ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_MATRIX_MULTIPLY,      ARG_NONE,       2, 1, 0)
+OPINFO(INPLACE_MATRIX_MULTIPLY,     ARG_NONE,       2, 1, 0)
+OPINFO(GET_AITER,                   ARG_NONE,       1, 1, 0)
+OPINFO(GET_ANEXT,                   ARG_NONE,       1, 2, 0)
+OPINFO(BEFORE_ASYNC_WITH,           ARG_NONE,       1, 2, 0)
+OPINFO(GET_YIELD_FROM_ITER,         ARG_NONE,       1, 1, 0)
+OPINFO(GET_AWAITABLE,               ARG_NONE,       1, 1, 0)
+OPINFO(BEGIN_FINALLY,               ARG_NONE,       0, 1, 0)
+OPINFO(END_ASYNC_FOR,               ARG_NONE,       7, 0, 0)
+OPINFO_SINCE(3, 11, END_ASYNC_FOR,  ARG_NONE,   0,  2, 0, 0, 0)
+OPINFO(RERAISE,                     ARG_NONE,       3, 0, OP_TERMINATOR)
+OPINFO(WITH_EXCEPT_START,           ARG_NONE,       0, 1, 0)
+OPINFO(LOAD_ASSERTION_ERROR,        ARG_NONE,       0, 1, 0)
+OPINFO(LIST_TO_TUPLE,               ARG_NONE,       1, 1, 0)
+OPINFO(PUSH_NULL,                   ARG_NONE,       0, 1, 0)
+OPINFO(PUSH_EXC_INFO,               ARG_NONE,       1, 2, 0)
+OPINFO(CHECK_EXC_MATCH,             ARG_NONE,       2, 2, 0)
+OPINFO(CHECK_EG_MATCH,              ARG_NONE,       2, 2, 0)
+OPINFO(BEFORE_WITH,                 ARG_NONE,       1, 2, 0)
+OPINFO(RETURN_GENERATOR,            ARG_NONE,       0, 1, 0)    // Value sent on resume
+OPINFO(ASYNC_GEN_WRAP,              ARG_NONE,       1, 1, 0)
+OPINFO(PREP_RERAISE_STAR,           ARG_NONE,       2, 1, 0)
+OPINFO(INTERPRETER_EXIT,            ARG_NONE,       1, 0, OP_TERMINATOR)
+OPINFO(END_FOR,                     ARG_NONE,       2, 0, 0)
+OPINFO_SINCE(3, 13, END_FOR,        ARG_NONE,   0,  1, 0, 0, 0)
+OPINFO(END_SEND,                    ARG_NONE,       2, 1, 0)
+OPINFO(BINARY_SLICE,                ARG_NONE,       3, 1, 0)
+OPINFO(STORE_SLICE,                 ARG_NONE,       4, 0, 0)
+OPINFO(CLEANUP_THROW,               ARG_NONE,       3, 2, 0)
+OPINFO(EXIT_INIT_CHECK,             ARG_NONE,       1, 0, 0)
+OPINFO(FORMAT_SIMPLE,               ARG_NONE,       1, 1, 0)
+OPINFO(FORMAT_WITH_SPEC,            ARG_NONE,       2, 1, 0)
+OPINFO(MAKE_FUNCTION,               ARG_NONE,       1, 1, 0)
+OPINFO(TO_BOOL,                     ARG_NONE,       1, 1, 0)
+OPINFO_SINCE(3, 13, TO_BOOL,        ARG_NONE,   0,  1, 1, 0, 3)
+
+/* Has parameter word */
+OPINFO(STORE_NAME_A,                ARG_NAME,       1, 0, 0)
+OPINFO(UNPACK_TUPLE_A,              ARG_NUMBER,     1, ARG, 0)
+OPINFO(UNPACK_LIST_A,               ARG_NUMBER,     1, ARG, 0)
+OPINFO(UNPACK_ARG_A,                ARG_NUMBER,     0, ARG, 0)
+OPINFO(STORE_ATTR_A,                ARG_NAME,       2, 0, 0)
+OPINFO_SINCE(3, 11, STORE_ATTR_A,   ARG_NAME,   0,  2, 0, 0, 4)
+OPINFO(DELETE_ATTR_A,               ARG_NAME,       1, 0, 0)
+OPINFO(STORE_GLOBAL_A,              ARG_NAME,       1, 0, 0)
+OPINFO(DELETE_GLOBAL_A,             ARG_NAME,       0, 0, 0)
+OPINFO(DELETE_NAME_A,               ARG_NAME,       0, 0, 0)
+OPINFO(ROT_N_A,                     ARG_NUMBER,     ARG, ARG, 0)
+OPINFO(UNPACK_VARARG_A,             ARG_NUMBER,     0, 1, 0)
+OPINFO(LOAD_CONST_A,                ARG_CONST,      0, 1, 0)
+OPINFO(LOAD_NAME_A,                 ARG_NAME,       0, 1, 0)
+OPINFO(BUILD_TUPLE_A,               ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_LIST_A,                ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_MAP_A,                 ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(LOAD_ATTR_A,                 ARG_NAME,       1, 1, 0)
+OPINFO_SINCE(3, 11, LOAD_ATTR_A,    ARG_NAME,   0,  1, 1, 0, 4)
+OPINFO_SINCE(3, 12, LOAD_ATTR_A,    ARG_NAME,   1,  1, SPECIAL, 0, 9)
+OPINFO(COMPARE_OP_A,                ARG_COMPARE,    2, 1, 0)
+OPINFO_SINCE(3, 11, COMPARE_OP_A,   ARG_COMPARE, 0, 2, 1, 0, 2)
+OPINFO_SINCE(3, 12, COMPARE_OP_A,   ARG_COMPARE, 4, 2, 1, 0, 1)
+OPINFO_SINCE(3, 13, COMPARE_OP_A,   ARG_COMPARE, 5, 2, 1, 0, 1)
+OPINFO(IMPORT_NAME_A,               ARG_NAME,       0, 1, 0)
+OPINFO_SINCE(2, 0, IMPORT_NAME_A,   ARG_NAME,   0,  1, 1, 0, 0)
+OPINFO_SINCE(2, 5, IMPORT_NAME_A,   ARG_NAME,   0,  2, 1, 0, 0)
+OPINFO(IMPORT_FROM_A,               ARG_NAME,       0, 0, 0)
+OPINFO_SINCE(2, 0, IMPORT_FROM_A,   ARG_NAME,   0,  0, 1, 0, 0)
+OPINFO(ACCESS_MODE_A,               ARG_NAME,       1, 0, 0)
+OPINFO(JUMP_FORWARD_A,              ARG_JUMP_REL,   0, 0, OP_TERMINATOR)
+OPINFO(JUMP_IF_FALSE_A,             ARG_JUMP_REL,   0, 0, 0)
+OPINFO(JUMP_IF_TRUE_A,              ARG_JUMP_REL,   0, 0, 0)
+OPINFO(JUMP_ABSOLUTE_A,             ARG_JUMP_ABS,   0, 0, OP_TERMINATOR)
+OPINFO(FOR_LOOP_A,                  ARG_JUMP_REL,   2, 3, 0)
+OPINFO(LOAD_LOCAL_A,                ARG_NAME,       0, 1, 0)
+OPINFO(LOAD_GLOBAL_A,               ARG_NAME,       0, 1, 0)
+OPINFO_SINCE(3, 11, LOAD_GLOBAL_A,  ARG_NAME,   1,  0, SPECIAL, 0, 5)
+OPINFO_SINCE(3, 12, LOAD_GLOBAL_A,  ARG_NAME,   1,  0, SPECIAL, 0, 4)
+OPINFO(SET_FUNC_ARGS_A,             ARG_NUMBER,     1, 1, 0)
+OPINFO(SETUP_LOOP_A,                ARG_JUMP_REL,   0, 0, OP_BLOCK_SETUP)
+OPINFO(SETUP_EXCEPT_A,              ARG_JUMP_REL,   0, 0, OP_BLOCK_SETUP)
+OPINFO(SETUP_FINALLY_A,             ARG_JUMP_REL,   0, 0, OP_BLOCK_SETUP)
+OPINFO(RESERVE_FAST_A,              ARG_CONST,      0, 0, 0)
+OPINFO(LOAD_FAST_A,                 ARG_LOCAL,      0, 1, 0)
+OPINFO(STORE_FAST_A,                ARG_LOCAL,      1, 0, 0)
+OPINFO(DELETE_FAST_A,               ARG_LOCAL,      0, 0, 0)
+OPINFO(GEN_START_A,                 ARG_NUMBER,     1, 0, 0)
+OPINFO(STORE_ANNOTATION_A,          ARG_NAME,       1, 0, 0)
+OPINFO(RAISE_VARARGS_A,             ARG_NUMBER,     ARG, 0, OP_TERMINATOR)
+OPINFO(CALL_FUNCTION_A,             ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(MAKE_FUNCTION_A,             ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(BUILD_SLICE_A,               ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(CALL_FUNCTION_VAR_A,         ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(CALL_FUNCTION_KW_A,          ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(CALL_FUNCTION_VAR_KW_A,      ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(CALL_FUNCTION_EX_A,          ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(UNPACK_SEQUENCE_A,           ARG_NUMBER,     1, ARG, 0)
+OPINFO_SINCE(3, 11, UNPACK_SEQUENCE_A, ARG_NUMBER, 0, 1, ARG, 0, 1)
+OPINFO(FOR_ITER_A,                  ARG_JUMP_REL,   1, 2, 0)
+OPINFO_SINCE(3, 12, FOR_ITER_A,     ARG_JUMP_REL, 0, 1, 2, 0, 1)
+OPINFO(DUP_TOPX_A,                  ARG_NUMBER,     ARG, SPECIAL, 0)
+OPINFO(BUILD_SET_A,                 ARG_NUMBER,     ARG, 1, 0)
+OPINFO(JUMP_IF_FALSE_OR_POP_A,      ARG_JUMP_ABS,   1, 0, 0)
+OPINFO_SINCE(3, 11, JUMP_IF_FALSE_OR_POP_A, ARG_JUMP_REL, 0, 1, 0, 0, 0)
+OPINFO(JUMP_IF_TRUE_OR_POP_A,       ARG_JUMP_ABS,   1, 0, 0)
+OPINFO_SINCE(3, 11, JUMP_IF_TRUE_OR_POP_A, ARG_JUMP_REL, 0, 1, 0, 0, 0)
+OPINFO(POP_JUMP_IF_FALSE_A,         ARG_JUMP_ABS,   1, 0, 0)
+OPINFO_SINCE(3, 12, POP_JUMP_IF_FALSE_A, ARG_JUMP_REL, 0, 1, 0, 0, 0)
+OPINFO_SINCE(3, 13, POP_JUMP_IF_FALSE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(POP_JUMP_IF_TRUE_A,          ARG_JUMP_ABS,   1, 0, 0)
+OPINFO_SINCE(3, 12, POP_JUMP_IF_TRUE_A, ARG_JUMP_REL, 0, 1, 0, 0, 0)
+OPINFO_SINCE(3, 13, POP_JUMP_IF_TRUE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(CONTINUE_LOOP_A,             ARG_JUMP_ABS,   0, 0, OP_TERMINATOR)
+OPINFO(MAKE_CLOSURE_A,              ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(LOAD_CLOSURE_A,              ARG_CELL,       0, 1, 0)
+OPINFO(LOAD_DEREF_A,                ARG_CELL,       0, 1, 0)
+OPINFO(STORE_DEREF_A,               ARG_CELL,       1, 0, 0)
+OPINFO(DELETE_DEREF_A,              ARG_CELL,       0, 0, 0)
+OPINFO(SETUP_WITH_A,                ARG_JUMP_REL,   1, 2, OP_BLOCK_SETUP)
+OPINFO(SET_ADD_A,                   ARG_NUMBER,     1, 0, 0)
+OPINFO(MAP_ADD_A,                   ARG_NUMBER,     2, 0, 0)
+OPINFO(UNPACK_EX_A,                 ARG_NUMBER,     1, SPECIAL, 0)
+OPINFO(LIST_APPEND_A,               ARG_NUMBER,     1, 0, 0)
+OPINFO(LOAD_CLASSDEREF_A,           ARG_CELL,       0, 1, 0)
+OPINFO(MATCH_CLASS_A,               ARG_NUMBER,     3, 2, 0)
+OPINFO_SINCE(3, 11, MATCH_CLASS_A,  ARG_NUMBER, 0,  3, 1, 0, 0)
+OPINFO(BUILD_LIST_UNPACK_A,         ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_MAP_UNPACK_A,          ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_MAP_UNPACK_WITH_CALL_A, ARG_NUMBER,    SPECIAL, 1, 0)
+OPINFO(BUILD_TUPLE_UNPACK_A,        ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_SET_UNPACK_A,          ARG_NUMBER,     ARG, 1, 0)
+OPINFO(SETUP_ASYNC_WITH_A,          ARG_JUMP_REL,   0, 0, OP_BLOCK_SETUP)
+OPINFO(FORMAT_VALUE_A,              ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(BUILD_CONST_KEY_MAP_A,       ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(BUILD_STRING_A,              ARG_NUMBER,     ARG, 1, 0)
+OPINFO(BUILD_TUPLE_UNPACK_WITH_CALL_A, ARG_NUMBER,  ARG, 1, 0)
+OPINFO(LOAD_METHOD_A,               ARG_NAME,       1, 2, 0)
+OPINFO_SINCE(3, 11, LOAD_METHOD_A,  ARG_NAME,   0,  1, 2, 0, 10)
+OPINFO(CALL_METHOD_A,               ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO(CALL_FINALLY_A,              ARG_JUMP_REL,   0, 0, 0)
+OPINFO(POP_FINALLY_A,               ARG_NUMBER,     1, 0, 0)
+OPINFO(IS_OP_A,                     ARG_NUMBER,     2, 1, 0)
+OPINFO(CONTAINS_OP_A,               ARG_NUMBER,     2, 1, 0)
+OPINFO_SINCE(3, 13, CONTAINS_OP_A,  ARG_NUMBER, 0,  2, 1, 0, 1)
+OPINFO(RERAISE_A,                   ARG_NUMBER,     3, 0, OP_TERMINATOR)
+OPINFO_SINCE(3, 11, RERAISE_A,      ARG_NUMBER, 0,  1, 0, OP_TERMINATOR, 0)
+OPINFO(JUMP_IF_NOT_EXC_MATCH_A,     ARG_JUMP_ABS,   2, 0, 0)
+OPINFO(LIST_EXTEND_A,               ARG_NUMBER,     1, 0, 0)
+OPINFO(SET_UPDATE_A,                ARG_NUMBER,     1, 0, 0)
+OPINFO(DICT_MERGE_A,                ARG_NUMBER,     1, 0, 0)
+OPINFO(DICT_UPDATE_A,               ARG_NUMBER,     1, 0, 0)
+OPINFO(SWAP_A,                      ARG_NUMBER,     ARG, ARG, 0)
+OPINFO(POP_JUMP_FORWARD_IF_FALSE_A, ARG_JUMP_REL,   1, 0, 0)
+OPINFO(POP_JUMP_FORWARD_IF_TRUE_A,  ARG_JUMP_REL,   1, 0, 0)
+OPINFO(COPY_A,                      ARG_NUMBER,     ARG, SPECIAL, 0)
+OPINFO(BINARY_OP_A,                 ARG_NUMBER,     2, 1, 0)
+OPINFO_SINCE(3, 11, BINARY_OP_A,    ARG_NUMBER, 0,  2, 1, 0, 1)
+OPINFO(SEND_A,                      ARG_JUMP_REL,   2, 2, 0)
+OPINFO_SINCE(3, 12, SEND_A,         ARG_JUMP_REL, 0, 2, 2, 0, 1)
+OPINFO(POP_JUMP_FORWARD_IF_NOT_NONE_A, ARG_JUMP_REL, 1, 0, 0)
+OPINFO(POP_JUMP_FORWARD_IF_NONE_A,  ARG_JUMP_REL,   1, 0, 0)
+OPINFO(GET_AWAITABLE_A,             ARG_NUMBER,     1, 1, 0)
+OPINFO(JUMP_BACKWARD_NO_INTERRUPT_A, ARG_JUMP_BACK, 0, 0, OP_TERMINATOR)
+OPINFO(MAKE_CELL_A,                 ARG_CELL,       0, 0, 0)
+OPINFO(JUMP_BACKWARD_A,             ARG_JUMP_BACK,  0, 0, OP_TERMINATOR)
+OPINFO_SINCE(3, 13, JUMP_BACKWARD_A, ARG_JUMP_BACK, 0, 0, 0, OP_TERMINATOR, 1)
+OPINFO(PRECALL_A,                   ARG_NUMBER,     ARG, 0, 0)
+OPINFO_SINCE(3, 11, PRECALL_A,      ARG_NUMBER, 0,  ARG, 0, 0, 1)
+OPINFO(CALL_A,                      ARG_NUMBER,     2, 1, 0)
+OPINFO_SINCE(3, 11, CALL_A,         ARG_NUMBER, 0,  2, 1, 0, 4)
+OPINFO_SINCE(3, 12, CALL_A,         ARG_NUMBER, 0,  SPECIAL, 1, 0, 3)
+OPINFO(KW_NAMES_A,                  ARG_CONST,      0, 0, 0)
+OPINFO(POP_JUMP_BACKWARD_IF_NOT_NONE_A, ARG_JUMP_BACK, 1, 0, 0)
+OPINFO(POP_JUMP_BACKWARD_IF_NONE_A, ARG_JUMP_BACK,  1, 0, 0)
+OPINFO(POP_JUMP_BACKWARD_IF_FALSE_A, ARG_JUMP_BACK, 1, 0, 0)
+OPINFO(POP_JUMP_BACKWARD_IF_TRUE_A, ARG_JUMP_BACK,  1, 0, 0)
+OPINFO(RETURN_CONST_A,              ARG_CONST,      0, 0, OP_TERMINATOR)
+OPINFO(LOAD_FAST_CHECK_A,           ARG_LOCAL,      0, 1, 0)
+OPINFO(POP_JUMP_IF_NOT_NONE_A,      ARG_JUMP_REL,   1, 0, 0)
+OPINFO_SINCE(3, 13, POP_JUMP_IF_NOT_NONE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(POP_JUMP_IF_NONE_A,          ARG_JUMP_REL,   1, 0, 0)
+OPINFO_SINCE(3, 13, POP_JUMP_IF_NONE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(LOAD_SUPER_ATTR_A,           ARG_NAME,       3, SPECIAL, 0)
+OPINFO_SINCE(3, 12, LOAD_SUPER_ATTR_A, ARG_NAME, 2, 3, SPECIAL, 0, 1)
+OPINFO(LOAD_FAST_AND_CLEAR_A,       ARG_LOCAL,      0, 1, 0)
+OPINFO(YIELD_VALUE_A,               ARG_NUMBER,     1, 1, 0)
+OPINFO(CALL_INTRINSIC_1_A,          ARG_NUMBER,     1, 1, 0)
+OPINFO(CALL_INTRINSIC_2_A,          ARG_NUMBER,     2, 1, 0)
+OPINFO(LOAD_FROM_DICT_OR_GLOBALS_A, ARG_NAME,       1, 1, 0)
+OPINFO(LOAD_FROM_DICT_OR_DEREF_A,   ARG_CELL,       1, 1, 0)
+OPINFO(CALL_KW_A,                   ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO_SINCE(3, 13, CALL_KW_A,      ARG_NUMBER, 0,  SPECIAL, 1, 0, 3)
+OPINFO(CONVERT_VALUE_A,             ARG_NUMBER,     1, 1, 0)
+OPINFO(LOAD_FAST_LOAD_FAST_A,       ARG_LOCAL_PAIR, 0, 2, 0)
+OPINFO(SET_FUNCTION_ATTRIBUTE_A,    ARG_NUMBER,     2, 1, 0)
+OPINFO(STORE_FAST_LOAD_FAST_A,      ARG_LOCAL_PAIR, 1, 1, 0)
+OPINFO(STORE_FAST_STORE_FAST_A,     ARG_LOCAL_PAIR, 2, 0, 0)
+
+/* Instrumented opcodes (never stored in a .pyc, but listed for completeness) */
+OPINFO(INSTRUMENTED_LOAD_SUPER_ATTR_A, ARG_NAME,    3, SPECIAL, 0)
+OPINFO_SINCE(3, 12, INSTRUMENTED_LOAD_SUPER_ATTR_A, ARG_NAME, 2, 3, SPECIAL, 0, 1)
+OPINFO(INSTRUMENTED_POP_JUMP_IF_NONE_A, ARG_JUMP_REL, 1, 0, 0)
+OPINFO_SINCE(3, 13, INSTRUMENTED_POP_JUMP_IF_NONE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(INSTRUMENTED_POP_JUMP_IF_NOT_NONE_A, ARG_JUMP_REL, 1, 0, 0)
+OPINFO_SINCE(3, 13, INSTRUMENTED_POP_JUMP_IF_NOT_NONE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(INSTRUMENTED_CALL_A,         ARG_NUMBER,     SPECIAL, 1, 0)
+OPINFO_SINCE(3, 12, INSTRUMENTED_CALL_A, ARG_NUMBER, 0, SPECIAL, 1, 0, 3)
+OPINFO(INSTRUMENTED_RETURN_VALUE_A, ARG_NUMBER,     1, 0, OP_TERMINATOR)
+OPINFO(INSTRUMENTED_YIELD_VALUE_A,  ARG_NUMBER,     1, 1, 0)
+OPINFO(INSTRUMENTED_CALL_FUNCTION_EX_A, ARG_NUMBER, SPECIAL, 1, 0)
+OPINFO(INSTRUMENTED_JUMP_FORWARD_A, ARG_JUMP_REL,   0, 0, OP_TERMINATOR)
+OPINFO(INSTRUMENTED_JUMP_BACKWARD_A, ARG_JUMP_BACK, 0, 0, OP_TERMINATOR)
+OPINFO_SINCE(3, 13, INSTRUMENTED_JUMP_BACKWARD_A, ARG_JUMP_BACK, 0, 0, 0, OP_TERMINATOR, 1)
+OPINFO(INSTRUMENTED_RETURN_CONST_A, ARG_CONST,      0, 0, OP_TERMINATOR)
+OPINFO(INSTRUMENTED_FOR_ITER_A,     ARG_JUMP_REL,   1, 2, 0)
+OPINFO_SINCE(3, 12, INSTRUMENTED_FOR_ITER_A, ARG_JUMP_REL, 0, 1, 2, 0, 1)
+OPINFO(INSTRUMENTED_POP_JUMP_IF_FALSE_A, ARG_JUMP_REL, 1, 0, 0)
+OPINFO_SINCE(3, 13, INSTRUMENTED_POP_JUMP_IF_FALSE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(INSTRUMENTED_POP_JUMP_IF_TRUE_A, ARG_JUMP_REL, 1, 0, 0)
+OPINFO_SINCE(3, 13, INSTRUMENTED_POP_JUMP_IF_TRUE_A, ARG_JUMP_REL, 0, 1, 0, 0, 1)
+OPINFO(INSTRUMENTED_END_FOR_A,      ARG_NUMBER,     2, 0, 0)
+OPINFO(INSTRUMENTED_END_SEND_A,     ARG_NUMBER,     2, 1, 0)
+OPINFO(INSTRUMENTED_CALL_KW_A,      ARG_NUMBER,     SPECIAL, 1, 0)
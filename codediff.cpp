@@ -0,0 +1,305 @@
+#include "codediff.h"
+#include "bytecode.h"
+#include "disasm.h"
+#include "pyc_numeric.h"
+#include "pyc_sequence.h"
+#include "pyc_string.h"
+#include <cstring>
+#include <map>
+
+/* 64-bit FNV-1a */
+class Fingerprinter {
+public:
+    Fingerprinter(PycModule* mod, bool deep)
+        : m_mod(mod), m_deep(deep), m_hash(14695981039346656037ULL) { }
+
+    uint64_t hash() const { return m_hash; }
+
+    void addBytes(const void* data, size_t length)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; ++i) {
+            m_hash ^= bytes[i];
+            m_hash *= 1099511628211ULL;
+        }
+    }
+
+    void addInt(int value)
+    {
+        unsigned char bytes[4] = {
+            (unsigned char)(value & 0xFF), (unsigned char)((value >> 8) & 0xFF),
+            (unsigned char)((value >> 16) & 0xFF), (unsigned char)((value >> 24) & 0xFF)
+        };
+        addBytes(bytes, sizeof(bytes));
+    }
+
+    void addTag(char tag) { addBytes(&tag, 1); }
+
+    void addString(const char* str)
+    {
+        size_t length = strlen(str);
+        addInt((int)length);
+        addBytes(str, length);
+    }
+
+    void addString(PycRef<PycString> str)
+    {
+        if (str == NULL) {
+            addInt(-1);
+        } else {
+            addInt(str->length());
+            addBytes(str->value(), str->length());
+        }
+    }
+
+    void addObject(PycRef<PycObject> obj);
+    void addSequence(PycRef<PycSequence> seq);
+    void addCode(PycRef<PycCode> code);
+
+private:
+    PycModule* m_mod;
+    bool m_deep;
+    uint64_t m_hash;
+};
+
+void Fingerprinter::addObject(PycRef<PycObject> obj)
+{
+    switch (obj.type()) {
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        addTag('c');
+        if (m_deep)
+            addCode(obj.cast<PycCode>());
+        else
+            addString(obj.cast<PycCode>()->name());   // Compared separately
+        break;
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_STRINGREF:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        // The marshal type of a string also depends on its contents and on
+        // interning, so only distinguish bytes from text.
+        if (obj.type() == PycObject::TYPE_UNICODE)
+            addTag('u');
+        else if (obj.type() == PycObject::TYPE_STRING || m_mod->majorVer() < 3)
+            addTag('s');
+        else
+            addTag('u');
+        addString(obj.cast<PycString>());
+        break;
+    case PycObject::TYPE_INT:
+        addTag('i');
+        addInt(obj.cast<PycInt>()->value());
+        break;
+    case PycObject::TYPE_LONG:
+    case PycObject::TYPE_INT64:
+        {
+            PycRef<PycLong> num = obj.cast<PycLong>();
+            addTag('l');
+            addInt(num->size());
+            for (int digit : num->value())
+                addInt(digit);
+        }
+        break;
+    case PycObject::TYPE_FLOAT:
+        addTag('f');
+        addString(obj.cast<PycFloat>()->value());
+        break;
+    case PycObject::TYPE_COMPLEX:
+        addTag('x');
+        addString(obj.cast<PycComplex>()->value());
+        addString(obj.cast<PycComplex>()->imag());
+        break;
+    case PycObject::TYPE_BINARY_FLOAT:
+        {
+            double value = obj.cast<PycCFloat>()->value();
+            addTag('g');
+            addBytes(&value, sizeof(value));
+        }
+        break;
+    case PycObject::TYPE_BINARY_COMPLEX:
+        {
+            double value = obj.cast<PycCComplex>()->value();
+            double imag = obj.cast<PycCComplex>()->imag();
+            addTag('y');
+            addBytes(&value, sizeof(value));
+            addBytes(&imag, sizeof(imag));
+        }
+        break;
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+        addTag('(');
+        addSequence(obj.cast<PycSequence>());
+        break;
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        addTag((char)obj.type());
+        addSequence(obj.cast<PycSequence>());
+        break;
+    case PycObject::TYPE_DICT:
+        {
+            const auto& values = obj.cast<PycDict>()->values();
+            addTag('{');
+            addInt((int)values.size());
+            for (const auto& item : values) {
+                addObject(std::get<0>(item));
+                addObject(std::get<1>(item));
+            }
+        }
+        break;
+    default:
+        // Singletons (None, True, Ellipsis, ...) and NULL
+        addTag((char)obj.type());
+        break;
+    }
+}
+
+void Fingerprinter::addSequence(PycRef<PycSequence> seq)
+{
+    if (seq == NULL) {
+        addInt(-1);
+        return;
+    }
+    addInt(seq->size());
+    for (int i = 0; i < seq->size(); ++i)
+        addObject(seq->get(i));
+}
+
+void Fingerprinter::addCode(PycRef<PycCode> code)
+{
+    addString(code->name());
+    addInt(code->argCount());
+    addInt(code->posOnlyArgCount());
+    addInt(code->kwOnlyArgCount());
+    addInt(code->flags());
+    addString(code->code());
+    addSequence(code->consts());
+    addSequence(code->names());
+    addSequence(code->localNames());
+    addString(code->localKinds());
+    addSequence(code->freeVars());
+    addSequence(code->cellVars());
+    addString(code->exceptTable());
+}
+
+uint64_t code_fingerprint(PycRef<PycCode> code, PycModule* mod, bool deep)
+{
+    Fingerprinter fp(mod, deep);
+    fp.addCode(code);
+    return fp.hash();
+}
+
+static void collect_code(PycRef<PycCode> code, PycModule* mod,
+                         const std::string& name,
+                         std::vector<CodeFingerprint>& result)
+{
+    result.push_back({ name, code, code_fingerprint(code, mod, false) });
+
+    std::map<std::string, int> seen;
+    std::string prefix = name.empty() ? name : name + ".";
+    for (int i = 0; i < code->consts()->size(); ++i) {
+        PycRef<PycObject> obj = code->consts()->get(i);
+        if (obj.type() != PycObject::TYPE_CODE && obj.type() != PycObject::TYPE_CODE2)
+            continue;
+        PycRef<PycCode> child = obj.cast<PycCode>();
+        std::string childName = prefix + child->name()->value();
+        int count = ++seen[childName];
+        if (count > 1)
+            childName += "#" + std::to_string(count);
+        collect_code(child, mod, childName, result);
+    }
+}
+
+std::vector<CodeFingerprint> fingerprint_module(PycModule* mod)
+{
+    std::vector<CodeFingerprint> result;
+    collect_code(mod->code(), mod, std::string(), result);
+    return result;
+}
+
+static const char* display_name(const CodeFingerprint& entry)
+{
+    return entry.name.empty() ? "<module>" : entry.name.c_str();
+}
+
+static void output_code(const CodeFingerprint& entry, PycModule* mod,
+                        unsigned flags, std::ostream& pyc_output)
+{
+    output_object(entry.code.cast<PycObject>(), mod, 1,
+                  flags | Pyc::DISASM_CODE_REFS, pyc_output);
+}
+
+int diff_modules(PycModule* oldMod, const char* oldName, PycModule* newMod,
+                 const char* newName, unsigned flags, std::ostream& pyc_output)
+{
+    std::vector<CodeFingerprint> oldCode = fingerprint_module(oldMod);
+    std::vector<CodeFingerprint> newCode = fingerprint_module(newMod);
+
+    std::map<std::string, size_t> newIndex;
+    for (size_t i = 0; i < newCode.size(); ++i)
+        newIndex[newCode[i].name] = i;
+
+    // Pairs of (old, new) indices; -1 for a missing side
+    std::vector<std::pair<long, long>> changes;
+    std::vector<bool> matched(newCode.size(), false);
+    int unchanged = 0;
+    for (size_t i = 0; i < oldCode.size(); ++i) {
+        auto iter = newIndex.find(oldCode[i].name);
+        if (iter == newIndex.end()) {
+            changes.emplace_back((long)i, -1L);
+            continue;
+        }
+        matched[iter->second] = true;
+        if (oldCode[i].hash != newCode[iter->second].hash)
+            changes.emplace_back((long)i, (long)iter->second);
+        else
+            ++unchanged;
+    }
+    for (size_t i = 0; i < newCode.size(); ++i) {
+        if (!matched[i])
+            changes.emplace_back(-1L, (long)i);
+    }
+
+    formatted_print(pyc_output, "--- %s (Python %d.%d)\n", oldName,
+                    oldMod->majorVer(), oldMod->minorVer());
+    formatted_print(pyc_output, "+++ %s (Python %d.%d)\n", newName,
+                    newMod->majorVer(), newMod->minorVer());
+
+    int changed = 0, removed = 0, added = 0;
+    for (const auto& change : changes) {
+        if (change.second < 0) {
+            formatted_print(pyc_output, "- %s\n", display_name(oldCode[change.first]));
+            ++removed;
+        } else if (change.first < 0) {
+            formatted_print(pyc_output, "+ %s\n", display_name(newCode[change.second]));
+            ++added;
+        } else {
+            formatted_print(pyc_output, "~ %s\n", display_name(oldCode[change.first]));
+            ++changed;
+        }
+    }
+    formatted_print(pyc_output, "%d changed, %d added, %d removed, %d unchanged\n",
+                    changed, added, removed, unchanged);
+
+    // Only the code objects that differ are disassembled
+    for (const auto& change : changes) {
+        if (change.first >= 0 && change.second >= 0) {
+            formatted_print(pyc_output, "\n~ %s (%s)\n",
+                            display_name(oldCode[change.first]), oldName);
+            output_code(oldCode[change.first], oldMod, flags, pyc_output);
+            formatted_print(pyc_output, "~ %s (%s)\n",
+                            display_name(newCode[change.second]), newName);
+            output_code(newCode[change.second], newMod, flags, pyc_output);
+        } else if (change.first < 0) {
+            formatted_print(pyc_output, "\n+ %s\n", display_name(newCode[change.second]));
+            output_code(newCode[change.second], newMod, flags, pyc_output);
+        }
+    }
+
+    return changed + added + removed;
+}
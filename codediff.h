@@ -0,0 +1,40 @@
+#ifndef _PYC_CODEDIFF_H
+#define _PYC_CODEDIFF_H
+
+#include "pyc_module.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Structural comparison of the code objects of two modules, used to find the
+ * functions that changed between two builds without disassembling or
+ * decompiling everything. */
+
+struct CodeFingerprint {
+    /* Dotted path of code object names from the module, e.g. "Foo.bar".
+     * Repeated names within one parent (lambdas, comprehensions, functions
+     * redefined in different branches) get a "#2", "#3", ... suffix. */
+    std::string name;
+    PycRef<PycCode> code;
+
+    /* Hash of the bytecode, constants, names and signature.  Nested code
+     * objects contribute only their name, so a change in a method does not
+     * mark its class as changed.  Line numbers and file names are ignored. */
+    uint64_t hash;
+};
+
+/* Fingerprint of a single code object, as in CodeFingerprint.  With deep
+ * set, nested code objects are hashed in full instead of by name. */
+uint64_t code_fingerprint(PycRef<PycCode> code, PycModule* mod, bool deep);
+
+/* All code objects of the module, in depth-first order */
+std::vector<CodeFingerprint> fingerprint_module(PycModule* mod);
+
+/* Write a summary of added, removed and changed code objects to pyc_output,
+ * followed by the disassembly (with Pyc::DisassemblyFlags) of only those
+ * objects that differ.  Returns the number of differences found. */
+int diff_modules(PycModule* oldMod, const char* oldName, PycModule* newMod,
+                 const char* newName, unsigned flags, std::ostream& pyc_output);
+
+#endif
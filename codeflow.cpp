@@ -0,0 +1,316 @@
+#include "codeflow.h"
+#include "bytecode.h"
+#include <algorithm>
+
+static void decode_instructions(const void* bytecode, int length, PycModule* mod,
+                                std::vector<Instruction>& instructions)
+{
+    PycBuffer source(bytecode, length);
+
+    instructions.clear();
+    // Most instructions take two bytes since Python 3.6
+    instructions.reserve(length / 2 + 1);
+
+    int pos = 0;
+    while (!source.atEof()) {
+        Instruction instr;
+        instr.pos = pos;
+        bc_next(source, mod, instr.opcode, instr.operand, pos);
+        instr.next = pos;
+        instructions.push_back(instr);
+    }
+}
+
+std::vector<Instruction> decode_instructions(PycRef<PycCode> code, PycModule* mod)
+{
+    return decode_instructions(code->code()->value(), code->code()->length(), mod);
+}
+
+std::vector<Instruction> decode_instructions(const void* bytecode, int length, PycModule* mod)
+{
+    std::vector<Instruction> instructions;
+    decode_instructions(bytecode, length, mod, instructions);
+    return instructions;
+}
+
+void decode_instructions(PycRef<PycCode> code, PycModule* mod,
+                         std::vector<Instruction>& instructions)
+{
+    decode_instructions(code->code()->value(), code->code()->length(), mod, instructions);
+}
+
+int instruction_at(const std::vector<Instruction>& instructions, int pos)
+{
+    auto it = std::lower_bound(instructions.begin(), instructions.end(), pos,
+                               [](const Instruction& instr, int pos) {
+                                   return instr.pos < pos;
+                               });
+    if (it == instructions.end() || it->pos != pos)
+        return -1;
+    return (int)(it - instructions.begin());
+}
+
+static int read_exception_varint(const unsigned char*& data, const unsigned char* end)
+{
+    int value = 0;
+    while (data != end) {
+        int byte = *data++;
+        value = (value << 6) | (byte & 0x3F);
+        if ((byte & 0x40) == 0)
+            return value;
+    }
+    return -1;
+}
+
+std::vector<ExceptionTableEntry> parse_exception_table(PycRef<PycCode> code, PycModule* mod)
+{
+    std::vector<ExceptionTableEntry> entries;
+    parse_exception_table(code, mod, entries);
+    return entries;
+}
+
+void parse_exception_table(PycRef<PycCode> code, PycModule* mod,
+                           std::vector<ExceptionTableEntry>& entries)
+{
+    entries.clear();
+    if (mod->verCompare(3, 11) < 0 || code->exceptTable() == NULL)
+        return;
+
+    // Entries are varints of 6-bit chunks, with 0x80 marking the first byte
+    // of an entry and 0x40 a continuation; offsets count 16-bit code units
+    PycRef<PycString> table = code->exceptTable();
+    const unsigned char* data = (const unsigned char*)table->value();
+    const unsigned char* end = data + table->length();
+    while (data != end) {
+        if ((*data & 0x80) == 0) {
+            ++data;     // Resynchronize on the next entry
+            continue;
+        }
+        int start = read_exception_varint(data, end);
+        int length = read_exception_varint(data, end);
+        int target = read_exception_varint(data, end);
+        int depth_lasti = read_exception_varint(data, end);
+        if (depth_lasti < 0)
+            break;
+
+        ExceptionTableEntry entry;
+        entry.start = start * 2;
+        entry.end = (start + length) * 2;
+        entry.target = target * 2;
+        entry.depth = depth_lasti >> 1;
+        entry.lasti = (depth_lasti & 1) != 0;
+        entries.push_back(entry);
+    }
+}
+
+JumpMap::JumpMap(const std::vector<Instruction>& instructions, PycRef<PycCode> code,
+                 PycModule* mod)
+{
+    build(instructions, parse_exception_table(code, mod), code->code()->length(), mod);
+}
+
+void JumpMap::build(const std::vector<Instruction>& instructions,
+                    const std::vector<ExceptionTableEntry>& handlers, int codeLength,
+                    PycModule* mod)
+{
+    m_flags.assign(codeLength, 0);
+    m_targets.clear();
+    m_sources.clear();
+
+    auto mark = [this](int pos, unsigned char mask) {
+        if (pos >= 0 && pos < (int)m_flags.size())
+            m_flags[pos] |= mask;
+    };
+
+    for (const auto& instr : instructions) {
+        if (!Pyc::GetOpcodeInfo(instr.opcode, mod).isJump())
+            continue;
+        mark(instr.pos, SOURCE);
+        mark(Pyc::JumpTarget(instr.opcode, instr.operand, instr.next, mod), TARGET);
+    }
+    for (const auto& entry : handlers)
+        mark(entry.target, TARGET);
+
+    for (int pos = 0; pos < (int)m_flags.size(); ++pos) {
+        if (m_flags[pos] & TARGET)
+            m_targets.push_back(pos);
+        if (m_flags[pos] & SOURCE)
+            m_sources.push_back(pos);
+    }
+}
+
+/* Instructions that finish an exception handler or finally block, popping
+ * values the interpreter pushed on entering it.  Compilers emit them even
+ * where nothing reaches them, such as after a bare except clause. */
+static bool ends_handler(int opcode)
+{
+    switch (opcode) {
+    case Pyc::END_FINALLY:
+    case Pyc::POP_EXCEPT:
+    case Pyc::RERAISE:
+    case Pyc::RERAISE_A:
+    case Pyc::END_ASYNC_FOR:
+    case Pyc::WITH_CLEANUP:
+    case Pyc::WITH_CLEANUP_START:
+    case Pyc::WITH_CLEANUP_FINISH:
+    case Pyc::POP_FINALLY_A:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::vector<CodeRange> find_dead_ranges(const std::vector<Instruction>& instructions,
+                                        PycRef<PycCode> code, PycModule* mod)
+{
+    CodeFlowScratch scratch;
+    std::vector<CodeRange> ranges;
+    find_dead_ranges(instructions, parse_exception_table(code, mod), mod, scratch, ranges);
+    return ranges;
+}
+
+void find_dead_ranges(const std::vector<Instruction>& instructions,
+                      const std::vector<ExceptionTableEntry>& handlers, PycModule* mod,
+                      CodeFlowScratch& scratch, std::vector<CodeRange>& ranges)
+{
+    std::vector<char>& reached = scratch.reached;
+    std::vector<int>& pending = scratch.pending;
+    reached.assign(instructions.size(), false);
+    pending.clear();
+    auto reach = [&](int index) {
+        if (index < 0 || index >= (int)instructions.size() || reached[index])
+            return;
+        reached[index] = true;
+        pending.push_back(index);
+    };
+
+    reach(0);
+    for (const auto& entry : handlers)
+        reach(instruction_at(instructions, entry.target));
+
+    while (!pending.empty()) {
+        int index = pending.back();
+        pending.pop_back();
+        const Instruction& instr = instructions[index];
+        const Pyc::OpcodeInfo& info = Pyc::GetOpcodeInfo(instr.opcode, mod);
+        if ((info.flags & Pyc::OP_TERMINATOR) == 0)
+            reach(index + 1);
+        if (info.isJump())
+            reach(instruction_at(instructions, Pyc::JumpTarget(instr.opcode, instr.operand,
+                                                               instr.next, mod)));
+    }
+
+    ranges.clear();
+    int depth = 0;
+    for (size_t index = 0; index < instructions.size(); ++index) {
+        if (reached[index])
+            continue;
+        const Instruction& instr = instructions[index];
+        if (ranges.empty() || ranges.back().end != instr.pos) {
+            ranges.push_back({ instr.pos, instr.next, false });
+            depth = 0;
+        }
+        CodeRange& range = ranges.back();
+        range.end = instr.next;
+        if (range.malformed)
+            continue;
+
+        // Run the range on its own, from an empty stack
+        int pops, pushes;
+        Pyc::StackEffect(instr.opcode, instr.operand, mod, false, pops, pushes);
+        if (instr.opcode == Pyc::PYC_INVALID_OPCODE
+                || (depth < pops && !ends_handler(instr.opcode))) {
+            range.malformed = true;
+            continue;
+        }
+        depth = std::max(depth + pushes - pops, 0);
+        if (Pyc::GetOpcodeInfo(instr.opcode, mod).isJump()
+                && instruction_at(instructions, Pyc::JumpTarget(instr.opcode, instr.operand,
+                                                                 instr.next, mod)) < 0)
+            range.malformed = true;
+    }
+}
+
+StackDepth analyze_stack_depth(const std::vector<Instruction>& instructions,
+                               PycRef<PycCode> code, PycModule* mod)
+{
+    return analyze_stack_depth(instructions, parse_exception_table(code, mod), mod);
+}
+
+StackDepth analyze_stack_depth(const std::vector<Instruction>& instructions,
+                               const std::vector<ExceptionTableEntry>& handlers,
+                               PycModule* mod)
+{
+    CodeFlowScratch scratch;
+    StackDepth result;
+    analyze_stack_depth(instructions, handlers, mod, scratch, result);
+    return result;
+}
+
+void analyze_stack_depth(const std::vector<Instruction>& instructions,
+                         const std::vector<ExceptionTableEntry>& handlers, PycModule* mod,
+                         CodeFlowScratch& scratch, StackDepth& result)
+{
+    result.depth.assign(instructions.size(), -1);
+    result.maxDepth = 0;
+    result.underflowPos = -1;
+    result.bounded = true;
+    if (instructions.empty())
+        return;
+
+    // Well-formed code reaches each instruction with at most a few distinct
+    // depths, so running out of this means a loop keeps growing the stack
+    size_t budget = 16 * instructions.size() + 1024;
+
+    std::vector<int>& pending = scratch.pending;
+    pending.clear();
+    auto reach = [&](int index, int depth) {
+        if (index < 0 || index >= (int)instructions.size() || result.depth[index] >= depth)
+            return;
+        result.depth[index] = depth;
+        result.maxDepth = std::max(result.maxDepth, depth);
+        pending.push_back(index);
+    };
+
+    // The generator code of Python 3.10 starts by popping the value sent to it
+    reach(0, instructions[0].opcode == Pyc::GEN_START_A ? 1 : 0);
+    // Handlers start with the exception (and optionally the offset of the
+    // raising instruction) above the recorded depth
+    for (const auto& entry : handlers)
+        reach(instruction_at(instructions, entry.target), entry.depth + (entry.lasti ? 2 : 1));
+
+    while (!pending.empty()) {
+        if (budget-- == 0) {
+            result.bounded = false;
+            return;
+        }
+        int index = pending.back();
+        pending.pop_back();
+        const Instruction& instr = instructions[index];
+        const Pyc::OpcodeInfo& info = Pyc::GetOpcodeInfo(instr.opcode, mod);
+        int depth = result.depth[index];
+        int pops, pushes;
+
+        Pyc::StackEffect(instr.opcode, instr.operand, mod, false, pops, pushes);
+        if (depth < pops)
+            continue;   // Unless a deeper path gets here later
+        if ((info.flags & Pyc::OP_TERMINATOR) == 0)
+            reach(index + 1, depth - pops + pushes);
+
+        if (info.isJump()) {
+            Pyc::StackEffect(instr.opcode, instr.operand, mod, true, pops, pushes);
+            int target = Pyc::JumpTarget(instr.opcode, instr.operand, instr.next, mod);
+            reach(instruction_at(instructions, target), depth - pops + pushes);
+        }
+    }
+
+    for (size_t index = 0; index < instructions.size(); ++index) {
+        const Instruction& instr = instructions[index];
+        int pops, pushes;
+        Pyc::StackEffect(instr.opcode, instr.operand, mod, false, pops, pushes);
+        if (result.depth[index] >= 0 && result.depth[index] < pops) {
+            result.underflowPos = instr.pos;
+            break;
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef _PYC_CODEFLOW_H
+#define _PYC_CODEFLOW_H
+
+#include "pyc_code.h"
+#include "pyc_module.h"
+#include <vector>
+
+/* Linear analyses of the bytecode of a code object, driven by the opcode
+ * metadata in bytecode_info.inl.  They run on the decoded instructions
+ * before the AST is built, and are shown by pycdas. */
+
+struct Instruction {
+    int pos;        // Offset of the instruction (including EXTENDED_ARG)
+    int next;       // Offset of the following instruction
+    int opcode;     // Pyc::Opcode
+    int operand;
+};
+
+/* All instructions of code, including CACHE entries */
+std::vector<Instruction> decode_instructions(PycRef<PycCode> code, PycModule* mod);
+std::vector<Instruction> decode_instructions(const void* bytecode, int length, PycModule* mod);
+
+/* The same into instructions, reusing its buffer */
+void decode_instructions(PycRef<PycCode> code, PycModule* mod,
+                         std::vector<Instruction>& instructions);
+
+/* Index of the instruction starting at pos, or -1 */
+int instruction_at(const std::vector<Instruction>& instructions, int pos);
+
+struct ExceptionTableEntry {
+    int start, end;     // Covered range of offsets
+    int target;         // Offset of the handler
+    int depth;          // Stack depth the handler unwinds to
+    bool lasti;         // Whether the offset of the raising instruction is pushed
+};
+
+/* Exception table of a Python 3.11+ code object, with offsets in bytes */
+std::vector<ExceptionTableEntry> parse_exception_table(PycRef<PycCode> code, PycModule* mod);
+void parse_exception_table(PycRef<PycCode> code, PycModule* mod,
+                           std::vector<ExceptionTableEntry>& entries);
+
+/* Work lists of the analyses below, for callers that run them on many code
+ * objects and want to keep their buffers between them */
+struct CodeFlowScratch {
+    std::vector<int> pending;
+    std::vector<char> reached;
+};
+
+/* Offsets where jumps (and exception handlers) lead to, and where the jumps
+ * themselves are, as a flag per code byte for O(1) lookups and as sorted
+ * lists of offsets */
+class JumpMap {
+public:
+    JumpMap() { }
+    JumpMap(const std::vector<Instruction>& instructions, PycRef<PycCode> code,
+            PycModule* mod);
+
+    /* Replaces the contents, reusing the buffers */
+    void build(const std::vector<Instruction>& instructions,
+               const std::vector<ExceptionTableEntry>& handlers, int codeLength,
+               PycModule* mod);
+
+    bool isTarget(int pos) const { return flag(pos, TARGET); }
+    bool isSource(int pos) const { return flag(pos, SOURCE); }
+
+    const std::vector<int>& targets() const { return m_targets; }
+    const std::vector<int>& sources() const { return m_sources; }
+
+private:
+    enum { TARGET = 0x1, SOURCE = 0x2 };
+
+    bool flag(int pos, unsigned char mask) const
+    {
+        return pos >= 0 && pos < (int)m_flags.size() && (m_flags[pos] & mask) != 0;
+    }
+
+    std::vector<unsigned char> m_flags;
+    std::vector<int> m_targets;
+    std::vector<int> m_sources;
+};
+
+struct CodeRange {
+    int start, end;     // Offsets of the first instruction and past the last
+    bool malformed;     // Has invalid opcodes or jumps, or pops values it
+                        // never pushed, so it cannot be compiled source
+};
+
+/* Runs of instructions that no path from the entry point or an exception
+ * handler reaches.  Older compilers leave the code of statements following
+ * a return or raise in place, but obfuscators also hide junk there. */
+std::vector<CodeRange> find_dead_ranges(const std::vector<Instruction>& instructions,
+                                        PycRef<PycCode> code, PycModule* mod);
+void find_dead_ranges(const std::vector<Instruction>& instructions,
+                      const std::vector<ExceptionTableEntry>& handlers, PycModule* mod,
+                      CodeFlowScratch& scratch, std::vector<CodeRange>& ranges);
+
+struct StackDepth {
+    StackDepth() : maxDepth(0), underflowPos(-1), bounded(true) { }
+
+    /* Deepest stack before each instruction (indexed like the
+     * instructions), or -1 for instructions that are never reached */
+    std::vector<int> depth;
+
+    int maxDepth;
+    int underflowPos;   // First instruction popping from an empty stack, or -1
+    bool bounded;       // False if some loop keeps growing the stack
+};
+
+/* Follow every path through the code from its entry point and exception
+ * handlers, applying the stack effect of each instruction and keeping the
+ * deepest stack where paths meet (like CPython's stackdepth()).  Each
+ * instruction is normally visited once or twice, so this is linear in the
+ * size of the code; depth and underflowPos are only meaningful if the
+ * result is bounded. */
+StackDepth analyze_stack_depth(const std::vector<Instruction>& instructions,
+                               PycRef<PycCode> code, PycModule* mod);
+
+/* The same, with the exception table given separately (for code that is
+ * still being assembled) */
+StackDepth analyze_stack_depth(const std::vector<Instruction>& instructions,
+                               const std::vector<ExceptionTableEntry>& handlers,
+                               PycModule* mod);
+void analyze_stack_depth(const std::vector<Instruction>& instructions,
+                         const std::vector<ExceptionTableEntry>& handlers, PycModule* mod,
+                         CodeFlowScratch& scratch, StackDepth& result);
+
+#endif
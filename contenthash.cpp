@@ -0,0 +1,310 @@
+#include "contenthash.h"
+#include "pyc_module.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* Walks marshal data like LoadObject() does, hashing the bytes it reads
+ * instead of creating objects, and optionally counting the uses of objects
+ * stored by reference.  See pyc_code.cpp for the layout of code objects. */
+class MarshalScanner {
+public:
+    MarshalScanner(PycData* in, int major, int minor, unsigned flags,
+                   MarshalRefUses* uses = nullptr)
+        : m_in(in), m_maj(major), m_min(minor), m_flags(flags), m_muted(0),
+          m_hash(14695981039346656037ULL), m_chunk(4096), m_uses(uses) { }
+
+    uint64_t hash() const { return m_hash; }
+
+    int verCompare(int maj, int min) const
+    {
+        if (m_maj == maj)
+            return m_min - min;
+        return m_maj - maj;
+    }
+
+    void addBytes(const void* data, size_t length)
+    {
+        if (m_muted)
+            return;
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; ++i) {
+            m_hash ^= bytes[i];
+            m_hash *= 1099511628211ULL;
+        }
+    }
+
+    void addInt(int value)
+    {
+        unsigned char bytes[4] = {
+            (unsigned char)(value & 0xFF), (unsigned char)((value >> 8) & 0xFF),
+            (unsigned char)((value >> 16) & 0xFF), (unsigned char)((value >> 24) & 0xFF)
+        };
+        addBytes(bytes, sizeof(bytes));
+    }
+
+    /* Returns the type of the object, without FLAG_REF */
+    int walkObject();
+
+private:
+    int readByte()
+    {
+        int ch = m_in->getByte();
+        if (ch == EOF)
+            throw std::runtime_error("Unexpected end of marshal data");
+        unsigned char byte = (unsigned char)ch;
+        addBytes(&byte, 1);
+        return byte;
+    }
+
+    int read16()
+    {
+        int result = readByte();
+        result |= readByte() << 8;
+        return result;
+    }
+
+    int read32()
+    {
+        int result = read16();
+        result |= read16() << 16;
+        return result;
+    }
+
+    /* A short before 2.3, and a long after */
+    int readCount() { return verCompare(2, 3) >= 0 ? read32() : read16(); }
+
+    void readBytes(int length)
+    {
+        if (length < 0)
+            throw std::runtime_error("Invalid length in marshal data");
+        while (length > 0) {
+            int count = std::min(length, (int)m_chunk.size());
+            if (m_in->getBuffer(count, m_chunk.data()) != count)
+                throw std::runtime_error("Unexpected end of marshal data");
+            addBytes(m_chunk.data(), count);
+            length -= count;
+        }
+    }
+
+    void walkItems(int count)
+    {
+        if (count < 0)
+            throw std::runtime_error("Invalid size in marshal data");
+        for (int i = 0; i < count; ++i)
+            walkObject();
+    }
+
+    void walkMuted()
+    {
+        ++m_muted;
+        walkObject();
+        --m_muted;
+    }
+
+    void walkCode();
+
+    static void addUse(std::vector<int>& uses, int index)
+    {
+        if (index >= 0 && (size_t)index < uses.size())
+            ++uses[(size_t)index];
+    }
+
+    PycData* m_in;
+    int m_maj, m_min;
+    unsigned m_flags;
+    int m_muted;        // Nesting of values that are read without hashing
+    uint64_t m_hash;
+    std::vector<unsigned char> m_chunk;
+    MarshalRefUses* m_uses;
+};
+
+int MarshalScanner::walkObject()
+{
+    int byte = readByte();
+    int type = byte & 0x7F;     // FLAG_REF is hashed, but not a type
+    if (m_uses && byte != PycObject::TYPE_OBREF && (byte & 0x80) && type != PycObject::TYPE_NULL)
+        m_uses->refs.push_back(0);
+
+    switch (type) {
+    case PycObject::TYPE_NULL:
+    case PycObject::TYPE_NONE:
+    case PycObject::TYPE_FALSE:
+    case PycObject::TYPE_TRUE:
+    case PycObject::TYPE_STOPITER:
+    case PycObject::TYPE_ELLIPSIS:
+        break;
+    case PycObject::TYPE_INT:
+        read32();
+        break;
+    case PycObject::TYPE_STRINGREF:
+        {
+            int index = read32();
+            if (m_uses)
+                addUse(m_uses->interns, index);
+        }
+        break;
+    case PycObject::TYPE_OBREF:
+        {
+            int index = read32();
+            if (m_uses && byte == PycObject::TYPE_OBREF)
+                addUse(m_uses->refs, index);
+        }
+        break;
+    case PycObject::TYPE_INT64:
+    case PycObject::TYPE_BINARY_FLOAT:
+        readBytes(8);
+        break;
+    case PycObject::TYPE_BINARY_COMPLEX:
+        readBytes(16);
+        break;
+    case PycObject::TYPE_FLOAT:
+        readBytes(readByte());
+        break;
+    case PycObject::TYPE_COMPLEX:
+        readBytes(readByte());
+        readBytes(readByte());
+        break;
+    case PycObject::TYPE_LONG:
+        {
+            int size = read32();
+            if (size < -0x3FFFFFFF || size > 0x3FFFFFFF)
+                throw std::runtime_error("Invalid size in marshal data");
+            readBytes(2 * (size < 0 ? -size : size));
+        }
+        break;
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_ASCII:
+        readBytes(read32());
+        break;
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_ASCII_INTERNED:
+        readBytes(read32());
+        if (m_uses)
+            m_uses->interns.push_back(0);
+        break;
+    case PycObject::TYPE_SHORT_ASCII:
+        readBytes(readByte());
+        break;
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        readBytes(readByte());
+        if (m_uses)
+            m_uses->interns.push_back(0);
+        break;
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        walkItems(read32());
+        break;
+    case PycObject::TYPE_SMALL_TUPLE:
+        walkItems(readByte());
+        break;
+    case PycObject::TYPE_DICT:
+        while (walkObject() != PycObject::TYPE_NULL)
+            walkObject();
+        break;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        walkCode();
+        break;
+    default:
+        throw std::runtime_error("Unsupported marshal type " + std::to_string(type));
+    }
+    return type;
+}
+
+void MarshalScanner::walkCode()
+{
+    if (verCompare(1, 3) >= 0)
+        readCount();        // argcount
+    if (verCompare(3, 8) >= 0)
+        read32();           // posonlyargcount
+    if (m_maj >= 3)
+        read32();           // kwonlyargcount
+    if (verCompare(1, 3) >= 0 && verCompare(3, 11) < 0)
+        readCount();        // nlocals
+    if (verCompare(1, 5) >= 0)
+        readCount();        // stacksize
+    if (verCompare(1, 3) >= 0)
+        readCount();        // flags
+
+    walkObject();           // code
+    walkObject();           // consts
+    walkObject();           // names
+    if (verCompare(1, 3) >= 0)
+        walkObject();       // varnames or localsplusnames
+    if (verCompare(3, 11) >= 0)
+        walkObject();       // localspluskinds
+    if (verCompare(2, 1) >= 0 && verCompare(3, 11) < 0) {
+        walkObject();       // freevars
+        walkObject();       // cellvars
+    }
+
+    if (m_flags & HASH_IGNORE_FILENAME)
+        walkMuted();
+    else
+        walkObject();
+    walkObject();           // name
+    if (verCompare(3, 11) >= 0)
+        walkObject();       // qualname
+
+    if (verCompare(1, 5) >= 0) {
+        if (m_flags & HASH_IGNORE_FIRSTLINE) {
+            ++m_muted;
+            readCount();
+            --m_muted;
+        } else {
+            readCount();
+        }
+        walkObject();       // lnotab or linetable
+    }
+    if (verCompare(3, 11) >= 0)
+        walkObject();       // exceptiontable
+}
+
+uint64_t pyc_content_hash(PycData* in, unsigned flags)
+{
+    unsigned int magic = (unsigned int)in->get32();
+    PycModule mod;
+    mod.setVersion(magic);
+    if (!mod.isValid())
+        throw std::runtime_error("Bad MAGIC");
+
+    // Skip the rest of the header, as PycModule::loadPyc() does
+    if (mod.verCompare(3, 7) >= 0)
+        in->get32();    // Flags
+    in->get32();        // Timestamp, or first half of the source hash
+    if (mod.verCompare(3, 3) >= 0)
+        in->get32();    // Source size, or second half of the source hash
+
+    MarshalScanner hasher(in, mod.majorVer(), mod.minorVer(), flags);
+    hasher.addInt((int)magic);
+    hasher.walkObject();
+    return hasher.hash();
+}
+
+uint64_t marshal_content_hash(PycData* in, int major, int minor, unsigned flags)
+{
+    unsigned int magic = PycModule::versionMagic(major, minor);
+    if (magic == INVALID)
+        throw std::runtime_error("Unsupported Python version");
+
+    MarshalScanner hasher(in, major, minor, flags);
+    hasher.addInt((int)magic);
+    hasher.walkObject();
+    return hasher.hash();
+}
+
+MarshalRefUses marshal_ref_uses(PycData* in, int major, int minor)
+{
+    if (!PycModule::isSupportedVersion(major, minor))
+        throw std::runtime_error("Unsupported Python version");
+
+    MarshalRefUses uses;
+    MarshalScanner scanner(in, major, minor, 0, &uses);
+    scanner.walkObject();
+    return uses;
+}
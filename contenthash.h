@@ -0,0 +1,39 @@
+#ifndef _PYC_CONTENTHASH_H
+#define _PYC_CONTENTHASH_H
+
+#include "data.h"
+#include <cstdint>
+#include <vector>
+
+/* Hashes of compiled code that stay the same when identical code is
+ * compiled again, for caching and deduplication.  The raw bytes of a pyc
+ * file change with the timestamp and size of its source (or, since 3.7,
+ * with the source hash and flags), so these cover only the magic number and
+ * the marshalled code.  The marshal data is walked as it is read, without
+ * loading any objects. */
+
+enum ContentHashFlags {
+    HASH_IGNORE_FILENAME = 0x1,     // co_filename of every code object
+    HASH_IGNORE_FIRSTLINE = 0x2,    // co_firstlineno of every code object
+};
+
+/* 64-bit FNV-1a hash of a pyc file read from in, which must hold a whole
+ * valid file.  Throws std::runtime_error for unknown versions and
+ * truncated or malformed marshal data. */
+uint64_t pyc_content_hash(PycData* in, unsigned flags);
+
+/* The same for a bare marshalled object of the given version */
+uint64_t marshal_content_hash(PycData* in, int major, int minor, unsigned flags);
+
+/* How often each object stored with FLAG_REF (3.4+) or interned (before
+ * 3.0) is used again through TYPE_OBREF or TYPE_STRINGREF, numbered the way
+ * PycModule numbers them */
+struct MarshalRefUses {
+    std::vector<int> refs, interns;
+};
+
+/* Counts them with the same walk over the marshal data in, without loading
+ * it, for PycModule::setRefUses() */
+MarshalRefUses marshal_ref_uses(PycData* in, int major, int minor);
+
+#endif
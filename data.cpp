@@ -3,6 +3,13 @@
 #include <cstdarg>
 #include <vector>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 /* PycData */
 int PycData::get16()
 {
@@ -84,6 +91,51 @@ int PycBuffer::getBuffer(int bytes, void* buffer)
     return bytes;
 }
 
+
+/* PycMappedFile */
+PycMappedFile::PycMappedFile(const char* filename)
+    : m_data(), m_size(), m_mapped()
+{
+#ifndef WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            m_data = static_cast<const unsigned char*>(map);
+            m_size = (size_t)st.st_size;
+            m_mapped = true;
+        }
+    }
+    close(fd);
+    if (m_mapped)
+        return;
+#endif
+
+    FILE* in = fopen(filename, "rb");
+    if (!in)
+        return;
+    unsigned char chunk[65536];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), in)) != 0)
+        m_buffer.insert(m_buffer.end(), chunk, chunk + count);
+    fclose(in);
+    if (!m_buffer.empty()) {
+        m_data = &m_buffer[0];
+        m_size = m_buffer.size();
+    }
+}
+
+PycMappedFile::~PycMappedFile()
+{
+#ifndef WIN32
+    if (m_mapped)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
 int formatted_print(std::ostream& stream, const char* format, ...)
 {
     va_list args;
@@ -2,7 +2,9 @@
 #define _PYC_FILE_H
 
 #include <cstdio>
+#include <cstddef>
 #include <ostream>
+#include <vector>
 
 #ifdef WIN32
 typedef __int64 Pyc_INT64;
@@ -52,11 +54,34 @@ public:
     int getByte() override;
     int getBuffer(int bytes, void* buffer) override;
 
+    void skip(int bytes) { m_pos = (bytes < m_size - m_pos) ? m_pos + bytes : m_size; }
+
 private:
     const unsigned char* m_buffer;
     int m_size, m_pos;
 };
 
+/* Read-only view of a whole file.  Uses mmap() where available, and falls
+ * back to reading the file into memory otherwise. */
+class PycMappedFile {
+public:
+    PycMappedFile(const char* filename);
+    ~PycMappedFile();
+
+    bool isOpen() const { return (m_data != 0); }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    PycMappedFile(const PycMappedFile&) = delete;
+    PycMappedFile& operator=(const PycMappedFile&) = delete;
+
+    const unsigned char* m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<unsigned char> m_buffer;
+};
+
 int formatted_print(std::ostream& stream, const char* format, ...);
 int formatted_printv(std::ostream& stream, const char* format, va_list args);
 
@@ -0,0 +1,12 @@
+#ifndef _PYC_DISASM_H
+#define _PYC_DISASM_H
+
+#include "pyc_module.h"
+#include <ostream>
+
+/* Recursively dump an object (and the disassembly of any code objects in
+ * it) in the pycdas output format.  flags are Pyc::DisassemblyFlags. */
+void output_object(PycRef<PycObject> obj, PycModule* mod, int indent,
+                   unsigned flags, std::ostream& pyc_output);
+
+#endif
@@ -0,0 +1,1734 @@
+#include "driver.h"
+#include "ASTree.h"
+#include "allocstats.h"
+#include "bytecode.h"
+#include "BoundedQueue.h"
+#include "contenthash.h"
+#include "outpack.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+
+#ifdef WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+void print_header(std::ostream& pyc_output, const char* dispname, PycModule& mod)
+{
+    pyc_output << "# Source Generated with AHMADxGEORGE Pycdc\n";
+    formatted_print(pyc_output, "# File: %s (Python %d.%d%s)\n\n", dispname,
+                    mod.majorVer(), mod.minorVer(),
+                    (mod.majorVer() < 3 && mod.isUnicode()) ? " Unicode" : "");
+}
+
+static uint64_t hash_bytes(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool is_pyc(const std::string& name)
+{
+    return name.size() > 4 && name.compare(name.size() - 4, 4, ".pyc") == 0;
+}
+
+static std::string join_path(const std::string& dir, const std::string& name)
+{
+    if (dir.empty())
+        return name;
+    if (name.empty())
+        return dir;
+    return dir + '/' + name;
+}
+
+static const char* base_name(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+/* foo/bar.pyc -> <outdir>/foo/bar.py */
+static std::string output_path(const std::string& outdir, const std::string& relpath)
+{
+    std::string name = relpath;
+    if (is_pyc(name))
+        name.erase(name.size() - 1);
+    else
+        name += ".py";
+    return join_path(outdir, name);
+}
+
+/* Create every missing directory leading up to path */
+static void make_parent_dirs(const std::string& path)
+{
+    for (size_t slash = path.find_first_of("/\\", 1); slash != std::string::npos;
+            slash = path.find_first_of("/\\", slash + 1)) {
+#ifdef WIN32
+        _mkdir(path.substr(0, slash).c_str());
+#else
+        mkdir(path.substr(0, slash).c_str(), 0777);
+#endif
+    }
+}
+
+/* Write a file through a temporary, so readers never see a partial file */
+static bool write_file(const std::string& path, const std::string& text)
+{
+    std::string temppath = path + ".tmp";
+    make_parent_dirs(path);
+    FILE* out = fopen(temppath.c_str(), "wb");
+    bool ok = out && fwrite(text.data(), 1, text.size(), out) == text.size();
+    if (out && fclose(out) != 0)
+        ok = false;
+#ifdef WIN32
+    if (ok)
+        remove(path.c_str());
+#endif
+    if (!ok || rename(temppath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error writing file '%s'\n", path.c_str());
+        remove(temppath.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* Read a whole file, hinting the kernel to read ahead */
+static bool read_file(const std::string& path, std::vector<unsigned char>& data)
+{
+#ifdef WIN32
+    int fd = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+#endif
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size > INT_MAX) {
+#ifdef WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+        return false;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    data.resize((size_t)info.st_size);
+    size_t done = 0;
+    while (done < data.size()) {
+#ifdef WIN32
+        int count = _read(fd, &data[done], (unsigned)(data.size() - done));
+#else
+        ssize_t count = read(fd, &data[done], data.size() - done);
+#endif
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            break;
+        done += (size_t)count;
+    }
+    data.resize(done);
+#ifdef WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+    return true;
+}
+
+struct InputFile {
+    std::string path, relpath;
+    size_t size;
+    long long mtime;
+};
+
+/* Expand an input argument to the .pyc files below it, if it is a directory */
+static void collect_inputs(const std::string& path, const std::string& relpath,
+                           std::vector<InputFile>& inputs)
+{
+#ifndef WIN32
+    DIR* dir = opendir(path.c_str());
+    if (dir) {
+        std::vector<std::string> names;
+        while (struct dirent* ent = readdir(dir)) {
+            if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+                names.push_back(ent->d_name);
+        }
+        closedir(dir);
+        std::sort(names.begin(), names.end());
+        for (const auto& name : names) {
+            std::string child = join_path(path, name);
+            struct stat info;
+            if (stat(child.c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode) || is_pyc(name))
+                collect_inputs(child, join_path(relpath, name), inputs);
+        }
+        return;
+    }
+#endif
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        memset(&info, 0, sizeof(info));
+    inputs.push_back({ path, relpath.empty() ? base_name(path) : relpath,
+                       (size_t)info.st_size, (long long)info.st_mtime });
+}
+
+#ifdef WIN32
+
+int watch_tree(const char*, const char*)
+{
+    fputs("Watch mode is not supported on this platform\n", stderr);
+    return 1;
+}
+
+#else
+
+class TreeWatcher {
+public:
+    TreeWatcher(const char* indir, const char* outdir)
+        : m_indir(indir), m_outdir(outdir) { }
+
+    int run();
+
+private:
+    struct FileState {
+        FileState() : hash(), size(), mtime() { }
+
+        uint64_t hash;
+        off_t size;
+        time_t mtime;
+        DecompyleCache cache;
+    };
+
+    /* Process every .pyc file below reldir.  With seen, unchanged files are
+     * recognized by their size and modification time instead of by reading
+     * them, and the files found are added to seen. */
+    void scan(const std::string& reldir, std::set<std::string>* seen);
+    void update(const std::string& relpath, const struct stat* info);
+    void remove(const std::string& relpath);
+
+#ifdef __linux__
+    int m_inotify;
+    std::map<int, std::string> m_watches;
+#endif
+    std::string m_indir, m_outdir;
+    std::map<std::string, FileState> m_files;
+};
+
+void TreeWatcher::scan(const std::string& reldir, std::set<std::string>* seen)
+{
+    std::string dirpath = join_path(m_indir, reldir);
+    DIR* dir = opendir(dirpath.c_str());
+    if (!dir)
+        return;
+
+#ifdef __linux__
+    if (!seen) {
+        int wd = inotify_add_watch(m_inotify, dirpath.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM
+                                   | IN_CREATE | IN_DELETE | IN_ONLYDIR);
+        if (wd < 0)
+            fprintf(stderr, "Cannot watch directory %s\n", dirpath.c_str());
+        else
+            m_watches[wd] = reldir;
+    }
+#endif
+
+    std::vector<std::string> names;
+    while (struct dirent* ent = readdir(dir)) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+            names.push_back(ent->d_name);
+    }
+    closedir(dir);
+
+    for (const auto& name : names) {
+        std::string relpath = join_path(reldir, name);
+        struct stat info;
+        if (stat(join_path(m_indir, relpath).c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode)) {
+            scan(relpath, seen);
+        } else if (S_ISREG(info.st_mode) && is_pyc(name)) {
+            if (seen)
+                seen->insert(relpath);
+            update(relpath, seen ? &info : nullptr);
+        }
+    }
+}
+
+void TreeWatcher::update(const std::string& relpath, const struct stat* info)
+{
+    // The state is only brought up to date once the output is written, so
+    // a file that fails is tried again on its next event or scan
+    FileState& state = m_files[relpath];
+    if (info && state.size == info->st_size && state.mtime == info->st_mtime)
+        return;
+
+    std::string inpath = join_path(m_indir, relpath);
+    PycMappedFile file(inpath.c_str());
+    if (!file.isOpen() || file.size() > INT_MAX)
+        return;
+    // Recompiling unchanged source only changes the header
+    uint64_t hash;
+    try {
+        PycBuffer in(file.data(), (int)file.size());
+        hash = pyc_content_hash(&in, 0);
+    } catch (std::exception&) {
+        hash = hash_bytes(file.data(), file.size());
+    }
+    if (hash == state.hash) {
+        if (info) {
+            state.size = info->st_size;
+            state.mtime = info->st_mtime;
+        }
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::ostringstream pyc_output;
+    try {
+        PycModule mod;
+        mod.loadFromBuffer(file.data(), (int)file.size());
+        if (!mod.isValid()) {
+            fprintf(stderr, "Could not load file %s\n", inpath.c_str());
+            return;
+        }
+        print_header(pyc_output, base_name(relpath), mod);
+        decompyle(mod.code(), &mod, pyc_output, &state.cache);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error decompyling %s: %s\n", inpath.c_str(), ex.what());
+        return;
+    }
+
+    std::string outpath = output_path(m_outdir, relpath);
+    if (!write_file(outpath, pyc_output.str()))
+        return;
+    state.hash = hash;
+    if (info) {
+        state.size = info->st_size;
+        state.mtime = info->st_mtime;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Updated %s (%d code objects reused, %d decompiled, %.1f ms)\n",
+            outpath.c_str(), state.cache.hits(), state.cache.misses(), ms);
+}
+
+void TreeWatcher::remove(const std::string& relpath)
+{
+    // relpath may also be a directory, taking all files below it along
+    std::string prefix = relpath + '/';
+    for (auto iter = m_files.begin(); iter != m_files.end(); ) {
+        if (iter->first == relpath || iter->first.compare(0, prefix.size(), prefix) == 0) {
+            std::string outpath = output_path(m_outdir, iter->first);
+            if (unlink(outpath.c_str()) == 0)
+                fprintf(stderr, "Removed %s\n", outpath.c_str());
+            iter = m_files.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+#ifdef __linux__
+
+int TreeWatcher::run()
+{
+    m_inotify = inotify_init1(IN_CLOEXEC);
+    if (m_inotify < 0) {
+        perror("inotify_init1");
+        return 1;
+    }
+    scan(std::string(), nullptr);
+    fprintf(stderr, "Watching %s for changes\n", m_indir.c_str());
+
+    alignas(struct inotify_event) char buffer[65536];
+    for (;;) {
+        // Collect events until the tree has been quiet for a moment, so a
+        // rebuild touching many files is handled as one batch
+        std::set<std::string> changed, removed, created;
+        bool overflow = false;
+        int timeout = -1;
+        for (;;) {
+            struct pollfd pfd = { m_inotify, POLLIN, 0 };
+            int ready = poll(&pfd, 1, timeout);
+            if (ready < 0 && errno != EINTR) {
+                perror("poll");
+                return 1;
+            }
+            if (ready <= 0)
+                break;
+            ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+            timeout = 50;
+
+            for (char* ptr = buffer; ptr < buffer + length; ) {
+                const struct inotify_event* event =
+                        reinterpret_cast<const struct inotify_event*>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                auto watch = m_watches.find(event->wd);
+                if (watch == m_watches.end())
+                    continue;
+                if (event->mask & IN_IGNORED) {
+                    m_watches.erase(watch);
+                    continue;
+                }
+                if (event->len == 0)
+                    continue;
+
+                std::string relpath = join_path(watch->second, event->name);
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    removed.insert(relpath);
+                    changed.erase(relpath);
+                    created.erase(relpath);
+                } else if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        created.insert(relpath);
+                    removed.erase(relpath);
+                } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    if (is_pyc(relpath))
+                        changed.insert(relpath);
+                    removed.erase(relpath);
+                }
+            }
+        }
+
+        for (const auto& relpath : removed)
+            remove(relpath);
+        if (overflow) {
+            // Events were lost; the content hashes sort out what changed
+            scan(std::string(), nullptr);
+            continue;
+        }
+        for (const auto& reldir : created)
+            scan(reldir, nullptr);
+        for (const auto& relpath : changed)
+            update(relpath, nullptr);
+    }
+}
+
+#else
+
+int TreeWatcher::run()
+{
+    // No change notification available, so poll the tree every second
+    fprintf(stderr, "Watching %s for changes\n", m_indir.c_str());
+    for (;;) {
+        std::set<std::string> seen;
+        scan(std::string(), &seen);
+
+        std::vector<std::string> gone;
+        for (const auto& file : m_files) {
+            if (seen.find(file.first) == seen.end())
+                gone.push_back(file.first);
+        }
+        for (const auto& relpath : gone)
+            remove(relpath);
+        sleep(1);
+    }
+}
+
+#endif
+
+int watch_tree(const char* indir, const char* outdir)
+{
+    struct stat info;
+    if (stat(indir, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        fprintf(stderr, "%s is not a directory\n", indir);
+        return 1;
+    }
+    TreeWatcher watcher(indir, outdir);
+    return watcher.run();
+}
+
+#endif
+
+/* == Batch pipeline ==
+   Files flow through four stages, each run by its own group of threads:
+
+   read        Read the whole file (I/O bound, so several threads keep
+               multiple requests in flight on high-latency file systems)
+   load        Unmarshal the module
+   decompile   One thread per core
+   write       Write the output file, or print to stdout in input order
+
+   Stages are connected by bounded queues, so a slow stage holds back the
+   ones feeding it instead of letting finished items pile up in memory.
+
+   Files enter the pipeline largest first, so the few giant modules of a
+   corpus do not start last and leave all but one core idle at the end.
+   Modules with a lot of bytecode are additionally split up: their functions,
+   classes and methods are decompiled ahead of time on several threads into
+   a DecompyleCache, and the module itself is then assembled from the cache. */
+
+/* Modules with more bytecode than this are split over several threads */
+static const size_t SPLIT_CODE_SIZE = 64 * 1024;
+
+enum BatchStatus { STATUS_OK, STATUS_INCOMPLETE, STATUS_ERROR, STATUS_TIMEOUT };
+
+static const char* status_names[] = { "ok", "incomplete", "error", "timeout" };
+
+struct BatchItem {
+    BatchItem()
+        : index(), size(), mtime(), codeSize(), inputHash(), outputHash(),
+          decompileNs(), status(STATUS_OK) { }
+
+    bool failed() const { return status == STATUS_ERROR || status == STATUS_TIMEOUT; }
+
+    size_t index;
+    std::string inpath, relpath;
+    size_t size;
+    long long mtime;
+    size_t codeSize;
+    uint64_t inputHash;
+    uint64_t outputHash;    // 0 without output
+    uint64_t decompileNs;
+    std::vector<unsigned char> data;
+    std::unique_ptr<PycModule> mod;
+    std::string output;
+    BatchStatus status;
+    std::string error;
+    std::string failures;   // JSON array, empty without any
+    std::unique_ptr<AllocStats> alloc;  // With --alloc-stats
+};
+
+typedef BoundedQueue<BatchItem*> BatchQueue;
+
+struct BatchStage {
+    BatchStage(const char* name, int threads, BatchQueue* input, BatchQueue* output)
+        : name(name), threads(threads), input(input), output(output),
+          active(threads), items(), busyNs(), starvedNs(), blockedNs() { }
+
+    const char* name;
+    int threads;
+    BatchQueue* input;
+    BatchQueue* output;     // NULL for the last stage
+    std::atomic<int> active;
+
+    // Time spent working, waiting for input and waiting for room downstream
+    std::atomic<uint64_t> items, busyNs, starvedNs, blockedNs;
+};
+
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point& since)
+{
+    auto now = std::chrono::steady_clock::now();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - since).count();
+    since = now;
+    return ns;
+}
+
+template <typename Work>
+static void run_stage(BatchStage& stage, Work work)
+{
+    auto clock = std::chrono::steady_clock::now();
+    BatchItem* item;
+    for (;;) {
+        bool got = stage.input->pop(item);
+        stage.starvedNs += elapsed_ns(clock);
+        if (!got)
+            break;
+        {
+            AllocScope scope(item->alloc.get());
+            work(item);
+        }
+        stage.busyNs += elapsed_ns(clock);
+        ++stage.items;
+        if (stage.output) {
+            stage.output->push(item);
+            stage.blockedNs += elapsed_ns(clock);
+        }
+    }
+    if (--stage.active == 0 && stage.output)
+        stage.output->close();
+}
+
+/* Total bytecode size of a code object and everything nested in it */
+static size_t code_size(PycRef<PycCode> code)
+{
+    size_t size = (size_t)code->code()->length();
+    for (int i = 0; i < code->consts()->size(); ++i) {
+        PycRef<PycObject> obj = code->consts()->get(i);
+        if (obj.type() == PycObject::TYPE_CODE || obj.type() == PycObject::TYPE_CODE2)
+            size += code_size(obj.cast<PycCode>());
+    }
+    return size;
+}
+
+struct SplitTask {
+    std::vector<int> path;      // Indices into the consts of each parent
+    int indent;
+    bool classBody;
+    size_t size;
+};
+
+/* Functions and classes defined at the top level of code, and the members
+ * of those classes, grouped by nesting depth */
+static void collect_split_tasks(PycRef<PycCode> code, std::vector<int>& path, int indent,
+                                size_t depth, std::vector<std::vector<SplitTask>>& levels)
+{
+    for (int i = 0; i < code->consts()->size(); ++i) {
+        PycRef<PycObject> obj = code->consts()->get(i);
+        if (obj.type() != PycObject::TYPE_CODE && obj.type() != PycObject::TYPE_CODE2)
+            continue;
+        PycRef<PycCode> child = obj.cast<PycCode>();
+        if (child->name()->value()[0] == '<')
+            continue;   // Lambdas and comprehensions are printed inline
+
+        bool classBody = (child->flags() & PycCode::CO_NEWLOCALS) == 0;
+        path.push_back(i);
+        if (levels.size() <= depth)
+            levels.resize(depth + 1);
+        levels[depth].push_back({ path, indent, classBody, code_size(child) });
+        if (classBody)
+            collect_split_tasks(child, path, indent + 1, depth + 1, levels);
+        path.pop_back();
+    }
+}
+
+static PycRef<PycCode> code_at(PycRef<PycCode> code, const std::vector<int>& path)
+{
+    for (int index : path)
+        code = code->consts()->get(index).cast<PycCode>();
+    return code;
+}
+
+/* Helper threads for split modules, shared by all decompile threads, so
+ * that giant modules decompiled side by side don't each start a full set;
+ * every helper also holds a copy of its module */
+class SplitBudget {
+public:
+    explicit SplitBudget(int threads) : m_free(threads) { }
+
+    /* Takes up to wanted threads, returning how many were taken */
+    int take(int wanted)
+    {
+        int free = m_free.load();
+        int taken;
+        do {
+            taken = std::max(0, std::min(wanted, free));
+        } while (taken > 0 && !m_free.compare_exchange_weak(free, free - taken));
+        return taken;
+    }
+
+    void give(int threads) { m_free += threads; }
+
+private:
+    std::atomic<int> m_free;
+};
+
+/* Holds the threads of a split module at the end of each nesting level
+ * until all of them are done with it.  A thread that gives up leaves. */
+class SplitLevelBarrier {
+public:
+    explicit SplitLevelBarrier(int threads) : m_threads(threads), m_waiting(), m_level() { }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        size_t level = m_level;
+        if (++m_waiting == m_threads)
+            advance();
+        else
+            m_cond.wait(lock, [&]() { return m_level != level; });
+    }
+
+    void leave()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_threads > 0 && m_waiting == m_threads)
+            advance();
+    }
+
+private:
+    void advance()
+    {
+        m_waiting = 0;
+        ++m_level;
+        m_cond.notify_all();
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    int m_threads, m_waiting;
+    size_t m_level;
+};
+
+/* Fill cache with the output of the functions and classes of mod, using
+ * helper threads taken from budget.  Objects are not shared between threads
+ * (their reference counts are not atomic), so every helper thread loads its
+ * own copy of the module from data, once.  Members of a class are done
+ * before the class, so that the class body finds them in the cache. */
+static void predecompyle_split(const std::vector<unsigned char>& data, PycModule& mod,
+                               SplitBudget& budget, double timeout, DecompyleCache& cache)
+{
+    std::vector<std::vector<SplitTask>> levels;
+    std::vector<int> path;
+    collect_split_tasks(mod.code(), path, 0, 0, levels);
+
+    size_t widest = 0;
+    for (auto& tasks : levels) {
+        std::stable_sort(tasks.begin(), tasks.end(),
+                         [](const SplitTask& a, const SplitTask& b) { return a.size > b.size; });
+        widest = std::max(widest, tasks.size());
+    }
+    std::unique_ptr<std::atomic<size_t>[]> next(new std::atomic<size_t>[levels.size()]);
+    for (size_t depth = 0; depth < levels.size(); ++depth)
+        next[depth] = 0;
+
+    // Once the timeout has passed on any thread, no more work is started;
+    // the decompyle() of the whole module then reports it.  Helpers share
+    // the deadline of the calling thread rather than starting their own.
+    std::atomic<bool> expired(false);
+    auto deadline = std::chrono::steady_clock::now()
+                  + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(timeout));
+
+    int count = widest > 1 ? budget.take((int)std::min(widest - 1, (size_t)INT_MAX)) : 0;
+    SplitLevelBarrier barrier(count + 1);
+    auto work = [&](PycModule* own) {
+        for (size_t depth = levels.size(); depth-- > 0; ) {
+            const std::vector<SplitTask>& tasks = levels[depth];
+            for (size_t index = next[depth]++; index < tasks.size() && !expired;
+                    index = next[depth]++) {
+                const SplitTask& task = tasks[index];
+                try {
+                    predecompyle(code_at(own->code(), task.path), own, task.indent,
+                                 task.classBody, &cache);
+                } catch (DecompyleTimeout&) {
+                    expired = true;
+                }
+            }
+            barrier.wait();
+        }
+    };
+
+    AllocStats* alloc = current_alloc_stats();
+    auto helper = [&]() {
+        AllocScope scope(alloc);
+        PycModule copy;
+        if (timeout > 0) {
+            double left = std::chrono::duration<double>(
+                              deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0 || expired) {
+                expired = true;
+                barrier.leave();
+                return;
+            }
+            decompyle_set_timeout(left);
+            // Loading doesn't check the timeout, so give up on the
+            // copy between its code objects
+            copy.setCodeHandler([&](PycRef<PycCode>) {
+                if (expired || std::chrono::steady_clock::now() >= deadline)
+                    throw DecompyleTimeout();
+            });
+        }
+        try {
+            copy.loadFromBuffer(data.data(), (int)data.size());
+        } catch (DecompyleTimeout&) {
+            expired = true;
+            barrier.leave();
+            return;
+        } catch (std::exception&) {
+            barrier.leave();
+            return;
+        }
+        work(&copy);
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 0; i < count; ++i)
+        helpers.emplace_back(helper);
+    work(&mod);
+    for (auto& thread : helpers)
+        thread.join();
+    budget.give(count);
+}
+
+static void print_stage_stats(const std::vector<BatchStage*>& stages)
+{
+    fputs("Stage       Threads     Items    Busy s  Starved s  Blocked s\n", stderr);
+    for (const BatchStage* stage : stages) {
+        fprintf(stderr, "%-10s  %7d  %8llu  %8.3f  %9.3f  %9.3f\n", stage->name,
+                stage->threads, (unsigned long long)stage->items.load(),
+                stage->busyNs / 1e9, stage->starvedNs / 1e9, stage->blockedNs / 1e9);
+    }
+}
+
+static void print_file_stats(const std::vector<std::unique_ptr<BatchItem>>& items,
+                             double seconds)
+{
+    std::vector<const BatchItem*> sorted;
+    for (const auto& item : items)
+        sorted.push_back(item.get());
+    std::sort(sorted.begin(), sorted.end(), [](const BatchItem* a, const BatchItem* b) {
+        return a->decompileNs < b->decompileNs;
+    });
+    auto percentile = [&](double p) {
+        size_t rank = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[rank]->decompileNs / 1e6;
+    };
+    fprintf(stderr, "Decompile time per file (ms): p50 %.2f  p90 %.2f  p99 %.2f  max %.2f (%s)\n",
+            percentile(50), percentile(90), percentile(99), percentile(100),
+            sorted.back()->relpath.c_str());
+    fprintf(stderr, "%zu files in %.3f s (%.1f files/s)\n", items.size(), seconds,
+            seconds > 0 ? items.size() / seconds : 0.0);
+}
+
+static void print_alloc_type_stats(int subsystem)
+{
+    const AllocTypeStats& stats = alloc_type_stats(subsystem);
+    std::vector<int> types;
+    for (int type = 0; type < AllocTypeStats::MAX_TYPES; ++type) {
+        if (stats.count[type])
+            types.push_back(type);
+    }
+    std::sort(types.begin(), types.end(), [&](int a, int b) {
+        return stats.bytes[a] > stats.bytes[b];
+    });
+    if (types.size() > 10)
+        types.resize(10);
+    for (int type : types) {
+        fprintf(stderr, "  %-7s %-20s %12llu  %12.2f\n", alloc_subsystem_name(subsystem),
+                alloc_type_name(subsystem, type), (unsigned long long)stats.count[type].load(),
+                stats.bytes[type] / 1048576.0);
+    }
+}
+
+/* Per subsystem: allocations over all files, the highest peak of any file,
+ * and what files still held when they were finished */
+static void print_alloc_stats(const std::vector<std::unique_ptr<BatchItem>>& items)
+{
+    fputs("Memory       Allocations  Max peak MiB  Live at end MiB\n", stderr);
+    const BatchItem* largest = nullptr;
+    for (int subsystem = 0; subsystem <= ALLOC_SUBSYSTEMS; ++subsystem) {
+        uint64_t count = 0;
+        int64_t peak = 0, live = 0;
+        for (const auto& item : items) {
+            if (!item->alloc)
+                continue;
+            const AllocCounter& counter = (subsystem == ALLOC_SUBSYSTEMS)
+                                        ? item->alloc->total()
+                                        : item->alloc->subsystem(subsystem);
+            count += counter.count;
+            peak = std::max(peak, counter.peak.load());
+            live += counter.live;
+            if (subsystem == ALLOC_SUBSYSTEMS
+                    && (!largest || counter.peak > largest->alloc->total().peak))
+                largest = item.get();
+        }
+        fprintf(stderr, "%-10s  %12llu  %12.2f  %15.2f\n",
+                subsystem == ALLOC_SUBSYSTEMS ? "total" : alloc_subsystem_name(subsystem),
+                (unsigned long long)count, peak / 1048576.0, live / 1048576.0);
+    }
+    if (largest) {
+        fprintf(stderr, "Largest peak: %.2f MiB (%s)\n",
+                largest->alloc->total().peak / 1048576.0, largest->relpath.c_str());
+    }
+    fputs("Allocated by type              Count           MiB\n", stderr);
+    print_alloc_type_stats(ALLOC_OBJECT);
+    print_alloc_type_stats(ALLOC_AST);
+}
+
+/* == Manifest ==
+   One JSON object per line, appended as each file is finished:
+
+   {"file": "lib/foo.pyc", "status": "ok", "size": 1234, "mtime": 1700000000,
+    "input_hash": "...", "output_hash": "...", "decompile_ms": 1.25}
+
+   "status" is one of ok, incomplete, error or timeout; failures also have
+   an "error" message.  Hashes are 64-bit FNV-1a in hex.  Files that
+   could not be fully decompiled have "failures", listing the code object
+   ("code", "line"), instruction ("offset", "opcode") and "reason" of each
+   construct that was given up on.  With
+   --alloc-stats, "alloc" holds the peak bytes of the file, and the live
+   bytes (when it was finished), peak bytes and allocations of each
+   subsystem.  When the manifest is read back to resume a job, the last
+   record of each file wins. */
+
+struct ManifestRecord {
+    std::string status;
+    long long size, mtime;
+};
+
+static std::string json_string(const std::string& str)
+{
+    std::string result = "\"";
+    for (unsigned char ch : str) {
+        if (ch == '"' || ch == '\\') {
+            result += '\\';
+            result += (char)ch;
+        } else if (ch < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", ch);
+            result += escape;
+        } else {
+            result += (char)ch;
+        }
+    }
+    return result + '"';
+}
+
+/* Find "key": in a manifest line and return the position of its value */
+static size_t json_find(const std::string& line, const char* key)
+{
+    std::string pattern = std::string("\"") + key + "\":";
+    size_t pos = line.find(pattern);
+    if (pos == std::string::npos)
+        return pos;
+    pos += pattern.size();
+    while (pos < line.size() && line[pos] == ' ')
+        ++pos;
+    return pos;
+}
+
+static bool json_get_string(const std::string& line, const char* key, std::string& value)
+{
+    size_t pos = json_find(line, key);
+    if (pos == std::string::npos || pos >= line.size() || line[pos] != '"')
+        return false;
+    value.clear();
+    for (++pos; pos < line.size() && line[pos] != '"'; ++pos) {
+        if (line[pos] == '\\' && pos + 1 < line.size()) {
+            ++pos;
+            if (line[pos] == 'u' && pos + 4 < line.size()) {
+                value += (char)strtol(line.substr(pos + 1, 4).c_str(), nullptr, 16);
+                pos += 4;
+                continue;
+            }
+        }
+        value += line[pos];
+    }
+    return pos < line.size();
+}
+
+static bool json_get_number(const std::string& line, const char* key, long long& value)
+{
+    size_t pos = json_find(line, key);
+    if (pos == std::string::npos)
+        return false;
+    char* end;
+    value = strtoll(line.c_str() + pos, &end, 10);
+    return end != line.c_str() + pos;
+}
+
+static void read_manifest(const char* filename, std::map<std::string, ManifestRecord>& records)
+{
+    FILE* in = fopen(filename, "rb");
+    if (!in)
+        return;
+    std::string line;
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), in)) {
+        line += buffer;
+        if (line.back() != '\n' && !feof(in))
+            continue;
+
+        // A line cut short by a crash is simply ignored
+        std::string file;
+        ManifestRecord record;
+        if (line.find('}') != std::string::npos
+                && json_get_string(line, "file", file)
+                && json_get_string(line, "status", record.status)
+                && json_get_number(line, "size", record.size)
+                && json_get_number(line, "mtime", record.mtime))
+            records[file] = record;
+        line.clear();
+    }
+    fclose(in);
+}
+
+static std::string manifest_line(const BatchItem& item)
+{
+    std::ostringstream line;
+    char hash[20];
+    line << "{\"file\": " << json_string(item.inpath)
+         << ", \"status\": \"" << status_names[item.status] << "\""
+         << ", \"size\": " << item.size << ", \"mtime\": " << item.mtime;
+    if (item.inputHash) {
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)item.inputHash);
+        line << ", \"input_hash\": \"" << hash << "\"";
+    }
+    if (item.outputHash) {
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)item.outputHash);
+        line << ", \"output_hash\": \"" << hash << "\"";
+    }
+    formatted_print(line, ", \"decompile_ms\": %.3f", item.decompileNs / 1e6);
+    if (!item.error.empty())
+        line << ", \"error\": " << json_string(item.error);
+    if (!item.failures.empty())
+        line << ", \"failures\": " << item.failures;
+    if (item.alloc) {
+        line << ", \"alloc\": {\"peak\": " << item.alloc->total().peak;
+        for (int subsystem = 0; subsystem < ALLOC_SUBSYSTEMS; ++subsystem) {
+            const AllocCounter& counter = item.alloc->subsystem(subsystem);
+            line << ", \"" << alloc_subsystem_name(subsystem) << "\": {\"live\": "
+                 << counter.live << ", \"peak\": " << counter.peak
+                 << ", \"count\": " << counter.count << "}";
+        }
+        line << "}";
+    }
+    line << "}\n";
+    return line.str();
+}
+
+/* == Stages ==
+   The work done on each file, shared by the pipeline threads and the
+   isolated worker processes. */
+
+/* The input and output buffers of an item are charged to its own stats,
+ * since they may be released by a thread working on another item */
+static void release_data(BatchItem& item)
+{
+    if (item.alloc)
+        item.alloc->add(ALLOC_LOADER, -(int64_t)item.data.capacity());
+    std::vector<unsigned char>().swap(item.data);
+}
+
+static void release_output(BatchItem& item)
+{
+    if (item.alloc)
+        item.alloc->add(ALLOC_PRINTER, -(int64_t)item.output.capacity());
+    std::string().swap(item.output);
+}
+
+static void read_item(BatchItem& item)
+{
+    if (!read_file(item.inpath, item.data)) {
+        fprintf(stderr, "Error opening file %s\n", item.inpath.c_str());
+        item.status = STATUS_ERROR;
+        item.error = "Could not read file";
+    } else {
+        item.inputHash = hash_bytes(item.data.data(), item.data.size());
+    }
+    if (item.alloc)
+        item.alloc->add(ALLOC_LOADER, (int64_t)item.data.capacity());
+}
+
+/* With split set, the data of large modules is kept, for the threads helping
+ * with them to load their own copies */
+static void load_item(BatchItem& item, bool split)
+{
+    if (item.failed())
+        return;
+    try {
+        item.mod.reset(new PycModule);
+        item.mod->loadFromBuffer(item.data.data(), (int)item.data.size());
+        if (!item.mod->isValid())
+            throw std::runtime_error("Unsupported or invalid pyc file");
+        item.codeSize = code_size(item.mod->code());
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error loading file %s: %s\n", item.inpath.c_str(), ex.what());
+        item.mod.reset();
+        item.status = STATUS_ERROR;
+        item.error = ex.what();
+    }
+    if (item.failed() || !split || item.codeSize <= SPLIT_CODE_SIZE)
+        release_data(item);
+}
+
+static std::string failures_json(const std::vector<DecompyleFailure>& failures)
+{
+    std::ostringstream json;
+    json << "[";
+    for (const DecompyleFailure& failure : failures) {
+        json << (&failure == &failures.front() ? "" : ", ")
+             << "{\"code\": " << json_string(failure.code) << ", \"line\": " << failure.firstLine
+             << ", \"offset\": " << failure.offset << ", \"opcode\": ";
+        if (failure.opcode >= 0)
+            json << "\"" << Pyc::OpcodeName(failure.opcode) << "\"";
+        else
+            json << "null";
+        json << ", \"reason\": " << json_string(failure.reason) << "}";
+    }
+    json << "]";
+    return json.str();
+}
+
+/* Split modules take their helper threads from budget, if given */
+static void decompile_item(BatchItem& item, SplitBudget* budget, double timeout)
+{
+    if (item.failed())
+        return;
+    // Partial output is kept on errors, as for a single file
+    auto start = std::chrono::steady_clock::now();
+    std::basic_ostringstream<char, std::char_traits<char>,
+                             CountingAllocator<char, ALLOC_PRINTER>> pyc_output;
+    decompyle_set_timeout(timeout);
+    try {
+        bool complete;
+        print_header(pyc_output, base_name(item.relpath), *item.mod);
+        if (!item.data.empty() && budget) {
+            DecompyleCache cache;
+            predecompyle_split(item.data, *item.mod, *budget, timeout, cache);
+            release_data(item);
+            complete = decompyle(item.mod->code(), item.mod.get(), pyc_output, &cache);
+        } else {
+            complete = decompyle(item.mod->code(), item.mod.get(), pyc_output);
+        }
+        if (!complete)
+            item.status = STATUS_INCOMPLETE;
+    } catch (DecompyleTimeout& ex) {
+        fprintf(stderr, "Timeout decompyling %s\n", item.inpath.c_str());
+        item.status = STATUS_TIMEOUT;
+        item.error = ex.what();
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error decompyling %s: %s\n", item.inpath.c_str(), ex.what());
+        item.status = STATUS_ERROR;
+        item.error = ex.what();
+    }
+    decompyle_set_timeout(0);
+    if (!decompyle_failures().empty())
+        item.failures = failures_json(decompyle_failures());
+    {
+        auto output = pyc_output.str();
+        item.output.assign(output.data(), output.size());
+    }
+    if (item.alloc)
+        item.alloc->add(ALLOC_PRINTER, (int64_t)item.output.capacity());
+    if (!item.output.empty()) {
+        item.outputHash = hash_bytes(reinterpret_cast<const unsigned char*>(item.output.data()),
+                                     item.output.size());
+    }
+    item.mod.reset();
+    item.decompileNs = elapsed_ns(start);
+}
+
+static void write_item(BatchItem& item, const char* outdir)
+{
+    if (!item.output.empty()
+            && !write_file(output_path(outdir, item.relpath), item.output)
+            && !item.failed()) {
+        item.status = STATUS_ERROR;
+        item.error = "Could not write output";
+    }
+    release_output(item);
+}
+
+/* Counts failures, records finished items in the manifest and, with a
+ * pack, appends their output to it; otherwise, without an output directory,
+ * prints their output to stdout in input order */
+class BatchResults {
+public:
+    BatchResults(FILE* manifest, PackWriter* pack, bool toStdout)
+        : m_manifest(manifest), m_pack(pack), m_toStdout(toStdout), m_failures(),
+          m_nextIndex() { }
+
+    int failures() const { return m_failures; }
+
+    void finish(BatchItem* item)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_pack) {
+            // BatchStatus is numbered like PackStatus
+            try {
+                m_pack->add(output_path(std::string(), item->relpath), item->output,
+                            (uint32_t)item->status, item->outputHash);
+            } catch (std::exception& ex) {
+                fprintf(stderr, "Error writing %s to the pack: %s\n", item->inpath.c_str(),
+                        ex.what());
+                item->status = STATUS_ERROR;
+                item->error = "Could not write output";
+            }
+            release_output(*item);
+        }
+        if (item->failed())
+            ++m_failures;
+        if (m_manifest) {
+            // Flushed per record, so a crash loses at most the last line
+            std::string line = manifest_line(*item);
+            fwrite(line.data(), 1, line.size(), m_manifest);
+            fflush(m_manifest);
+        }
+        if (!m_toStdout)
+            return;
+        m_reorder[item->index] = item;
+        for (auto iter = m_reorder.begin();
+                iter != m_reorder.end() && iter->first == m_nextIndex;
+                iter = m_reorder.erase(iter), ++m_nextIndex) {
+            std::cout << iter->second->output;
+            release_output(*iter->second);
+        }
+    }
+
+private:
+    FILE* m_manifest;
+    PackWriter* m_pack;
+    bool m_toStdout;
+    std::mutex m_lock;
+    int m_failures;
+    std::map<size_t, BatchItem*> m_reorder;    // Items waiting for their turn on stdout
+    size_t m_nextIndex;
+};
+
+static void run_pipeline(const std::vector<BatchItem*>& order, int jobs, const char* outdir,
+                         double timeout, bool stats, BatchResults& results)
+{
+    size_t depth = (size_t)std::max(4, jobs * 2);
+    BatchQueue pending(order.size()), loadQueue(depth), decompileQueue(depth),
+               writeQueue(depth);
+    BatchStage readStage("read", std::min(8, std::max(2, jobs / 2)), &pending, &loadQueue);
+    BatchStage loadStage("load", std::max(1, jobs / 4), &loadQueue, &decompileQueue);
+    BatchStage decompileStage("decompile", jobs, &decompileQueue, &writeQueue);
+    BatchStage writeStage("write", outdir ? 2 : 1, &writeQueue, nullptr);
+    SplitBudget splitBudget(jobs - 1);
+
+    for (BatchItem* item : order)
+        pending.tryPush(item);
+    pending.close();
+
+    auto reader = [&]() {
+        run_stage(readStage, [&](BatchItem* item) { read_item(*item); });
+    };
+    auto loader = [&]() {
+        run_stage(loadStage, [&](BatchItem* item) { load_item(*item, jobs > 1); });
+    };
+    auto decompiler = [&]() {
+        run_stage(decompileStage, [&](BatchItem* item) {
+            decompile_item(*item, &splitBudget, timeout);
+        });
+    };
+    auto writer = [&]() {
+        run_stage(writeStage, [&](BatchItem* item) {
+            if (outdir)
+                write_item(*item, outdir);
+            results.finish(item);
+        });
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readStage.threads; ++i)
+        threads.emplace_back(reader);
+    for (int i = 0; i < loadStage.threads; ++i)
+        threads.emplace_back(loader);
+    for (int i = 0; i < decompileStage.threads; ++i)
+        threads.emplace_back(decompiler);
+    for (int i = 0; i < writeStage.threads; ++i)
+        threads.emplace_back(writer);
+    for (auto& thread : threads)
+        thread.join();
+
+    if (stats)
+        print_stage_stats({ &readStage, &loadStage, &decompileStage, &writeStage });
+}
+
+#ifndef WIN32
+
+/* == Isolated workers ==
+   With --isolate, files are decompiled by long-lived worker processes
+   instead of threads, so an input that crashes the decompiler, or hangs it
+   where the timeout is not checked (e.g. while unmarshalling), only costs
+   one worker.  The supervisor sends each worker the path of one file at a
+   time over a pipe; the worker reads, loads, decompiles and writes it, and
+   replies with the result.  A worker that dies, or overruns the timeout by
+   more than a second, is replaced, and its file is recorded as an error or
+   a timeout. */
+
+struct WorkerReply {
+    uint32_t status;
+    uint32_t errorSize;
+    uint32_t failuresSize;
+    uint64_t inputHash, outputHash, decompileNs;
+    uint64_t outputSize;        // Only without an output directory
+};
+
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const char* ptr = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t count = write(fd, ptr, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        ptr += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size)
+{
+    char* ptr = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t count = read(fd, ptr, size);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        ptr += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+static void append_string(std::string& message, const std::string& str)
+{
+    uint64_t size = str.size();
+    message.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    message += str;
+}
+
+static bool read_string(int fd, std::string& str)
+{
+    uint64_t size;
+    if (!read_all(fd, &size, sizeof(size)))
+        return false;
+    str.resize(size);
+    return size == 0 || read_all(fd, &str[0], size);
+}
+
+/* Body of a worker process; exits when the supervisor closes the pipe */
+static void worker_main(int request, int reply, const char* outdir, double timeout)
+{
+    for (;;) {
+        BatchItem item;
+        if (!read_string(request, item.inpath) || !read_string(request, item.relpath))
+            break;
+        read_item(item);
+        load_item(item, false);
+        decompile_item(item, nullptr, timeout);
+        if (outdir)
+            write_item(item, outdir);
+
+        WorkerReply header = {
+            (uint32_t)item.status, (uint32_t)item.error.size(),
+            (uint32_t)item.failures.size(), item.inputHash, item.outputHash,
+            item.decompileNs, item.output.size()
+        };
+        std::string message(reinterpret_cast<const char*>(&header), sizeof(header));
+        message += item.error;
+        message += item.failures;
+        message += item.output;
+        if (!write_all(reply, message.data(), message.size()))
+            break;
+    }
+    _exit(0);
+}
+
+/* Without --timeout, a worker busy with one file for this many seconds is
+ * taken to hang, and is killed and replaced */
+static const double WORKER_HANG_SECONDS = 300.0;
+
+class WorkerPool {
+public:
+    WorkerPool(int count, const char* outdir, double timeout, BatchResults& results)
+        : m_workers(count), m_outdir(outdir), m_timeout(timeout), m_results(results),
+          m_stage("worker", count, nullptr, nullptr), m_restarts() { }
+
+    ~WorkerPool()
+    {
+        for (Worker& worker : m_workers)
+            stop(worker, false);
+    }
+
+    /* Returns false if no worker could be started */
+    bool run(const std::vector<BatchItem*>& order);
+
+    void printStats()
+    {
+        print_stage_stats({ &m_stage });
+        fprintf(stderr, "%d workers replaced\n", m_restarts);
+    }
+
+private:
+    struct Worker {
+        Worker() : pid(-1), request(-1), reply(-1), item() { }
+
+        pid_t pid;
+        int request, reply;
+        BatchItem* item;        // NULL while idle
+        std::chrono::steady_clock::time_point started;
+        std::string buffer;     // Reply received so far
+    };
+
+    bool start(Worker& worker);
+    int stop(Worker& worker, bool kill);
+    bool receive(Worker& worker);
+    void finish(Worker& worker);
+    void lose(Worker& worker, BatchStatus status, const std::string& error);
+
+    std::vector<Worker> m_workers;
+    const char* m_outdir;
+    double m_timeout;
+    BatchResults& m_results;
+    BatchStage m_stage;
+    int m_restarts;
+};
+
+bool WorkerPool::start(Worker& worker)
+{
+    int request[2], reply[2];
+    if (pipe(request) != 0)
+        return false;
+    if (pipe(reply) != 0) {
+        close(request[0]);
+        close(request[1]);
+        return false;
+    }
+
+    // Buffered output would otherwise be written again by the child
+    std::cout.flush();
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(request[1]);
+        close(reply[0]);
+        for (const Worker& other : m_workers) {
+            if (other.pid > 0) {
+                close(other.request);
+                close(other.reply);
+            }
+        }
+        worker_main(request[0], reply[1], m_outdir, m_timeout);
+    }
+    close(request[0]);
+    close(reply[1]);
+    if (pid < 0) {
+        close(request[1]);
+        close(reply[0]);
+        return false;
+    }
+    worker.pid = pid;
+    worker.request = request[1];
+    worker.reply = reply[0];
+    return true;
+}
+
+/* Returns the wait status of the worker */
+int WorkerPool::stop(Worker& worker, bool kill)
+{
+    int status = 0;
+    if (worker.pid < 0)
+        return status;
+    close(worker.request);
+    close(worker.reply);
+    if (kill)
+        ::kill(worker.pid, SIGKILL);
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    worker.pid = -1;
+    worker.request = worker.reply = -1;
+    worker.buffer.clear();
+    return status;
+}
+
+/* Read what the worker has sent so far; returns false if it died */
+bool WorkerPool::receive(Worker& worker)
+{
+    char buffer[65536];
+    ssize_t count = read(worker.reply, buffer, sizeof(buffer));
+    if (count < 0)
+        return errno == EINTR || errno == EAGAIN;
+    if (count == 0)
+        return false;
+    worker.buffer.append(buffer, (size_t)count);
+
+    WorkerReply header;
+    if (worker.buffer.size() < sizeof(header))
+        return true;
+    memcpy(&header, worker.buffer.data(), sizeof(header));
+    if (worker.buffer.size() < sizeof(header) + header.errorSize + header.failuresSize
+                                  + header.outputSize)
+        return true;
+
+    BatchItem* item = worker.item;
+    item->status = (BatchStatus)header.status;
+    item->inputHash = header.inputHash;
+    item->outputHash = header.outputHash;
+    item->decompileNs = header.decompileNs;
+    item->error = worker.buffer.substr(sizeof(header), header.errorSize);
+    item->failures = worker.buffer.substr(sizeof(header) + header.errorSize,
+                                          header.failuresSize);
+    item->output = worker.buffer.substr(sizeof(header) + header.errorSize
+                                        + header.failuresSize);
+    worker.buffer.clear();
+    finish(worker);
+    return true;
+}
+
+void WorkerPool::finish(Worker& worker)
+{
+    auto started = worker.started;
+    m_stage.busyNs += elapsed_ns(started);
+    ++m_stage.items;
+    m_results.finish(worker.item);
+    worker.item = nullptr;
+}
+
+/* Replace a worker that crashed or hung, failing the file it was working on */
+void WorkerPool::lose(Worker& worker, BatchStatus status, const std::string& error)
+{
+    fprintf(stderr, "%s on %s\n", error.c_str(), worker.item->inpath.c_str());
+    stop(worker, true);
+    ++m_restarts;
+    worker.item->status = status;
+    worker.item->error = error;
+    worker.item->output.clear();
+    worker.item->decompileNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - worker.started).count();
+    finish(worker);
+}
+
+bool WorkerPool::run(const std::vector<BatchItem*>& order)
+{
+    // A dead worker is noticed by the pipe, not by a signal
+    void (*oldHandler)(int) = signal(SIGPIPE, SIG_IGN);
+    // Workers give up on their own after the timeout; the kill is for those
+    // stuck where the timeout isn't checked
+    auto limit = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                     std::chrono::duration<double>(m_timeout > 0 ? m_timeout + 1.0
+                                                                 : WORKER_HANG_SECONDS));
+    size_t next = 0;
+    bool ok = true;
+
+    auto dispatch = [&](Worker& worker) {
+        while (next < order.size()) {
+            if (worker.pid < 0 && !start(worker)) {
+                fprintf(stderr, "Error starting worker process: %s\n", strerror(errno));
+                return false;
+            }
+            std::string message;
+            append_string(message, order[next]->inpath);
+            append_string(message, order[next]->relpath);
+            worker.item = order[next++];
+            worker.started = std::chrono::steady_clock::now();
+            if (write_all(worker.request, message.data(), message.size()))
+                return true;
+            lose(worker, STATUS_ERROR, "Worker exited");
+        }
+        return true;
+    };
+
+    for (Worker& worker : m_workers)
+        ok = ok && dispatch(worker);
+
+    std::vector<struct pollfd> fds;
+    std::vector<Worker*> polled;
+    while (ok) {
+        fds.clear();
+        polled.clear();
+        auto now = std::chrono::steady_clock::now();
+        int wait = -1;
+        for (Worker& worker : m_workers) {
+            if (!worker.item)
+                continue;
+            fds.push_back({ worker.reply, POLLIN, 0 });
+            polled.push_back(&worker);
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            worker.started + limit - now).count();
+            left = std::max(left + 1, (decltype(left))0);
+            if (wait < 0 || left < wait)
+                wait = (int)std::min(left, (decltype(left))INT_MAX);
+        }
+        if (polled.empty())
+            break;
+
+        if (poll(fds.data(), fds.size(), wait) < 0 && errno != EINTR) {
+            fprintf(stderr, "Error waiting for workers: %s\n", strerror(errno));
+            ok = false;
+            break;
+        }
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < polled.size(); ++i) {
+            Worker& worker = *polled[i];
+            if (fds[i].revents && !receive(worker)) {
+                int status = stop(worker, true);
+                char error[64];
+                if (WIFSIGNALED(status))
+                    snprintf(error, sizeof(error), "Worker crashed (signal %d)", WTERMSIG(status));
+                else
+                    snprintf(error, sizeof(error), "Worker exited with status %d",
+                             WEXITSTATUS(status));
+                lose(worker, STATUS_ERROR, error);
+            } else if (worker.item && now - worker.started > limit) {
+                lose(worker, STATUS_TIMEOUT, "Timed out, worker killed");
+            }
+            if (!worker.item)
+                ok = ok && dispatch(worker);
+        }
+    }
+
+    for (Worker& worker : m_workers)
+        stop(worker, false);
+    signal(SIGPIPE, oldHandler);
+    return ok;
+}
+
+#endif
+
+int batch_decompile(const std::vector<const char*>& inputs, const char* outdir,
+                    const BatchOptions& options)
+{
+#ifdef WIN32
+    if (options.isolate) {
+        fputs("Option '--isolate' is not supported on this platform\n", stderr);
+        return 1;
+    }
+#endif
+    // Workers are separate processes, whose memory is not seen here
+    if (options.allocStats && options.isolate)
+        fputs("Option '--alloc-stats' is ignored with '--isolate'\n", stderr);
+    else if (options.allocStats)
+        set_alloc_stats_enabled(true);
+
+    std::vector<InputFile> files;
+    for (const char* input : inputs)
+        collect_inputs(input, std::string(), files);
+    if (files.empty()) {
+        fputs("No input files found\n", stderr);
+        return 1;
+    }
+
+    // Outputs already in the pack are kept, and replaced when decompiled again
+    std::unique_ptr<PackWriter> pack;
+    if (options.pack) {
+        pack.reset(new PackWriter);
+        try {
+            pack->open(options.pack);
+        } catch (std::exception& ex) {
+            fprintf(stderr, "Error opening pack '%s': %s\n", options.pack, ex.what());
+            return 1;
+        }
+    }
+
+    // Resume: skip files finished by a previous run and unchanged since.
+    // Timeouts are retried, as they may depend on the load of the machine.
+    std::map<std::string, ManifestRecord> done;
+    if (options.manifest)
+        read_manifest(options.manifest, done);
+
+    std::vector<std::unique_ptr<BatchItem>> items;
+    size_t skipped = 0;
+    for (const auto& file : files) {
+        auto record = done.find(file.path);
+        if (record != done.end() && record->second.status != "timeout"
+                && record->second.size == (long long)file.size
+                && record->second.mtime == file.mtime) {
+            struct stat info;
+            if (record->second.status == "error"
+                    || (pack ? pack->contains(output_path(std::string(), file.relpath))
+                             : !outdir || stat(output_path(outdir, file.relpath).c_str(),
+                                               &info) == 0)) {
+                ++skipped;
+                continue;
+            }
+        }
+        items.emplace_back(new BatchItem);
+        items.back()->index = items.size() - 1;
+        items.back()->inpath = file.path;
+        items.back()->relpath = file.relpath;
+        items.back()->size = file.size;
+        items.back()->mtime = file.mtime;
+        if (alloc_stats_enabled())
+            items.back()->alloc.reset(new AllocStats);
+    }
+    if (skipped)
+        fprintf(stderr, "Skipping %zu files already done\n", skipped);
+    if (items.empty())
+        return 0;
+
+    FILE* manifest = nullptr;
+    if (options.manifest) {
+        manifest = fopen(options.manifest, "a+b");
+        if (!manifest) {
+            fprintf(stderr, "Error opening manifest '%s' for writing\n", options.manifest);
+            return 1;
+        }
+        // A run that crashed may have left a partial last line, which the
+        // first new record must not be appended to
+        if (fseek(manifest, -1, SEEK_END) == 0 && fgetc(manifest) != '\n') {
+            fseek(manifest, 0, SEEK_END);
+            fputc('\n', manifest);
+        }
+        fseek(manifest, 0, SEEK_END);
+    }
+
+    int jobs = options.jobs > 0 ? options.jobs
+                                : std::max(1, (int)std::thread::hardware_concurrency());
+
+    // The file size is the cheapest estimate of the decompilation cost
+    std::vector<BatchItem*> order;
+    for (const auto& item : items)
+        order.push_back(item.get());
+    std::stable_sort(order.begin(), order.end(), [](const BatchItem* a, const BatchItem* b) {
+        return a->size > b->size;
+    });
+
+    BatchResults results(manifest, pack.get(), outdir == nullptr && !pack);
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+#ifndef WIN32
+    if (options.isolate) {
+        WorkerPool pool(jobs, outdir, options.timeout, results);
+        ok = pool.run(order);
+        if (options.stats)
+            pool.printStats();
+    } else
+#endif
+    {
+        run_pipeline(order, jobs, outdir, options.timeout, options.stats, results);
+    }
+    std::cout.flush();
+    if (manifest)
+        fclose(manifest);
+    if (pack) {
+        try {
+            pack->close();
+        } catch (std::exception& ex) {
+            fprintf(stderr, "Error writing pack '%s': %s\n", options.pack, ex.what());
+            ok = false;
+        }
+    }
+
+    if (options.stats && ok) {
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start).count();
+        print_file_stats(items, seconds);
+        if (alloc_stats_enabled())
+            print_alloc_stats(items);
+    }
+    return (!ok || results.failures()) ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+#ifndef _PYC_DRIVER_H
+#define _PYC_DRIVER_H
+
+#include "pyc_module.h"
+#include <ostream>
+#include <vector>
+
+/* Front-end modes of pycdc that process many modules in one run */
+
+void print_header(std::ostream& pyc_output, const char* dispname, PycModule& mod);
+
+/* Decompile every .pyc file below indir to the same relative path below
+ * outdir (with a .py extension), then keep the output up to date as files
+ * change.  Files are only processed again if their contents changed, and
+ * nested code objects whose fingerprint is unchanged reuse their previous
+ * output.  Only returns on error. */
+int watch_tree(const char* indir, const char* outdir);
+
+struct BatchOptions {
+    BatchOptions()
+        : jobs(0), stats(false), isolate(false), timeout(0), manifest(), pack(),
+          allocStats(false) { }
+
+    int jobs;               // Decompiler threads; 0 for one per core
+    bool stats;             // Print per-stage statistics to stderr
+    bool isolate;           // Use worker processes instead of threads (POSIX only)
+    double timeout;         // Seconds per file; 0 for no limit
+    const char* manifest;   // JSONL results file, resumed from if it exists
+    const char* pack;       // Output pack (see outpack.h) to append to instead of outdir
+    bool allocStats;        // Account memory per file and subsystem (see allocstats.h)
+};
+
+/* Decompile the given files and directories (searched for .pyc files) in a
+ * pipeline of read, load, decompile and write stages.  With outdir, each
+ * file is written to the same relative path below outdir; with a pack, the
+ * outputs are appended to it under that path; otherwise all output goes to
+ * stdout in input order.  With a manifest, files recorded in it as done
+ * and unchanged since are skipped.  With isolate, files are decompiled by a
+ * pool of forked worker processes, and a file that crashes or hangs a
+ * worker only fails that file; without a timeout, a worker hangs after
+ * 300 seconds on one file.  Returns 1 if any file failed. */
+int batch_decompile(const std::vector<const char*>& inputs, const char* outdir,
+                    const BatchOptions& options);
+
+#endif
@@ -0,0 +1,263 @@
+#include "libpycdc.h"
+#include "ASTree.h"
+#include "contenthash.h"
+#include "disasm.h"
+#include <climits>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+
+struct pycdc_module {
+    std::mutex lock;
+    PycModule mod;
+    std::string error;
+
+    bool decompiled = false;
+    std::string source;
+    std::map<unsigned, std::string> disassembly;
+};
+
+static void count_code(PycRef<PycCode> code, pycdc_metadata* metadata)
+{
+    ++metadata->num_code_objects;
+    metadata->code_size += (size_t)code->code()->length();
+    for (const auto& obj : code->consts().cast<PycSimpleSequence>()->values()) {
+        if (obj.type() == PycObject::TYPE_CODE || obj.type() == PycObject::TYPE_CODE2)
+            count_code(obj.cast<PycCode>(), metadata);
+    }
+}
+
+static pycdc_status copy_to_buffer(const std::string& text, char* buffer, size_t size,
+                                   size_t* needed)
+{
+    if (needed)
+        *needed = text.size() + 1;
+    if (!buffer || size < text.size() + 1)
+        return PYCDC_ERR_BUFFER_TOO_SMALL;
+    memcpy(buffer, text.c_str(), text.size() + 1);
+    return PYCDC_OK;
+}
+
+static pycdc_status load_module(const void* data, size_t size, int major, int minor,
+                                bool marshalled, pycdc_module** module)
+{
+    if (!module)
+        return PYCDC_ERR_INVALID_ARG;
+    *module = nullptr;
+    if (!data || size > INT_MAX)
+        return PYCDC_ERR_INVALID_ARG;
+
+    pycdc_module* handle = new (std::nothrow) pycdc_module;
+    if (!handle)
+        return PYCDC_ERR_NO_MEMORY;
+    try {
+        if (marshalled)
+            handle->mod.loadFromMarshalledBuffer(data, (int)size, major, minor);
+        else
+            handle->mod.loadFromBuffer(data, (int)size);
+    } catch (std::bad_alloc&) {
+        delete handle;
+        return PYCDC_ERR_NO_MEMORY;
+    } catch (std::exception&) {
+        delete handle;
+        return PYCDC_ERR_LOAD;
+    }
+    if (!handle->mod.isValid() || handle->mod.code() == NULL) {
+        delete handle;
+        return marshalled ? PYCDC_ERR_INVALID_ARG : PYCDC_ERR_LOAD;
+    }
+
+    *module = handle;
+    return PYCDC_OK;
+}
+
+/* Generate (once) and return the decompiled source of a locked handle */
+static pycdc_status ensure_source(pycdc_module* module)
+{
+    if (module->decompiled)
+        return PYCDC_OK;
+    try {
+        std::ostringstream pyc_output;
+        decompyle(module->mod.code(), &module->mod, pyc_output);
+        module->source = pyc_output.str();
+        module->decompiled = true;
+        return PYCDC_OK;
+    } catch (std::bad_alloc&) {
+        module->error = "Out of memory";
+        return PYCDC_ERR_NO_MEMORY;
+    } catch (std::exception& ex) {
+        module->error = ex.what();
+        return PYCDC_ERR_DECOMPILE;
+    }
+}
+
+static pycdc_status ensure_disassembly(pycdc_module* module, unsigned flags,
+                                       const std::string** text)
+{
+    auto iter = module->disassembly.find(flags);
+    if (iter == module->disassembly.end()) {
+        try {
+            std::ostringstream pyc_output;
+            output_object(module->mod.code().cast<PycObject>(), &module->mod, 0,
+                          flags, pyc_output);
+            iter = module->disassembly.emplace(flags, pyc_output.str()).first;
+        } catch (std::bad_alloc&) {
+            module->error = "Out of memory";
+            return PYCDC_ERR_NO_MEMORY;
+        } catch (std::exception& ex) {
+            module->error = ex.what();
+            return PYCDC_ERR_DECOMPILE;
+        }
+    }
+    *text = &iter->second;
+    return PYCDC_OK;
+}
+
+int pycdc_api_version(void)
+{
+    return PYCDC_API_VERSION;
+}
+
+pycdc_status pycdc_load(const void* data, size_t size, pycdc_module** module)
+{
+    return load_module(data, size, 0, 0, false, module);
+}
+
+pycdc_status pycdc_load_marshalled(const void* data, size_t size, int major,
+                                   int minor, pycdc_module** module)
+{
+    if (!PycModule::isSupportedVersion(major, minor)) {
+        if (module)
+            *module = nullptr;
+        return PYCDC_ERR_INVALID_ARG;
+    }
+    return load_module(data, size, major, minor, true, module);
+}
+
+void pycdc_free(pycdc_module* module)
+{
+    delete module;
+}
+
+const char* pycdc_last_error(pycdc_module* module)
+{
+    if (!module)
+        return "";
+    std::lock_guard<std::mutex> guard(module->lock);
+    return module->error.c_str();
+}
+
+pycdc_status pycdc_get_metadata(pycdc_module* module, pycdc_metadata* metadata)
+{
+    if (!module || !metadata)
+        return PYCDC_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(module->lock);
+
+    PycRef<PycCode> code = module->mod.code();
+    memset(metadata, 0, sizeof(*metadata));
+    metadata->major = module->mod.majorVer();
+    metadata->minor = module->mod.minorVer();
+    metadata->is_unicode = module->mod.isUnicode();
+    metadata->flags = code->flags();
+    metadata->first_line = code->firstLine();
+    metadata->num_consts = code->consts()->size();
+    metadata->num_names = code->names()->size();
+    metadata->file_name = code->fileName()->value();
+    count_code(code, metadata);
+    return PYCDC_OK;
+}
+
+pycdc_status pycdc_decompile(pycdc_module* module, pycdc_write_fn write, void* context)
+{
+    if (!module || !write)
+        return PYCDC_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(module->lock);
+
+    pycdc_status status = ensure_source(module);
+    if (status == PYCDC_OK)
+        write(context, module->source.data(), module->source.size());
+    return status;
+}
+
+pycdc_status pycdc_decompile_to_buffer(pycdc_module* module, char* buffer, size_t size,
+                                       size_t* needed)
+{
+    if (!module)
+        return PYCDC_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(module->lock);
+
+    pycdc_status status = ensure_source(module);
+    if (status != PYCDC_OK)
+        return status;
+    return copy_to_buffer(module->source, buffer, size, needed);
+}
+
+pycdc_status pycdc_disassemble(pycdc_module* module, unsigned flags,
+                               pycdc_write_fn write, void* context)
+{
+    if (!module || !write)
+        return PYCDC_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(module->lock);
+
+    const std::string* text;
+    pycdc_status status = ensure_disassembly(module, flags, &text);
+    if (status == PYCDC_OK)
+        write(context, text->data(), text->size());
+    return status;
+}
+
+pycdc_status pycdc_disassemble_to_buffer(pycdc_module* module, unsigned flags,
+                                         char* buffer, size_t size, size_t* needed)
+{
+    if (!module)
+        return PYCDC_ERR_INVALID_ARG;
+    std::lock_guard<std::mutex> guard(module->lock);
+
+    const std::string* text;
+    pycdc_status status = ensure_disassembly(module, flags, &text);
+    if (status != PYCDC_OK)
+        return status;
+    return copy_to_buffer(*text, buffer, size, needed);
+}
+
+static pycdc_status content_hash(const void* data, size_t size, int major, int minor,
+                                 bool marshalled, unsigned flags,
+                                 unsigned long long* hash)
+{
+    if (!data || !hash || size > INT_MAX)
+        return PYCDC_ERR_INVALID_ARG;
+    if (marshalled && !PycModule::isSupportedVersion(major, minor))
+        return PYCDC_ERR_INVALID_ARG;
+
+    static_assert((int)PYCDC_HASH_IGNORE_FILENAME == (int)HASH_IGNORE_FILENAME
+                  && (int)PYCDC_HASH_IGNORE_FIRSTLINE == (int)HASH_IGNORE_FIRSTLINE,
+                  "Hash flags must match");
+    try {
+        PycBuffer in(data, (int)size);
+        if (marshalled)
+            *hash = marshal_content_hash(&in, major, minor, flags);
+        else
+            *hash = pyc_content_hash(&in, flags);
+        return PYCDC_OK;
+    } catch (std::bad_alloc&) {
+        return PYCDC_ERR_NO_MEMORY;
+    } catch (std::exception&) {
+        return PYCDC_ERR_LOAD;
+    }
+}
+
+pycdc_status pycdc_content_hash(const void* data, size_t size, unsigned flags,
+                                unsigned long long* hash)
+{
+    return content_hash(data, size, 0, 0, false, flags, hash);
+}
+
+pycdc_status pycdc_content_hash_marshalled(const void* data, size_t size, int major,
+                                           int minor, unsigned flags,
+                                           unsigned long long* hash)
+{
+    return content_hash(data, size, major, minor, true, flags, hash);
+}
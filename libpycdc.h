@@ -0,0 +1,127 @@
+#ifndef _LIBPYCDC_H
+#define _LIBPYCDC_H
+
+/* C API for embedding the decompiler and disassembler.
+ *
+ * A pycdc_module handle owns one loaded module.  All functions are reentrant;
+ * calls on the same handle are serialized internally, and distinct handles
+ * may be used concurrently from any number of threads. */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(PYCDC_BUILDING_LIBRARY)
+#    define PYCDC_API __declspec(dllexport)
+#  else
+#    define PYCDC_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define PYCDC_API __attribute__((visibility("default")))
+#else
+#  define PYCDC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever the API changes incompatibly */
+#define PYCDC_API_VERSION 1
+
+typedef struct pycdc_module pycdc_module;
+
+typedef enum {
+    PYCDC_OK = 0,
+    PYCDC_ERR_INVALID_ARG,      /* NULL handle/buffer, or bad version */
+    PYCDC_ERR_LOAD,             /* Input is not a valid pyc / code object */
+    PYCDC_ERR_DECOMPILE,        /* Decompilation or disassembly failed */
+    PYCDC_ERR_BUFFER_TOO_SMALL, /* *needed holds the required size */
+    PYCDC_ERR_NO_MEMORY,
+} pycdc_status;
+
+/* Same values as the pycdas --pycode-extra and --show-caches options */
+enum {
+    PYCDC_DISASM_PYCODE_VERBOSE = 0x1,
+    PYCDC_DISASM_SHOW_CACHES = 0x2,
+};
+
+/* Flags for pycdc_content_hash() */
+enum {
+    PYCDC_HASH_IGNORE_FILENAME = 0x1,   /* co_filename of all code objects */
+    PYCDC_HASH_IGNORE_FIRSTLINE = 0x2,  /* co_firstlineno of all code objects */
+};
+
+/* Output callback: receives the output text, possibly in several chunks */
+typedef void (*pycdc_write_fn)(void* context, const char* data, size_t length);
+
+typedef struct {
+    int major;              /* Python version the module was compiled for */
+    int minor;
+    int is_unicode;         /* Python 1.6 - 2.7 compiled with -U */
+    int flags;              /* Module code object CO_* flags */
+    int first_line;
+    int num_consts;
+    int num_names;
+    int num_code_objects;   /* Module code object and all nested ones */
+    size_t code_size;       /* Total bytecode size of all code objects */
+    const char* file_name;  /* Owned by the handle */
+} pycdc_metadata;
+
+PYCDC_API int pycdc_api_version(void);
+
+/* Load a pyc file image (with its header) from memory.  The data is not
+ * referenced after the call returns. */
+PYCDC_API pycdc_status pycdc_load(const void* data, size_t size,
+                                  pycdc_module** module);
+
+/* Load a bare marshalled code object for the given Python version */
+PYCDC_API pycdc_status pycdc_load_marshalled(const void* data, size_t size,
+                                             int major, int minor,
+                                             pycdc_module** module);
+
+PYCDC_API void pycdc_free(pycdc_module* module);
+
+/* Message describing the last failure on this handle, or "".  The string
+ * remains valid until the next call using the same handle. */
+PYCDC_API const char* pycdc_last_error(pycdc_module* module);
+
+PYCDC_API pycdc_status pycdc_get_metadata(pycdc_module* module,
+                                          pycdc_metadata* metadata);
+
+/* Decompile to source.  The output is generated once and cached in the
+ * handle, so probing for the buffer size does not decompile twice. */
+PYCDC_API pycdc_status pycdc_decompile(pycdc_module* module,
+                                       pycdc_write_fn write, void* context);
+
+/* Copy the NUL-terminated output into buffer.  needed (optional) receives
+ * the required buffer size, including the terminator. */
+PYCDC_API pycdc_status pycdc_decompile_to_buffer(pycdc_module* module,
+                                                 char* buffer, size_t size,
+                                                 size_t* needed);
+
+PYCDC_API pycdc_status pycdc_disassemble(pycdc_module* module, unsigned flags,
+                                         pycdc_write_fn write, void* context);
+
+PYCDC_API pycdc_status pycdc_disassemble_to_buffer(pycdc_module* module,
+                                                   unsigned flags, char* buffer,
+                                                   size_t size, size_t* needed);
+
+/* 64-bit hash of a pyc image that is the same whenever identical code is
+ * compiled again: it covers the Python version and the marshalled code, but
+ * not the timestamp, source size or source hash in the header.  The data is
+ * hashed in one pass without loading it, so no handle is needed. */
+PYCDC_API pycdc_status pycdc_content_hash(const void* data, size_t size,
+                                          unsigned flags,
+                                          unsigned long long* hash);
+
+/* The same for a bare marshalled code object of the given Python version */
+PYCDC_API pycdc_status pycdc_content_hash_marshalled(const void* data, size_t size,
+                                                     int major, int minor,
+                                                     unsigned flags,
+                                                     unsigned long long* hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
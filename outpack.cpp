@@ -0,0 +1,361 @@
+#include "outpack.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char PACK_MAGIC[8] = { 'P', 'Y', 'C', 'P', 'A', 'C', 'K', '\n' };
+static const char INDEX_MAGIC[8] = { 'P', 'Y', 'C', 'P', 'K', 'I', 'D', 'X' };
+static const uint32_t PACK_VERSION = 1;
+
+static const size_t HEADER_SIZE = 16;
+static const size_t RECORD_SIZE = 24;   // Without the name
+static const size_t ENTRY_SIZE = 32;
+static const size_t FOOTER_SIZE = 24;
+
+/* Longest name accepted when recovering records, to stop at garbage */
+static const uint32_t MAX_NAME_LENGTH = 0xFFFF;
+
+static void put32(std::string& out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        out += (char)((value >> (8 * i)) & 0xFF);
+}
+
+static void put64(std::string& out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        out += (char)((value >> (8 * i)) & 0xFF);
+}
+
+static uint32_t get32(const char* data)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= (uint32_t)(unsigned char)data[i] << (8 * i);
+    return value;
+}
+
+static uint64_t get64(const char* data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+        value |= (uint64_t)(unsigned char)data[i] << (8 * i);
+    return value;
+}
+
+static bool seek_file(FILE* file, uint64_t pos)
+{
+#ifdef WIN32
+    return _fseeki64(file, (long long)pos, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)pos, SEEK_SET) == 0;
+#endif
+}
+
+static bool read_at(FILE* file, uint64_t pos, void* data, size_t size)
+{
+    return seek_file(file, pos) && fread(data, 1, size, file) == size;
+}
+
+static uint64_t file_size(FILE* file)
+{
+#ifdef WIN32
+    if (_fseeki64(file, 0, SEEK_END) != 0)
+        return 0;
+    return (uint64_t)_ftelli64(file);
+#else
+    if (fseeko(file, 0, SEEK_END) != 0)
+        return 0;
+    return (uint64_t)ftello(file);
+#endif
+}
+
+static bool truncate_file(FILE* file, uint64_t size)
+{
+    if (fflush(file) != 0)
+        return false;
+#ifdef WIN32
+    return _chsize_s(_fileno(file), (long long)size) == 0;
+#else
+    return ftruncate(fileno(file), (off_t)size) == 0;
+#endif
+}
+
+const char* pack_status_name(uint32_t status)
+{
+    static const char* names[] = { "ok", "incomplete", "error", "timeout" };
+    return status <= PACK_TIMEOUT ? names[status] : "unknown";
+}
+
+/* == PackWriter == */
+
+PackWriter::~PackWriter()
+{
+    try {
+        close();
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error writing pack '%s': %s\n", m_filename.c_str(), ex.what());
+    }
+}
+
+void PackWriter::open(const char* filename)
+{
+    close();
+    m_filename = filename;
+    m_entries.clear();
+    m_buffer.clear();
+
+    m_file = fopen(filename, "r+b");
+    if (!m_file)
+        m_file = fopen(filename, "w+b");
+    if (!m_file)
+        throw std::runtime_error("Could not open file");
+
+    uint64_t size = file_size(m_file);
+    if (size == 0) {
+        m_buffer.assign(PACK_MAGIC, sizeof(PACK_MAGIC));
+        put32(m_buffer, PACK_VERSION);
+        put32(m_buffer, 0);
+        m_end = HEADER_SIZE;
+        if (!seek_file(m_file, 0))
+            throw std::runtime_error("Could not seek in file");
+        return;
+    }
+
+    char header[HEADER_SIZE];
+    if (size < HEADER_SIZE || !read_at(m_file, 0, header, sizeof(header))
+            || memcmp(header, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0
+            || get32(header + 8) != PACK_VERSION) {
+        fclose(m_file);
+        m_file = nullptr;
+        throw std::runtime_error("Not an output pack");
+    }
+    recover(size);
+    // Drop the old index, so a run that dies before writing the new one
+    // leaves a pack without a footer rather than one with a stale footer
+    if (size > m_end && !truncate_file(m_file, m_end))
+        throw std::runtime_error("Could not truncate file");
+    if (!seek_file(m_file, m_end))
+        throw std::runtime_error("Could not seek in file");
+}
+
+/* Rebuilds the entries from the records, which end at the index of a
+ * complete pack.  Without an index, a record cut short ends the walk, and
+ * is overwritten. */
+void PackWriter::recover(uint64_t size)
+{
+    uint64_t limit = size;
+    char footer[FOOTER_SIZE];
+    if (size >= HEADER_SIZE + FOOTER_SIZE
+            && read_at(m_file, size - FOOTER_SIZE, footer, sizeof(footer))
+            && memcmp(footer + 16, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0) {
+        uint64_t index = get64(footer), count = get64(footer + 8);
+        if (index >= HEADER_SIZE && index <= size && count <= (size - index) / ENTRY_SIZE
+                && index + count * ENTRY_SIZE + FOOTER_SIZE == size)
+            limit = index;
+    }
+
+    uint64_t pos = HEADER_SIZE;
+    char record[RECORD_SIZE];
+    std::string name;
+    while (limit - pos >= RECORD_SIZE && read_at(m_file, pos, record, sizeof(record))) {
+        PackEntry entry;
+        entry.length = get64(record);
+        entry.hash = get64(record + 8);
+        entry.status = get32(record + 16);
+        uint32_t nameLength = get32(record + 20);
+        entry.offset = pos + RECORD_SIZE + nameLength;
+        if (nameLength == 0 || nameLength > MAX_NAME_LENGTH || entry.status > PACK_TIMEOUT
+                || entry.offset > limit || entry.length > limit - entry.offset)
+            break;
+        name.resize(nameLength);
+        if (fread(&name[0], 1, nameLength, m_file) != nameLength)
+            break;
+        entry.name = name;
+        m_entries[name] = entry;
+        pos = entry.offset + entry.length;
+    }
+    m_end = pos;
+}
+
+void PackWriter::add(const std::string& name, const std::string& data, uint32_t status,
+                     uint64_t hash)
+{
+    if (!m_file)
+        throw std::logic_error("Pack is not open");
+    if (name.empty() || name.size() > MAX_NAME_LENGTH)
+        throw std::runtime_error("Invalid name for pack entry");
+
+    PackEntry& entry = m_entries[name];
+    entry.name = name;
+    entry.offset = m_end + RECORD_SIZE + name.size();
+    entry.length = data.size();
+    entry.hash = hash;
+    entry.status = status;
+
+    put64(m_buffer, entry.length);
+    put64(m_buffer, hash);
+    put32(m_buffer, status);
+    put32(m_buffer, (uint32_t)name.size());
+    m_buffer += name;
+    if (data.size() >= m_bufferSize) {
+        // Not worth copying into the buffer first
+        flush();
+        if (fwrite(data.data(), 1, data.size(), m_file) != data.size())
+            throw std::runtime_error("Could not write to file");
+    } else {
+        m_buffer += data;
+        if (m_buffer.size() >= m_bufferSize)
+            flush();
+    }
+    m_end = entry.offset + entry.length;
+}
+
+void PackWriter::flush()
+{
+    if (!m_buffer.empty() && fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size())
+        throw std::runtime_error("Could not write to file");
+    m_buffer.clear();
+}
+
+void PackWriter::close()
+{
+    if (!m_file)
+        return;
+
+    bool ok;
+    try {
+        for (const auto& item : m_entries) {
+            const PackEntry& entry = item.second;
+            put64(m_buffer, entry.offset);
+            put64(m_buffer, entry.length);
+            put64(m_buffer, entry.hash);
+            put32(m_buffer, entry.status);
+            put32(m_buffer, (uint32_t)entry.name.size());
+            if (m_buffer.size() >= m_bufferSize)
+                flush();
+        }
+        put64(m_buffer, m_end);
+        put64(m_buffer, m_entries.size());
+        m_buffer.append(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        flush();
+
+        // A recovered pack may have had more data after its last whole record
+        uint64_t size = m_end + m_entries.size() * ENTRY_SIZE + FOOTER_SIZE;
+        ok = truncate_file(m_file, size);
+    } catch (...) {
+        fclose(m_file);
+        m_file = nullptr;
+        m_buffer.clear();
+        throw;
+    }
+    if (fclose(m_file) != 0)
+        ok = false;
+    m_file = nullptr;
+    if (!ok)
+        throw std::runtime_error("Could not write to file");
+}
+
+/* == PackReader == */
+
+PackReader::~PackReader()
+{
+#ifndef WIN32
+    if (m_mapped)
+        munmap(const_cast<char*>(m_data), (size_t)m_size);
+#endif
+}
+
+void PackReader::open(const char* filename)
+{
+#ifndef WIN32
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open file");
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* map = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            m_data = static_cast<const char*>(map);
+            m_size = (uint64_t)info.st_size;
+            m_mapped = true;
+        }
+    }
+    ::close(fd);
+#endif
+    if (!m_mapped) {
+        FILE* in = fopen(filename, "rb");
+        if (!in)
+            throw std::runtime_error("Could not open file");
+        m_copy.resize((size_t)file_size(in));
+        bool ok = read_at(in, 0, m_copy.data(), m_copy.size());
+        fclose(in);
+        if (!ok)
+            throw std::runtime_error("Could not read file");
+        m_data = m_copy.data();
+        m_size = m_copy.size();
+    }
+
+    if (m_size < HEADER_SIZE + FOOTER_SIZE || memcmp(m_data, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+        throw std::runtime_error("Not an output pack");
+    if (get32(m_data + 8) != PACK_VERSION)
+        throw std::runtime_error("Unsupported output pack version");
+    const char* footer = m_data + m_size - FOOTER_SIZE;
+    m_index = get64(footer);
+    m_count = get64(footer + 8);
+    if (memcmp(footer + 16, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || m_index < HEADER_SIZE
+            || m_index > m_size || m_count > (m_size - m_index) / ENTRY_SIZE
+            || m_index + m_count * ENTRY_SIZE + FOOTER_SIZE != m_size)
+        throw std::runtime_error("Output pack has no index (not closed properly?)");
+}
+
+PackEntry PackReader::entry(size_t index) const
+{
+    if (index >= m_count)
+        throw std::out_of_range("Output pack entry out of range");
+    const char* data = m_data + m_index + index * ENTRY_SIZE;
+    PackEntry entry;
+    entry.offset = get64(data);
+    entry.length = get64(data + 8);
+    entry.hash = get64(data + 16);
+    entry.status = get32(data + 24);
+    uint32_t nameLength = get32(data + 28);
+    if (entry.offset < HEADER_SIZE + nameLength || entry.offset > m_index
+            || entry.length > m_index - entry.offset)
+        throw std::runtime_error("Corrupt output pack index");
+    entry.name.assign(m_data + entry.offset - nameLength, nameLength);
+    return entry;
+}
+
+long PackReader::find(const std::string& name) const
+{
+    size_t first = 0, last = (size_t)m_count;
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        const char* data = m_data + m_index + middle * ENTRY_SIZE;
+        uint64_t offset = get64(data);
+        uint32_t nameLength = get32(data + 28);
+        if (offset < HEADER_SIZE + nameLength || offset > m_index)
+            throw std::runtime_error("Corrupt output pack index");
+        int cmp = memcmp(m_data + offset - nameLength, name.data(),
+                         std::min((size_t)nameLength, name.size()));
+        if (cmp == 0)
+            cmp = (nameLength < name.size()) ? -1 : (nameLength > name.size()) ? 1 : 0;
+        if (cmp == 0)
+            return (long)middle;
+        if (cmp < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return -1;
+}
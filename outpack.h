@@ -0,0 +1,100 @@
+#ifndef _PYC_OUTPACK_H
+#define _PYC_OUTPACK_H
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Output packs: the results of a batch run appended to one file, instead of
+ * one small file per module.  All integers are little-endian.
+
+   header   "PYCPACK\n", u32 version (1), u32 reserved
+   records  u64 length, u64 hash, u32 status, u32 name length, name, data
+   index    u64 data offset, u64 length, u64 hash, u32 status, u32 name
+            length, for each name in byte order; the name of an entry comes
+            right before its data
+   footer   u64 index offset, u64 entry count, "PYCPKIDX"
+
+   The index is written when the writer is closed, and dropped when the
+   pack is opened for writing again.  A pack whose index is missing (after
+   a crash) is recovered from its records when it is opened for writing
+   again, and a name added again replaces its earlier entry.
+   The fixed-size sorted index lets readers map the file and look names up
+   with a binary search, without parsing anything up front. */
+
+enum PackStatus { PACK_OK, PACK_INCOMPLETE, PACK_ERROR, PACK_TIMEOUT };
+
+const char* pack_status_name(uint32_t status);
+
+struct PackEntry {
+    PackEntry() : offset(), length(), hash(), status() { }
+
+    std::string name;
+    uint64_t offset;    // Of the data
+    uint64_t length;
+    uint64_t hash;      // Of the data, or 0 without any
+    uint32_t status;
+};
+
+/* Appends records to a pack, in large sequential writes.  Not thread-safe;
+ * errors throw std::runtime_error. */
+class PackWriter {
+public:
+    explicit PackWriter(size_t bufferSize = 4 << 20)
+        : m_file(), m_end(), m_bufferSize(bufferSize) { }
+
+    /* Closes without throwing, writing the index if possible */
+    ~PackWriter();
+
+    /* Creates the pack, or opens an existing one to append to */
+    void open(const char* filename);
+    bool contains(const std::string& name) const { return m_entries.count(name) != 0; }
+    void add(const std::string& name, const std::string& data, uint32_t status,
+             uint64_t hash);
+
+    /* Writes the buffered records, the index and the footer */
+    void close();
+
+private:
+    void recover(uint64_t size);
+    void flush();
+
+    FILE* m_file;
+    std::string m_filename;
+    uint64_t m_end;             // Where the next record goes
+    size_t m_bufferSize;
+    std::string m_buffer;       // Records not written yet
+    std::map<std::string, PackEntry> m_entries;
+};
+
+/* Read-only view of a whole pack, mapped into memory where possible */
+class PackReader {
+public:
+    PackReader() : m_data(), m_size(), m_index(), m_count(), m_mapped() { }
+    ~PackReader();
+
+    /* Throws std::runtime_error for files that are not complete packs */
+    void open(const char* filename);
+
+    size_t size() const { return (size_t)m_count; }
+    PackEntry entry(size_t index) const;
+
+    /* Index of the entry with the name, or -1 */
+    long find(const std::string& name) const;
+    const char* data(const PackEntry& entry) const { return m_data + entry.offset; }
+
+private:
+    PackReader(const PackReader&) = delete;
+    PackReader& operator=(const PackReader&) = delete;
+
+    const char* m_data;
+    uint64_t m_size;
+    uint64_t m_index;
+    uint64_t m_count;
+    bool m_mapped;
+    std::vector<char> m_copy;   // The file, where it can't be mapped
+};
+
+#endif
@@ -70,6 +70,7 @@ void PycCode::load(PycData* stream, PycModule* mod)
             throw std::runtime_error("Cannot remap unexpected flags");
         m_flags = (m_flags & 0xFFFF) | ((m_flags & 0xFFF0000) << 4);
     }
+    mod->codeStarted(this);
 
     m_code = LoadObject(stream, mod).cast<PycString>();
     m_consts = LoadObject(stream, mod).cast<PycSequence>();
@@ -117,6 +118,35 @@ void PycCode::load(PycData* stream, PycModule* mod)
         m_exceptTable = LoadObject(stream, mod).cast<PycString>();
     else
         m_exceptTable = new PycString;
+
+    mod->codeLoaded(this);
+}
+
+template <class _Obj>
+static PycRef<_Obj> empty_immortal()
+{
+    _Obj* obj = new _Obj;
+    obj->makeImmortal();
+    return obj;
+}
+
+void PycCode::releaseBody()
+{
+    // Shared by all released code objects, which can be many
+    static const PycRef<PycString> emptyString = empty_immortal<PycString>();
+    static const PycRef<PycSequence> emptyTuple = empty_immortal<PycTuple>().cast<PycSequence>();
+
+    m_code = emptyString;
+    m_consts = emptyTuple;
+    m_names = emptyTuple;
+    m_localNames = emptyTuple;
+    m_localKinds = emptyString;
+    m_freeVars = emptyTuple;
+    m_cellVars = emptyTuple;
+    m_lnTable = emptyString;
+    m_exceptTable = emptyString;
+    m_globalsUsed.clear();
+    m_globalsUsed.shrink_to_fit();
 }
 
 PycRef<PycString> PycCode::getCellVar(PycModule* mod, int idx) const
@@ -82,6 +82,14 @@ public:
 
     const globals_t& getGlobals() const { return m_globalsUsed; }
 
+    /* For tools that rewrite code objects before marshalling them again */
+    void setConsts(PycRef<PycSequence> consts) { m_consts = std::move(consts); }
+    void setLnTable(PycRef<PycString> lnTable) { m_lnTable = std::move(lnTable); }
+
+    /* For streaming consumers that are done with the code object, but whose
+     * parent still refers to it: keeps only the names, counts and flags */
+    void releaseBody();
+
     void markGlobal(PycRef<PycString> varname)
     {
         m_globalsUsed.emplace_back(std::move(varname));
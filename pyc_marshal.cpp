@@ -0,0 +1,479 @@
+#include "pyc_marshal.h"
+#include "pyc_module.h"
+#include "pyc_numeric.h"
+#include <cstring>
+#include <stdexcept>
+
+/* Set in the type of an object the reader should remember for TYPE_OBREF */
+static const int FLAG_REF = 0x80;
+
+PycMarshalWriter::PycMarshalWriter(int major, int minor)
+    : m_maj(major), m_min(minor), m_refCount()
+{
+    if (PycModule::versionMagic(major, minor) == INVALID)
+        throw std::invalid_argument("Unsupported Python version");
+}
+
+void PycMarshalWriter::clear()
+{
+    m_data.clear();
+    m_interned.clear();
+    m_objectIds.clear();
+    m_valueIds.clear();
+    m_shared.clear();
+    m_refCount = 0;
+}
+
+void PycMarshalWriter::write16(int value)
+{
+    /* Ensure endianness */
+    writeByte(value & 0xFF);
+    writeByte((value >> 8) & 0xFF);
+}
+
+void PycMarshalWriter::write32(int value)
+{
+    /* Ensure endianness */
+    writeByte(value & 0xFF);
+    writeByte((value >>  8) & 0xFF);
+    writeByte((value >> 16) & 0xFF);
+    writeByte((value >> 24) & 0xFF);
+}
+
+void PycMarshalWriter::write64(Pyc_INT64 value)
+{
+    write32((int)(value & 0xFFFFFFFF));
+    write32((int)((value >> 32) & 0xFFFFFFFF));
+}
+
+void PycMarshalWriter::writePycHeader(unsigned int mtime, unsigned int sourceSize)
+{
+    write32((int)PycModule::versionMagic(m_maj, m_min));
+    if (verCompare(3, 7) >= 0)
+        write32(0);     // Flags: timestamp-based
+    write32((int)mtime);
+    if (verCompare(3, 3) >= 0)
+        write32((int)sourceSize);
+}
+
+void PycMarshalWriter::writeBool(bool value)
+{
+    if (verCompare(2, 3) >= 0) {
+        writeByte(value ? PycObject::TYPE_TRUE : PycObject::TYPE_FALSE);
+    } else {
+        // Before 2.3, True and False were just 1 and 0
+        writeInt(value ? 1 : 0);
+    }
+}
+
+void PycMarshalWriter::writeInt(long long value)
+{
+    if (value >= -0x7FFFFFFFLL - 1 && value <= 0x7FFFFFFFLL) {
+        writeByte(PycObject::TYPE_INT);
+        write32((int)value);
+        return;
+    }
+
+    // Sign and magnitude, in 15-bit digits from the least significant
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value
+                                             : (unsigned long long)value;
+    std::string digits;
+    int count = 0;
+    for (; magnitude != 0; magnitude >>= 15, ++count) {
+        digits.push_back((char)(magnitude & 0xFF));
+        digits.push_back((char)((magnitude >> 8) & 0x7F));
+    }
+    writeByte(PycObject::TYPE_LONG);
+    write32(value < 0 ? -count : count);
+    writeRaw(digits);
+}
+
+void PycMarshalWriter::writeBytes(const std::string& value)
+{
+    writeByte(PycObject::TYPE_STRING);
+    write32((int)value.size());
+    writeRaw(value);
+}
+
+void PycMarshalWriter::writeText(const std::string& value)
+{
+    if (m_maj < 3) {
+        writeBytes(value);
+        return;
+    }
+
+    bool ascii = true;
+    for (char ch : value) {
+        if (ch & 0x80) {
+            ascii = false;
+            break;
+        }
+    }
+    if (ascii && verCompare(3, 4) >= 0) {
+        if (value.size() < 256) {
+            writeByte(PycObject::TYPE_SHORT_ASCII);
+            writeByte((int)value.size());
+        } else {
+            writeByte(PycObject::TYPE_ASCII);
+            write32((int)value.size());
+        }
+    } else {
+        writeByte(PycObject::TYPE_UNICODE);
+        write32((int)value.size());
+    }
+    writeRaw(value);
+}
+
+void PycMarshalWriter::writeTupleHeader(int count)
+{
+    if (verCompare(3, 4) >= 0 && count < 256) {
+        writeByte(PycObject::TYPE_SMALL_TUPLE);
+        writeByte(count);
+    } else {
+        writeByte(PycObject::TYPE_TUPLE);
+        write32(count);
+    }
+}
+
+/* See the table in pyc_code.cpp for the layout of each version */
+void PycMarshalWriter::writeCode(const PycCodeCounts& counts,
+                                 const std::function<void(PycCodeField)>& writeField)
+{
+    writeByte(verCompare(1, 3) >= 0 ? PycObject::TYPE_CODE : PycObject::TYPE_CODE2);
+    writeCodeBody(counts, writeField);
+}
+
+void PycMarshalWriter::writeCodeBody(const PycCodeCounts& counts,
+                                     const std::function<void(PycCodeField)>& writeField)
+{
+    // Shorts before 2.3, longs after
+    auto writeCount = [this](int value) {
+        if (verCompare(2, 3) >= 0)
+            write32(value);
+        else
+            write16(value);
+    };
+
+    int flags = counts.flags;
+    if (verCompare(3, 8) < 0) {
+        // Undo the remapping of the FUTURE flags done by PycCode::load()
+        flags = (flags & 0xFFFF) | ((flags >> 4) & 0xFFF0000);
+    }
+
+    if (verCompare(1, 3) >= 0)
+        writeCount(counts.argCount);
+    if (verCompare(3, 8) >= 0)
+        write32(counts.posOnlyArgCount);
+    if (m_maj >= 3)
+        write32(counts.kwOnlyArgCount);
+    if (verCompare(1, 3) >= 0 && verCompare(3, 11) < 0)
+        writeCount(counts.numLocals);
+    if (verCompare(1, 5) >= 0)
+        writeCount(counts.stackSize);
+    if (verCompare(1, 3) >= 0)
+        writeCount(flags);
+
+    visitCodeFields([&](PycCodeField field) {
+        // The first line number comes right before the line number table
+        if (field == CODE_LN_TABLE)
+            writeCount(counts.firstLine);
+        writeField(field);
+    });
+}
+
+void PycMarshalWriter::visitCodeFields(const std::function<void(PycCodeField)>& visit) const
+{
+    visit(CODE_BYTES);
+    visit(CODE_CONSTS);
+    visit(CODE_NAMES);
+    if (verCompare(1, 3) >= 0)
+        visit(CODE_LOCAL_NAMES);
+    if (verCompare(3, 11) >= 0)
+        visit(CODE_LOCAL_KINDS);
+    if (verCompare(2, 1) >= 0 && verCompare(3, 11) < 0) {
+        visit(CODE_FREE_VARS);
+        visit(CODE_CELL_VARS);
+    }
+    visit(CODE_FILE_NAME);
+    visit(CODE_NAME);
+    if (verCompare(3, 11) >= 0)
+        visit(CODE_QUAL_NAME);
+    if (verCompare(1, 5) >= 0)
+        visit(CODE_LN_TABLE);
+    if (verCompare(3, 11) >= 0)
+        visit(CODE_EXCEPT_TABLE);
+}
+
+static PycRef<PycObject> code_field(const PycCode* code, PycCodeField field)
+{
+    switch (field) {
+    case CODE_BYTES:
+        return code->code().cast<PycObject>();
+    case CODE_CONSTS:
+        return code->consts().cast<PycObject>();
+    case CODE_NAMES:
+        return code->names().cast<PycObject>();
+    case CODE_LOCAL_NAMES:
+        return code->localNames().cast<PycObject>();
+    case CODE_LOCAL_KINDS:
+        return code->localKinds().cast<PycObject>();
+    case CODE_FREE_VARS:
+        return code->freeVars().cast<PycObject>();
+    case CODE_CELL_VARS:
+        return code->cellVars().cast<PycObject>();
+    case CODE_FILE_NAME:
+        return code->fileName().cast<PycObject>();
+    case CODE_NAME:
+        return code->name().cast<PycObject>();
+    case CODE_QUAL_NAME:
+        return code->qualName().cast<PycObject>();
+    case CODE_LN_TABLE:
+        return code->lnTable().cast<PycObject>();
+    case CODE_EXCEPT_TABLE:
+        return code->exceptTable().cast<PycObject>();
+    }
+    return nullptr;
+}
+
+/* Calls visit for the objects contained in obj, in the order they are
+ * written */
+void PycMarshalWriter::visitChildren(PycObject* obj,
+                                     const std::function<void(PycObject*)>& visit) const
+{
+    switch (obj->type()) {
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        for (const auto& item : static_cast<PycSimpleSequence*>(obj)->values())
+            visit(item);
+        break;
+    case PycObject::TYPE_DICT:
+        for (const auto& item : static_cast<PycDict*>(obj)->values()) {
+            visit(std::get<0>(item));
+            visit(std::get<1>(item));
+        }
+        break;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        visitCodeFields([&](PycCodeField field) {
+            visit(code_field(static_cast<PycCode*>(obj), field));
+        });
+        break;
+    }
+}
+
+void PycMarshalWriter::writeObject(PycRef<PycObject> obj)
+{
+    if (obj == nullptr) {
+        writeByte(PycObject::TYPE_NULL);
+        return;
+    }
+
+    int flag = 0;
+    auto found = m_objectIds.find(obj);
+    if (found != m_objectIds.end()) {
+        SharedObject& shared = m_shared[found->second];
+        if (shared.refIndex >= 0) {
+            writeByte(PycObject::TYPE_OBREF);
+            write32(shared.refIndex);
+            return;
+        }
+        if (shared.count > 1) {
+            shared.refIndex = m_refCount++;
+            flag = FLAG_REF;
+        }
+    }
+
+    const int type = obj->type();
+    if (type == PycObject::TYPE_INTERNED && m_maj < 3) {
+        const std::string& value = obj.cast<PycString>()->strValue();
+        auto interned = m_interned.find(value);
+        if (interned != m_interned.end()) {
+            writeByte(PycObject::TYPE_STRINGREF);
+            write32(interned->second);
+            return;
+        }
+        int index = (int)m_interned.size();
+        m_interned.emplace(value, index);
+    }
+
+    writeByte(type | flag);
+    switch (type) {
+    case PycObject::TYPE_NONE:
+    case PycObject::TYPE_FALSE:
+    case PycObject::TYPE_TRUE:
+    case PycObject::TYPE_STOPITER:
+    case PycObject::TYPE_ELLIPSIS:
+        break;
+    case PycObject::TYPE_INT:
+        write32(obj.cast<PycInt>()->value());
+        break;
+    case PycObject::TYPE_INT64:
+        {
+            // Loaded as four 16-bit digits
+            const std::vector<int>& digits = obj.cast<PycLong>()->value();
+            write32((int)((unsigned)(digits[0] & 0xFFFF) | ((unsigned)digits[1] << 16)));
+            write32((int)((unsigned)(digits[2] & 0xFFFF) | ((unsigned)digits[3] << 16)));
+        }
+        break;
+    case PycObject::TYPE_LONG:
+        {
+            PycRef<PycLong> value = obj.cast<PycLong>();
+            write32(value->size());
+            for (int digit : value->value())
+                write16(digit);
+        }
+        break;
+    case PycObject::TYPE_FLOAT:
+    case PycObject::TYPE_COMPLEX:
+        {
+            PycRef<PycFloat> value = obj.cast<PycFloat>();
+            writeByte((int)strlen(value->value()));
+            writeRaw(value->value());
+            if (type == PycObject::TYPE_COMPLEX) {
+                const char* imag = obj.cast<PycComplex>()->imag();
+                writeByte((int)strlen(imag));
+                writeRaw(imag);
+            }
+        }
+        break;
+    case PycObject::TYPE_BINARY_FLOAT:
+    case PycObject::TYPE_BINARY_COMPLEX:
+        {
+            Pyc_INT64 bits;
+            double value = obj.cast<PycCFloat>()->value();
+            memcpy(&bits, &value, sizeof(bits));
+            write64(bits);
+            if (type == PycObject::TYPE_BINARY_COMPLEX) {
+                value = obj.cast<PycCComplex>()->imag();
+                memcpy(&bits, &value, sizeof(bits));
+                write64(bits);
+            }
+        }
+        break;
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+        {
+            const std::string& value = obj.cast<PycString>()->strValue();
+            write32((int)value.size());
+            writeRaw(value);
+        }
+        break;
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        {
+            const std::string& value = obj.cast<PycString>()->strValue();
+            writeByte((int)value.size());
+            writeRaw(value);
+        }
+        break;
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        {
+            PycRef<PycSimpleSequence> seq = obj.cast<PycSimpleSequence>();
+            if (type == PycObject::TYPE_SMALL_TUPLE)
+                writeByte(seq->size());
+            else
+                write32(seq->size());
+            for (const auto& item : seq->values())
+                writeObject(item);
+        }
+        break;
+    case PycObject::TYPE_DICT:
+        for (const auto& item : obj.cast<PycDict>()->values()) {
+            writeObject(std::get<0>(item));
+            writeObject(std::get<1>(item));
+        }
+        writeByte(PycObject::TYPE_NULL);
+        break;
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        {
+            PycRef<PycCode> code = obj.cast<PycCode>();
+            writeCodeBody(PycCodeCounts(code), [&](PycCodeField field) {
+                writeObject(code_field(code, field));
+            });
+        }
+        break;
+    default:
+        throw std::runtime_error("Cannot marshal objects of type " + std::to_string(type));
+    }
+}
+
+/* Objects that may be merged with equal ones: immutable, and not code */
+static bool shareable_by_value(int type)
+{
+    switch (type) {
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_DICT:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_CODE:
+    case PycObject::TYPE_CODE2:
+        return false;
+    default:
+        return true;
+    }
+}
+
+/* Index of obj in m_shared, for the object itself or (byValue) for its
+ * value, which is the type and marshalled data of strings and numbers, and
+ * the ids of the items of containers */
+int PycMarshalWriter::objectId(PycObject* obj, bool byValue)
+{
+    auto found = m_objectIds.find(obj);
+    if (found != m_objectIds.end())
+        return found->second;
+
+    std::string key(1, (char)obj->type());
+    bool leaf = true;
+    visitChildren(obj, [&](PycObject* child) {
+        int id = child ? objectId(child, byValue) : -1;
+        key.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        leaf = false;
+    });
+
+    int id = (int)m_shared.size();
+    if (byValue && shareable_by_value(obj->type())) {
+        if (leaf && obj->type() != PycObject::TYPE_TUPLE
+                && obj->type() != PycObject::TYPE_SMALL_TUPLE
+                && obj->type() != PycObject::TYPE_FROZENSET) {
+            PycMarshalWriter value(m_maj, m_min);
+            value.writeObject(obj);
+            key = value.data();
+        }
+        auto inserted = m_valueIds.emplace(std::move(key), id);
+        id = inserted.first->second;
+    }
+    if (id == (int)m_shared.size())
+        m_shared.push_back(SharedObject { 0, -1 });
+    m_objectIds.emplace(obj, id);
+    return id;
+}
+
+void PycMarshalWriter::countObject(PycObject* obj)
+{
+    // The singletons are not worth a reference
+    if (!obj || obj->isImmortal())
+        return;
+
+    if (m_shared[m_objectIds.at(obj)].count++ > 0)
+        return;
+    visitChildren(obj, [this](PycObject* child) { countObject(child); });
+}
+
+void PycMarshalWriter::shareObjects(PycRef<PycObject> root, bool byValue)
+{
+    if (verCompare(3, 4) < 0 || root == nullptr)
+        return;
+
+    objectId(root, byValue);
+    countObject(root);
+}
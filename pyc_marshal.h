@@ -0,0 +1,132 @@
+#ifndef _PYC_MARSHAL_H
+#define _PYC_MARSHAL_H
+
+#include "pyc_code.h"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Fields of a code object that are marshalled objects, in no particular
+ * order; PycMarshalWriter::writeCode() asks for them in the order of the
+ * target version, and only for those the version has. */
+enum PycCodeField {
+    CODE_BYTES,         // Bytecode (bytes)
+    CODE_CONSTS,        // Tuple of constants
+    CODE_NAMES,         // Tuple of names
+    CODE_LOCAL_NAMES,   // varnames, or localsplusnames since 3.11
+    CODE_LOCAL_KINDS,   // localspluskinds (bytes), 3.11 ->
+    CODE_FREE_VARS,     // Tuple of names, 2.1 - 3.10
+    CODE_CELL_VARS,     // Tuple of names, 2.1 - 3.10
+    CODE_FILE_NAME,
+    CODE_NAME,
+    CODE_QUAL_NAME,     // 3.11 ->
+    CODE_LN_TABLE,      // lnotab or linetable (bytes), 1.5 ->
+    CODE_EXCEPT_TABLE,  // Exception table (bytes), 3.11 ->
+};
+
+/* Integer fields of a code object.  The flags use the numbering of
+ * PycCode::CodeFlags (that is, of Python 3.8), and are mapped back for
+ * older versions. */
+struct PycCodeCounts {
+    PycCodeCounts()
+        : argCount(), posOnlyArgCount(), kwOnlyArgCount(), numLocals(),
+          stackSize(), flags(), firstLine() { }
+
+    explicit PycCodeCounts(const PycCode* code)
+        : argCount(code->argCount()), posOnlyArgCount(code->posOnlyArgCount()),
+          kwOnlyArgCount(code->kwOnlyArgCount()), numLocals(code->numLocals()),
+          stackSize(code->stackSize()), flags(code->flags()),
+          firstLine(code->firstLine()) { }
+
+    int argCount, posOnlyArgCount, kwOnlyArgCount, numLocals;
+    int stackSize, flags, firstLine;
+};
+
+/* Builds marshal data (and pyc files) for one Python version, in memory.
+ * This is the reverse of LoadObject(): writeObject() writes back a loaded
+ * object tree, and the other methods build new objects from plain values,
+ * leaving the choice of layout (interning, small tuples vs. tuples) to the
+ * caller. */
+class PycMarshalWriter {
+public:
+    PycMarshalWriter(int major, int minor);
+
+    int majorVer() const { return m_maj; }
+    int minorVer() const { return m_min; }
+
+    int verCompare(int maj, int min) const
+    {
+        if (m_maj == maj)
+            return m_min - min;
+        return m_maj - maj;
+    }
+
+    const std::string& data() const { return m_data; }
+    void clear();
+
+    void writeByte(int value) { m_data.push_back((char)value); }
+    void write16(int value);
+    void write32(int value);
+    void write64(Pyc_INT64 value);
+    void writeRaw(const std::string& bytes) { m_data += bytes; }
+
+    /* Magic number, flags, timestamp and size, as the version has them */
+    void writePycHeader(unsigned int mtime = 0, unsigned int sourceSize = 0);
+
+    void writeNone() { writeByte(PycObject::TYPE_NONE); }
+    void writeBool(bool value);
+    void writeInt(long long value);     // TYPE_INT, or TYPE_LONG if it doesn't fit
+    void writeBytes(const std::string& value);
+
+    /* A str: TYPE_STRING before Python 3 (where str is bytes), and the
+     * most compact of TYPE_SHORT_ASCII, TYPE_ASCII or TYPE_UNICODE after.
+     * The value is UTF-8 for Python 3. */
+    void writeText(const std::string& value);
+
+    /* Header of a tuple of count items, which follow it */
+    void writeTupleHeader(int count);
+
+    /* Type and integer fields of a code object, then the objects requested
+     * from writeField in the order of the version */
+    void writeCode(const PycCodeCounts& counts,
+                   const std::function<void(PycCodeField)>& writeField);
+
+    /* Any object loaded by LoadObject() for the same version, keeping its
+     * type.  Interned strings that were already written are referenced
+     * with TYPE_STRINGREF (2.4 - 2.7), like CPython does. */
+    void writeObject(PycRef<PycObject> obj);
+
+    /* Makes writeObject() write the objects that occur more than once
+     * below root only the first time (flagged with FLAG_REF), and as
+     * TYPE_OBREF after that (3.4 ->).  With byValue, separate objects that
+     * are equal (of the same type, and not code objects) are shared too.
+     * Call it before writing root; it does nothing for older versions. */
+    void shareObjects(PycRef<PycObject> root, bool byValue);
+
+private:
+    void writeCodeBody(const PycCodeCounts& counts,
+                       const std::function<void(PycCodeField)>& writeField);
+    void visitCodeFields(const std::function<void(PycCodeField)>& visit) const;
+    void visitChildren(PycObject* obj, const std::function<void(PycObject*)>& visit) const;
+
+    int objectId(PycObject* obj, bool byValue);
+    void countObject(PycObject* obj);
+
+    int m_maj, m_min;
+    std::string m_data;
+
+    // Strings written as TYPE_INTERNED, by value (2.4 - 2.7)
+    std::unordered_map<std::string, int> m_interned;
+
+    struct SharedObject {
+        int count;      // Occurrences below the shareObjects() root
+        int refIndex;   // Index in the reader's list of refs once written
+    };
+    std::unordered_map<const PycObject*, int> m_objectIds;
+    std::unordered_map<std::string, int> m_valueIds;
+    std::vector<SharedObject> m_shared;
+    int m_refCount;
+};
+
+#endif
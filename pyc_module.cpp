@@ -197,12 +197,40 @@ bool PycModule::isSupportedVersion(int major, int minor)
     case 2:
         return (minor >= 0 && minor <= 7);
     case 3:
-        return (minor >= 0 && minor <= 12);
+        return (minor >= 0 && minor <= 13);
     default:
         return false;
     }
 }
 
+unsigned int PycModule::versionMagic(int major, int minor)
+{
+    static const unsigned int magic1[] = {
+        MAGIC_1_0, MAGIC_1_1, MAGIC_1_1, MAGIC_1_3, MAGIC_1_4, MAGIC_1_5, MAGIC_1_6,
+    };
+    static const unsigned int magic2[] = {
+        MAGIC_2_0, MAGIC_2_1, MAGIC_2_2, MAGIC_2_3, MAGIC_2_4, MAGIC_2_5, MAGIC_2_6,
+        MAGIC_2_7,
+    };
+    // 3.0 and 3.1 only ever wrote their unicode magic
+    static const unsigned int magic3[] = {
+        MAGIC_3_0+1, MAGIC_3_1+1, MAGIC_3_2, MAGIC_3_3, MAGIC_3_4, MAGIC_3_5_3,
+        MAGIC_3_6, MAGIC_3_7, MAGIC_3_8, MAGIC_3_9, MAGIC_3_10, MAGIC_3_11,
+        MAGIC_3_12, MAGIC_3_13,
+    };
+
+    if (!isSupportedVersion(major, minor))
+        return INVALID;
+    switch (major) {
+    case 1:
+        return magic1[minor];
+    case 2:
+        return magic2[minor];
+    default:
+        return magic3[minor];
+    }
+}
+
 void PycModule::loadFromFile(const char* filename)
 {
     PycFile in(filename);
@@ -210,37 +238,66 @@ void PycModule::loadFromFile(const char* filename)
         fprintf(stderr, "Error opening file %s\n", filename);
         return;
     }
-    setVersion(in.get32());
-    if (!isValid()) {
-        fputs("Bad MAGIC!\n", stderr);
+    loadPyc(&in);
+}
+
+void PycModule::loadFromMarshalledFile(const char* filename, int major, int minor)
+{
+    PycFile in (filename);
+    if (!in.isOpen()) {
+        fprintf(stderr, "Error opening file %s\n", filename);
         return;
     }
+    loadMarshalled(&in, major, minor);
+}
+
+void PycModule::loadFromBuffer(const void* buffer, int size)
+{
+    PycBuffer in(buffer, size);
+    loadPyc(&in);
+}
+
+void PycModule::loadFromMarshalledBuffer(const void* buffer, int size, int major, int minor)
+{
+    PycBuffer in(buffer, size);
+    loadMarshalled(&in, major, minor);
+}
+
+void PycModule::loadPycHeader(PycData* in)
+{
+    setVersion(in->get32());
+    if (!isValid())
+        return;
 
     int flags = 0;
     if (verCompare(3, 7) >= 0)
-        flags = in.get32();
+        flags = in->get32();
 
     if (flags & 0x1) {
         // Optional checksum added in Python 3.7
-        in.get32();
-        in.get32();
+        in->get32();
+        in->get32();
     } else {
-        in.get32(); // Timestamp -- who cares?
+        in->get32(); // Timestamp -- who cares?
 
         if (verCompare(3, 3) >= 0)
-            in.get32(); // Size parameter added in Python 3.3
+            in->get32(); // Size parameter added in Python 3.3
     }
-
-    m_code = LoadObject(&in, this).cast<PycCode>();
 }
 
-void PycModule::loadFromMarshalledFile(const char* filename, int major, int minor)
+void PycModule::loadPyc(PycData* in)
 {
-    PycFile in (filename);
-    if (!in.isOpen()) {
-        fprintf(stderr, "Error opening file %s\n", filename);
+    loadPycHeader(in);
+    if (!isValid()) {
+        fputs("Bad MAGIC!\n", stderr);
         return;
     }
+
+    m_code = LoadObject(in, this).cast<PycCode>();
+}
+
+void PycModule::loadMarshalled(PycData* in, int major, int minor)
+{
     if (!isSupportedVersion(major, minor)) {
         fprintf(stderr, "Unsupported version %d.%d\n", major, minor);
         return;
@@ -248,19 +305,124 @@ void PycModule::loadFromMarshalledFile(const char* filename, int major, int mino
     m_maj = major;
     m_min = minor;
     m_unicode = (major >= 3);
-    m_code = LoadObject(&in, this).cast<PycCode>();
+    m_code = LoadObject(in, this).cast<PycCode>();
 }
 
-PycRef<PycString> PycModule::getIntern(int ref) const
+void PycModule::intern(PycRef<PycString> str)
 {
-    if (ref < 0 || (size_t)ref >= m_interns.size())
+    size_t index = m_interns.size();
+    if (m_dropRefs && (index >= m_internUses.size() || m_internUses[index] == 0))
+        str = nullptr;
+    m_interns.emplace_back(std::move(str));
+}
+
+PycRef<PycString> PycModule::getIntern(int ref)
+{
+    if (ref < 0 || (size_t)ref >= m_interns.size() || m_interns[(size_t)ref] == nullptr)
         throw std::out_of_range("Intern index out of range");
-    return m_interns[(size_t)ref];
+    PycRef<PycString> str = m_interns[(size_t)ref];
+    if (m_dropRefs && --m_internUses[(size_t)ref] == 0)
+        m_interns[(size_t)ref] = nullptr;
+    return str;
+}
+
+void PycModule::refObject(PycRef<PycObject> obj)
+{
+    size_t index = m_refs.size();
+    if (m_dropRefs && (index >= m_refUses.size() || m_refUses[index] == 0))
+        obj = nullptr;
+    m_refs.emplace_back(std::move(obj));
 }
 
-PycRef<PycObject> PycModule::getRef(int ref) const
+PycRef<PycObject> PycModule::getRef(int ref)
 {
-    if (ref < 0 || (size_t)ref >= m_refs.size())
+    if (ref < 0 || (size_t)ref >= m_refs.size() || (m_dropRefs && m_refs[(size_t)ref] == nullptr))
         throw std::out_of_range("Ref index out of range");
-    return m_refs[(size_t)ref];
+    PycRef<PycObject> obj = m_refs[(size_t)ref];
+    if (m_dropRefs && --m_refUses[(size_t)ref] == 0)
+        m_refs[(size_t)ref] = nullptr;
+    if (obj != nullptr && !m_dropRefs)
+        m_renderCache.markShared(obj);
+    return obj;
+}
+
+void PycModule::setRefUses(std::vector<int> refUses, std::vector<int> internUses)
+{
+    m_dropRefs = true;
+    m_refUses = std::move(refUses);
+    m_internUses = std::move(internUses);
+}
+
+void PycModule::codeStarted(PycCode* code)
+{
+    // The module's flags decide how strings are printed, which streaming
+    // consumers do before the module's code is done loading
+    if (m_code == nullptr)
+        m_code = code;
+}
+
+void PycModule::codeLoaded(PycRef<PycCode> code)
+{
+    if (m_codeHandler)
+        m_codeHandler(std::move(code));
+}
+
+/* Whether obj might render to MIN_BYTES or more, which makes it worth a
+ * lookup each time it is printed */
+static bool render_candidate(PycObject* obj)
+{
+    switch (obj->type()) {
+    case PycObject::TYPE_STRING:
+    case PycObject::TYPE_UNICODE:
+    case PycObject::TYPE_INTERNED:
+    case PycObject::TYPE_ASCII:
+    case PycObject::TYPE_ASCII_INTERNED:
+    case PycObject::TYPE_SHORT_ASCII:
+    case PycObject::TYPE_SHORT_ASCII_INTERNED:
+        // Up to four bytes per byte when escaped
+        return static_cast<PycString*>(obj)->strValue().size() * 4 >= PycRenderCache::MIN_BYTES;
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        // At least three bytes per item, with the separator
+        return (size_t)static_cast<PycSequence*>(obj)->size() * 3 >= PycRenderCache::MIN_BYTES;
+    case PycObject::TYPE_DICT:
+        return static_cast<PycDict*>(obj)->values().size() * 6 >= PycRenderCache::MIN_BYTES;
+    default:
+        return false;
+    }
+}
+
+void PycRenderCache::markShared(PycObject* obj)
+{
+    if (m_shared.find(obj) != m_shared.end())
+        return;
+    m_shared.emplace(obj, render_candidate(obj));
+
+    // Everything in a shared container is shared too, such as a constant
+    // table in a consts tuple that is referenced as a whole
+    switch (obj->type()) {
+    case PycObject::TYPE_TUPLE:
+    case PycObject::TYPE_SMALL_TUPLE:
+    case PycObject::TYPE_LIST:
+    case PycObject::TYPE_SET:
+    case PycObject::TYPE_FROZENSET:
+        for (const auto& item : static_cast<PycSimpleSequence*>(obj)->values()) {
+            if (item != nullptr)
+                markShared(item);
+        }
+        break;
+    case PycObject::TYPE_DICT:
+        for (const auto& item : static_cast<PycDict*>(obj)->values()) {
+            if (std::get<0>(item) != nullptr)
+                markShared(std::get<0>(item));
+            if (std::get<1>(item) != nullptr)
+                markShared(std::get<1>(item));
+        }
+        break;
+    default:
+        break;
+    }
 }
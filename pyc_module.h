@@ -2,6 +2,11 @@
 #define _PYC_MODULE_H
 
 #include "pyc_code.h"
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 enum PycMagic {
@@ -40,12 +45,102 @@ enum PycMagic {
     INVALID = 0,
 };
 
+/* Renderings of the large constants of one module that are shared through
+ * TYPE_OBREF, so that a table referenced from many functions is only turned
+ * into text once.  Renderings are keyed by object identity and the context
+ * they were printed in (see below), and only kept if they are at least
+ * MIN_BYTES long; shorter ones are printed directly from then on.  An entry
+ * keeps its object alive, so its address can't be reused by another object
+ * while it is cached.  That is why nothing is cached while streaming (see
+ * PycModule::setRefUses()), which frees objects after their last use.  Like
+ * the rest of a module, not shared between threads. */
+class PycRenderCache {
+public:
+    enum {
+        RENDER_CONST,           // print_const()
+        RENDER_STRING,          // PycString::print()
+        RENDER_STRING_TRIPLE,
+        RENDER_DISASM = 0x100,  // output_object(), plus (flags << 16) and the indent
+    };
+
+    static const size_t MIN_BYTES = 256;
+
+    PycRenderCache() : m_hits(), m_misses() { }
+
+    /* Called for every TYPE_OBREF use of obj */
+    void markShared(PycObject* obj);
+
+    /* Whether obj is shared and large enough to be worth caching */
+    bool isShared(const PycObject* obj) const
+    {
+        if (m_shared.empty())
+            return false;
+        auto iter = m_shared.find(obj);
+        return iter != m_shared.end() && iter->second;
+    }
+
+    /* Prints obj, reusing its rendering in context if there is one, and
+     * rendering it with render(std::ostream&) otherwise */
+    template <typename Render>
+    void print(std::ostream& pyc_output, PycObject* obj, unsigned context, Render render)
+    {
+        if (!isShared(obj)) {
+            render(pyc_output);
+            return;
+        }
+        key_t key(obj, context);
+        auto iter = m_renderings.find(key);
+        if (iter != m_renderings.end()) {
+            if (iter->second.object == nullptr) {
+                // Too short to keep
+                render(pyc_output);
+                return;
+            }
+            pyc_output << iter->second.text;
+            ++m_hits;
+            return;
+        }
+        std::ostringstream text;
+        render(text);
+        std::string rendering = text.str();
+        pyc_output << rendering;
+        ++m_misses;
+        if (rendering.size() >= MIN_BYTES)
+            m_renderings.emplace(key, Entry { obj, std::move(rendering) });
+        else
+            m_renderings.emplace(key, Entry { nullptr, std::string() });
+    }
+
+    /* Shared objects printed again from a rendering, and rendered */
+    int hits() const { return m_hits; }
+    int misses() const { return m_misses; }
+
+private:
+    struct Entry {
+        PycRef<PycObject> object;
+        std::string text;
+    };
+    typedef std::pair<const PycObject*, unsigned> key_t;
+
+    std::unordered_map<const PycObject*, bool> m_shared;   // Object, render candidate
+    std::map<key_t, Entry> m_renderings;
+    int m_hits, m_misses;
+};
+
 class PycModule {
 public:
-    PycModule() : m_maj(-1), m_min(-1), m_unicode(false) { }
+    typedef std::function<void(PycRef<PycCode>)> code_handler_t;
+
+    PycModule() : m_maj(-1), m_min(-1), m_unicode(false), m_dropRefs(false) { }
 
     void loadFromFile(const char* filename);
     void loadFromMarshalledFile(const char *filename, int major, int minor);
+    void loadFromBuffer(const void* buffer, int size);
+    void loadFromMarshalledBuffer(const void* buffer, int size, int major, int minor);
+
+    /* Reads the magic number and the rest of the header of a pyc file,
+     * leaving in at the start of the marshalled code */
+    void loadPycHeader(PycData* in);
     bool isValid() const { return (m_maj >= 0) && (m_min >= 0); }
 
     int majorVer() const { return m_maj; }
@@ -72,17 +167,39 @@ public:
 
     PycRef<PycCode> code() const { return m_code; }
 
-    void intern(PycRef<PycString> str) { m_interns.emplace_back(std::move(str)); }
-    PycRef<PycString> getIntern(int ref) const;
+    void intern(PycRef<PycString> str);
+    PycRef<PycString> getIntern(int ref);
+
+    void refObject(PycRef<PycObject> obj);
+    PycRef<PycObject> getRef(int ref);
+
+    /* For streaming: given the number of TYPE_OBREF and TYPE_STRINGREF uses
+     * of each object from a scan of the same data (see marshal_ref_uses()),
+     * objects are only kept until their last use, and renderings aren't
+     * cached (see PycRenderCache) */
+    void setRefUses(std::vector<int> refUses, std::vector<int> internUses);
+
+    PycRenderCache& renderCache() { return m_renderCache; }
 
-    void refObject(PycRef<PycObject> obj) { m_refs.emplace_back(std::move(obj)); }
-    PycRef<PycObject> getRef(int ref) const;
+    /* Also for streaming: handler is called with every code object as soon
+     * as it is loaded, so nested code objects come before their parents */
+    void setCodeHandler(code_handler_t handler) { m_codeHandler = std::move(handler); }
+
+    // Called by PycCode::load()
+    void codeStarted(PycCode* code);
+    void codeLoaded(PycRef<PycCode> code);
 
     static bool isSupportedVersion(int major, int minor);
 
-private:
+    /* Magic number of a supported version, or INVALID */
+    static unsigned int versionMagic(int major, int minor);
+
     void setVersion(unsigned int magic);
 
+private:
+    void loadPyc(PycData* in);
+    void loadMarshalled(PycData* in, int major, int minor);
+
 private:
     int m_maj, m_min;
     bool m_unicode;
@@ -90,6 +207,11 @@ private:
     PycRef<PycCode> m_code;
     std::vector<PycRef<PycString>> m_interns;
     std::vector<PycRef<PycObject>> m_refs;
+
+    bool m_dropRefs;
+    std::vector<int> m_refUses, m_internUses;
+    code_handler_t m_codeHandler;
+    PycRenderCache m_renderCache;
 };
 
 #endif
@@ -5,11 +5,18 @@
 #include "data.h"
 #include <cstdio>
 
-PycRef<PycObject> Pyc_None = new PycObject(PycObject::TYPE_NONE);
-PycRef<PycObject> Pyc_Ellipsis = new PycObject(PycObject::TYPE_ELLIPSIS);
-PycRef<PycObject> Pyc_StopIteration = new PycObject(PycObject::TYPE_STOPITER);
-PycRef<PycObject> Pyc_False = new PycObject(PycObject::TYPE_FALSE);
-PycRef<PycObject> Pyc_True = new PycObject(PycObject::TYPE_TRUE);
+static PycObject* CreateImmortal(int type)
+{
+    PycObject* obj = new PycObject(type);
+    obj->makeImmortal();
+    return obj;
+}
+
+PycRef<PycObject> Pyc_None = CreateImmortal(PycObject::TYPE_NONE);
+PycRef<PycObject> Pyc_Ellipsis = CreateImmortal(PycObject::TYPE_ELLIPSIS);
+PycRef<PycObject> Pyc_StopIteration = CreateImmortal(PycObject::TYPE_STOPITER);
+PycRef<PycObject> Pyc_False = CreateImmortal(PycObject::TYPE_FALSE);
+PycRef<PycObject> Pyc_True = CreateImmortal(PycObject::TYPE_TRUE);
 
 PycRef<PycObject> CreateObject(int type)
 {
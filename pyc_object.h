@@ -2,6 +2,7 @@
 #define _PYC_OBJECT_H
 
 #include <typeinfo>
+#include "allocstats.h"
 
 template <class _Obj>
 class PycRef {
@@ -53,8 +54,14 @@ public:
 
     PycRef<_Obj>& operator=(PycRef<_Obj>&& obj) noexcept
     {
+        if (&obj == this)
+            return *this;
+        // Release the old object last, in case it owns the new one
+        _Obj* old = m_obj;
         m_obj = obj.m_obj;
         obj.m_obj = nullptr;
+        if (old)
+            old->delRef();
         return *this;
     }
 
@@ -129,9 +136,17 @@ public:
         TYPE_SHORT_ASCII_INTERNED = 'Z',    // Python 3.4 ->
     };
 
-    PycObject(int type = TYPE_UNKNOWN) : m_refs(0), m_type(type) { }
+    PycObject(int type = TYPE_UNKNOWN) : m_refs(0), m_type(type)
+    {
+        if (alloc_stats_enabled())
+            alloc_object_constructed(ALLOC_OBJECT, type);
+    }
+
     virtual ~PycObject() { }
 
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
+
     int type() const { return m_type; }
 
     virtual bool isEqual(PycRef<PycObject> obj) const
@@ -148,8 +163,13 @@ protected:
     int m_type;
 
 public:
-    void addRef() { ++m_refs; }
-    void delRef() { if (--m_refs == 0) delete this; }
+    /* Immortal objects (the static singletons below) may be shared by
+     * several decompiler threads, so their refcount is never touched. */
+    void makeImmortal() { m_refs = -1; }
+    bool isImmortal() const { return m_refs < 0; }
+
+    void addRef() { if (m_refs >= 0) ++m_refs; }
+    void delRef() { if (m_refs >= 0 && --m_refs == 0) delete this; }
 };
 
 template <class _Obj>
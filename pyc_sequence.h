@@ -29,6 +29,12 @@ public:
     const value_t& values() const { return m_values; }
     PycRef<PycObject> get(int idx) const override { return m_values.at(idx); }
 
+    void setValues(value_t values)
+    {
+        m_values = std::move(values);
+        m_size = (int)m_values.size();
+    }
+
 protected:
     value_t m_values;
 };
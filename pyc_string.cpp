@@ -58,6 +58,22 @@ bool PycString::isEqual(PycRef<PycObject> obj) const
 
 void PycString::print(std::ostream &pyc_output, PycModule* mod, bool triple,
                       const char* parent_f_string_quote)
+{
+    // Parts of f-strings depend on the quotes of the f-string
+    if (parent_f_string_quote) {
+        printValue(pyc_output, mod, triple, parent_f_string_quote);
+        return;
+    }
+    mod->renderCache().print(pyc_output, this,
+                             triple ? PycRenderCache::RENDER_STRING_TRIPLE
+                                    : PycRenderCache::RENDER_STRING,
+                             [&](std::ostream& text) {
+                                 printValue(text, mod, triple, nullptr);
+                             });
+}
+
+void PycString::printValue(std::ostream &pyc_output, PycModule* mod, bool triple,
+                           const char* parent_f_string_quote)
 {
     char prefix = 0;
     switch (type()) {
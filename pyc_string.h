@@ -31,6 +31,9 @@ public:
                const char* parent_f_string_quote = nullptr);
 
 private:
+    void printValue(std::ostream& stream, class PycModule* mod, bool triple,
+                    const char* parent_f_string_quote);
+
     std::string m_value;
 };
 
@@ -0,0 +1,449 @@
+/* Microbenchmarks for the primitives that dominate decompilation time.
+ *
+ * Each benchmark runs one primitive in a loop for a minimum amount of time
+ * and reports the time and number of allocations per operation.  Results
+ * can be saved to a file and compared against in a later run, which exits
+ * with 1 if any benchmark got slower by more than the threshold.
+ *
+ *   pycbench [--time <sec>] [--save <file>] [--baseline <file>]
+ *            [--threshold <percent>] [filter...]
+ *
+ * Only benchmarks whose name contains one of the filters are run. */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "ASTree.h"
+#include "FastStack.h"
+#include "bytecode.h"
+#include "pyc_numeric.h"
+
+/* Allocation counting; the benchmarks run on a single thread */
+static size_t s_allocCount = 0;
+
+static void* counted_alloc(size_t size)
+{
+    ++s_allocCount;
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+/* Discards output, so printing costs are measured without I/O */
+class NullBuf : public std::streambuf {
+protected:
+    int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+/* Keeps results alive, so the compiler cannot drop the work */
+static volatile size_t s_sink;
+
+/* Builds marshal data by hand */
+class MarshalBytes {
+public:
+    MarshalBytes& byte(int value) { m_data.push_back((char)value); return *this; }
+    MarshalBytes& int16(int value) { return byte(value & 0xFF).byte((value >> 8) & 0xFF); }
+    MarshalBytes& int32(int value) { return int16(value & 0xFFFF).int16((value >> 16) & 0xFFFF); }
+    MarshalBytes& raw(const std::string& bytes) { m_data += bytes; return *this; }
+
+    MarshalBytes& string(int type, const std::string& value)
+    {
+        byte(type);
+        if (type == PycObject::TYPE_SHORT_ASCII)
+            byte((int)value.size());
+        else
+            int32((int)value.size());
+        return raw(value);
+    }
+
+    MarshalBytes& smallInts(int count)
+    {
+        for (int i = 0; i < count; ++i)
+            byte(PycObject::TYPE_INT).int32(i);
+        return *this;
+    }
+
+    const std::string& data() const { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+struct Benchmark {
+    std::string name;
+    size_t opsPerCall;
+    std::function<void()> body;
+};
+
+struct Result {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+static Result measure(const Benchmark& bench, double minSeconds)
+{
+    typedef std::chrono::steady_clock clock;
+
+    bench.body();   // Warm up
+    for (size_t calls = 1; ; calls *= 2) {
+        size_t allocs = s_allocCount;
+        auto start = clock::now();
+        for (size_t i = 0; i < calls; ++i)
+            bench.body();
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        allocs = s_allocCount - allocs;
+
+        if (seconds >= minSeconds || calls >= ((size_t)1 << 40)) {
+            double ops = (double)calls * bench.opsPerCall;
+            return { seconds * 1e9 / ops, allocs / ops };
+        }
+    }
+}
+
+static void add_get32(std::vector<Benchmark>& benches)
+{
+    static std::string data(64 * 1024, '\0');
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 131);
+
+    benches.push_back({ "get32/PycBuffer", data.size() / 4, [] {
+        PycBuffer in(data.data(), (int)data.size());
+        size_t sum = 0;
+        while (!in.atEof())
+            sum += in.get32();
+        s_sink = sum;
+    } });
+
+    static const char* filename = "pycbench.tmp";
+    FILE* out = fopen(filename, "wb");
+    if (!out || fwrite(data.data(), 1, data.size(), out) != data.size()) {
+        fprintf(stderr, "Cannot write %s, skipping the PycFile benchmark\n", filename);
+        if (out)
+            fclose(out);
+        return;
+    }
+    fclose(out);
+    benches.push_back({ "get32/PycFile", data.size() / 4, [] {
+        PycFile in(filename);
+        size_t sum = 0;
+        for (size_t i = 0; i < data.size() / 4; ++i)
+            sum += in.get32();
+        s_sink = sum;
+    } });
+}
+
+static std::string code_object_3_11()
+{
+    std::string code;
+    for (int i = 0; i < 32; ++i)
+        code += std::string("\x64\x00\x01\x00", 4);    // LOAD_CONST 0, POP_TOP
+    code += std::string("\x53\x00", 2);                // RETURN_VALUE
+
+    MarshalBytes obj;
+    obj.byte(PycObject::TYPE_CODE).int32(0).int32(0).int32(0).int32(1).int32(0);
+    obj.string(PycObject::TYPE_STRING, code);
+    obj.byte(PycObject::TYPE_SMALL_TUPLE).byte(1).byte(PycObject::TYPE_NONE);
+    obj.byte(PycObject::TYPE_SMALL_TUPLE).byte(0);
+    obj.byte(PycObject::TYPE_SMALL_TUPLE).byte(0);
+    obj.string(PycObject::TYPE_STRING, "");
+    obj.string(PycObject::TYPE_SHORT_ASCII, "bench.py");
+    obj.string(PycObject::TYPE_SHORT_ASCII, "<module>");
+    obj.string(PycObject::TYPE_SHORT_ASCII, "<module>");
+    obj.int32(1);
+    obj.string(PycObject::TYPE_STRING, "");
+    obj.string(PycObject::TYPE_STRING, "");
+    return obj.data();
+}
+
+static std::string long_object(int digits)
+{
+    MarshalBytes obj;
+    obj.byte(PycObject::TYPE_LONG).int32(digits);
+    for (int i = 0; i < digits; ++i)
+        obj.int16((i * 7919 + 1) & 0x7FFF);
+    return obj.data();
+}
+
+static void add_load_object(std::vector<Benchmark>& benches, PycModule* mod)
+{
+    std::vector<std::pair<std::string, std::string>> objects;
+    objects.emplace_back("int", MarshalBytes().byte(PycObject::TYPE_INT).int32(12345).data());
+    objects.emplace_back("long", long_object(8));
+    objects.emplace_back("float", MarshalBytes().byte(PycObject::TYPE_BINARY_FLOAT)
+                                                .raw(std::string("\x1f\x85\xebQ\xb8\x1e\t@", 8)).data());
+    objects.emplace_back("string", MarshalBytes().string(PycObject::TYPE_STRING,
+                                                         std::string(64, 'x')).data());
+    objects.emplace_back("short_ascii", MarshalBytes().string(PycObject::TYPE_SHORT_ASCII,
+                                                              "identifier").data());
+    objects.emplace_back("unicode", MarshalBytes().string(PycObject::TYPE_UNICODE,
+                                                          "gr\xc3\xbc\xc3\x9f dich, Welt").data());
+    objects.emplace_back("small_tuple", MarshalBytes().byte(PycObject::TYPE_SMALL_TUPLE)
+                                                      .byte(8).smallInts(8).data());
+    objects.emplace_back("list", MarshalBytes().byte(PycObject::TYPE_LIST)
+                                               .int32(64).smallInts(64).data());
+    MarshalBytes dict;
+    dict.byte(PycObject::TYPE_DICT).smallInts(32).byte(PycObject::TYPE_NULL);
+    objects.emplace_back("dict", dict.data());
+    objects.emplace_back("code", code_object_3_11());
+
+    for (const auto& object : objects) {
+        std::string data = object.second;
+        benches.push_back({ "LoadObject/" + object.first, 1, [data, mod] {
+            PycBuffer in(data.data(), (int)data.size());
+            s_sink = (size_t)LoadObject(&in, mod)->type();
+        } });
+    }
+}
+
+static void add_bc_next(std::vector<Benchmark>& benches)
+{
+    static const struct { int major, minor; unsigned magic; } versions[] = {
+        { 1, 5, MAGIC_1_5 }, { 2, 7, MAGIC_2_7 }, { 3, 6, MAGIC_3_6 },
+        { 3, 11, MAGIC_3_11 }, { 3, 13, MAGIC_3_13 },
+    };
+
+    for (const auto& version : versions) {
+        // Every valid opcode of the version, in turn
+        std::string code;
+        std::vector<int> opcodes;
+        for (int byte = 0; byte < 256; ++byte) {
+            int opcode = Pyc::ByteToOpcode(version.major, version.minor, byte);
+            if (opcode != Pyc::PYC_INVALID_OPCODE && opcode != Pyc::EXTENDED_ARG_A)
+                opcodes.push_back(byte);
+        }
+        size_t count = 0;
+        bool wordcode = version.major > 3 || (version.major == 3 && version.minor >= 6);
+        while (code.size() < 16 * 1024) {
+            int byte = opcodes[count % opcodes.size()];
+            code += (char)byte;
+            if (wordcode)
+                code += (char)(count & 0xFF);
+            else if (Pyc::ByteToOpcode(version.major, version.minor, byte) >= Pyc::PYC_HAVE_ARG)
+                code += std::string("\x01\x00", 2);
+            ++count;
+        }
+
+        std::shared_ptr<PycModule> mod = std::make_shared<PycModule>();
+        mod->setVersion(version.magic);
+        benches.push_back({ "bc_next/" + std::to_string(version.major) + "."
+                                       + std::to_string(version.minor), count, [code, mod] {
+            PycBuffer source(code.data(), (int)code.size());
+            int opcode, operand, pos = 0;
+            size_t sum = 0;
+            while (!source.atEof()) {
+                bc_next(source, mod.get(), opcode, operand, pos);
+                sum += opcode;
+            }
+            s_sink = sum;
+        } });
+    }
+}
+
+static void add_string_print(std::vector<Benchmark>& benches, PycModule* mod)
+{
+    static const struct { const char* name; std::string chunk; } strings[] = {
+        { "plain", "The quick brown fox jumps over the lazy dog. " },
+        { "escapes", std::string("\x00\n\t'\"\\\x7f\x80\xff\r{}", 13) },
+    };
+
+    for (const auto& str : strings) {
+        PycRef<PycString> value = new PycString(PycObject::TYPE_ASCII);
+        std::string text;
+        while (text.size() < 256)
+            text += str.chunk;
+        value->setValue(text);
+        benches.push_back({ std::string("PycString::print/") + str.name, text.size(), [value, mod] {
+            NullBuf nullbuf;
+            std::ostream out(&nullbuf);
+            value->print(out, mod);
+        } });
+    }
+}
+
+static void add_long_repr(std::vector<Benchmark>& benches, PycModule* mod)
+{
+    for (int digits : { 1, 4, 64, 1024 }) {
+        std::string data = long_object(digits);
+        PycBuffer in(data.data(), (int)data.size());
+        PycRef<PycLong> value = LoadObject(&in, mod).cast<PycLong>();
+        benches.push_back({ "PycLong::repr/" + std::to_string(value->repr(mod).size() - 2) + "hex",
+                            1, [value, mod] {
+            s_sink = value->repr(mod).size();
+        } });
+    }
+}
+
+static void add_fast_stack(std::vector<Benchmark>& benches)
+{
+    PycRef<PycString> name = new PycString;
+    name->setValue("x");
+    PycRef<ASTNode> node = new ASTName(name);
+
+    benches.push_back({ "FastStack/push_pop", 128, [node] {
+        FastStack stack(16);
+        for (int i = 0; i < 64; ++i)
+            stack.push(node);
+        for (int i = 0; i < 64; ++i)
+            stack.pop();
+        s_sink = stack.empty();
+    } });
+
+    std::shared_ptr<FastStack> full = std::make_shared<FastStack>(64);
+    for (int i = 0; i < 64; ++i)
+        full->push(node);
+    benches.push_back({ "FastStack/copy64", 1, [full] {
+        FastStack copy(*full);
+        s_sink = copy.empty();
+    } });
+}
+
+static void add_print_src(std::vector<Benchmark>& benches, PycModule* mod)
+{
+    PycRef<PycString> name = new PycString;
+    name->setValue("x");
+
+    for (int depth : { 16, 256 }) {
+        // a + b + ... nests to the left and needs no parentheses, while
+        // a - (b - (...)) nests to the right and needs them at every level
+        PycRef<ASTNode> left = new ASTName(name);
+        PycRef<ASTNode> right = new ASTName(name);
+        for (int i = 0; i < depth; ++i) {
+            left = new ASTBinary(left, new ASTName(name), ASTBinary::BIN_ADD);
+            right = new ASTBinary(new ASTName(name), right, ASTBinary::BIN_SUBTRACT);
+        }
+        for (const auto& expr : { std::make_pair("left", left), std::make_pair("right", right) }) {
+            PycRef<ASTNode> node = expr.second;
+            benches.push_back({ std::string("print_src/") + expr.first + std::to_string(depth),
+                                (size_t)depth, [node, mod] {
+                NullBuf nullbuf;
+                std::ostream out(&nullbuf);
+                print_src(node, mod, out);
+            } });
+        }
+    }
+}
+
+static std::map<std::string, Result> load_baseline(const char* filename)
+{
+    std::map<std::string, Result> baseline;
+    FILE* in = fopen(filename, "r");
+    if (!in) {
+        fprintf(stderr, "Error opening baseline %s\n", filename);
+        return baseline;
+    }
+    char name[256];
+    Result result;
+    while (fscanf(in, "%255s %lf %lf", name, &result.nsPerOp, &result.allocsPerOp) == 3)
+        baseline[name] = result;
+    fclose(in);
+    return baseline;
+}
+
+int main(int argc, char* argv[])
+{
+    double minSeconds = 0.2;
+    double threshold = 10;
+    const char* savefile = nullptr;
+    const char* basefile = nullptr;
+    std::vector<std::string> filters;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "--time") == 0 && arg + 1 < argc) {
+            minSeconds = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--save") == 0 && arg + 1 < argc) {
+            savefile = argv[++arg];
+        } else if (strcmp(argv[arg], "--baseline") == 0 && arg + 1 < argc) {
+            basefile = argv[++arg];
+        } else if (strcmp(argv[arg], "--threshold") == 0 && arg + 1 < argc) {
+            threshold = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
+            fprintf(stderr, "Usage:  %s [options] [filter...]\n\n", argv[0]);
+            fputs("Options:\n", stderr);
+            fputs("  --time <sec>         Minimum time per benchmark (default: 0.2)\n", stderr);
+            fputs("  --save <file>        Write the results to <file>\n", stderr);
+            fputs("  --baseline <file>    Compare with results saved earlier\n", stderr);
+            fputs("  --threshold <pct>    Slowdown against the baseline that counts as a\n", stderr);
+            fputs("                       regression (default: 10)\n", stderr);
+            fputs("  --help               Show this help text and then exit\n", stderr);
+            return 0;
+        } else if (argv[arg][0] == '-') {
+            fprintf(stderr, "Error: Unrecognized argument %s\n", argv[arg]);
+            return 1;
+        } else {
+            filters.push_back(argv[arg]);
+        }
+    }
+
+    PycModule mod;
+    mod.setVersion(MAGIC_3_11);
+
+    std::vector<Benchmark> benches;
+    add_get32(benches);
+    add_load_object(benches, &mod);
+    add_bc_next(benches);
+    add_string_print(benches, &mod);
+    add_long_repr(benches, &mod);
+    add_fast_stack(benches);
+    add_print_src(benches, &mod);
+
+    std::map<std::string, Result> baseline;
+    if (basefile)
+        baseline = load_baseline(basefile);
+    FILE* save = nullptr;
+    if (savefile && !(save = fopen(savefile, "w"))) {
+        fprintf(stderr, "Error opening %s for writing\n", savefile);
+        return 1;
+    }
+
+    printf("%-28s %12s %12s\n", "benchmark", "ns/op", "allocs/op");
+    int regressions = 0;
+    for (const Benchmark& bench : benches) {
+        if (!filters.empty()) {
+            bool match = false;
+            for (const std::string& filter : filters)
+                match = match || bench.name.find(filter) != std::string::npos;
+            if (!match)
+                continue;
+        }
+
+        Result result = measure(bench, minSeconds);
+        printf("%-28s %12.2f %12.3f", bench.name.c_str(), result.nsPerOp, result.allocsPerOp);
+        auto base = baseline.find(bench.name);
+        if (base != baseline.end() && base->second.nsPerOp > 0) {
+            double change = (result.nsPerOp / base->second.nsPerOp - 1) * 100;
+            printf("   %+6.1f%%", change);
+            if (change > threshold) {
+                printf(" REGRESSION");
+                ++regressions;
+            }
+            if (result.allocsPerOp > base->second.allocsPerOp + 0.001)
+                printf(" (allocs/op was %.3f)", base->second.allocsPerOp);
+        }
+        printf("\n");
+        fflush(stdout);
+        if (save)
+            fprintf(save, "%s %.4f %.4f\n", bench.name.c_str(), result.nsPerOp, result.allocsPerOp);
+    }
+
+    if (save)
+        fclose(save);
+    remove("pycbench.tmp");
+    return regressions ? 1 : 0;
+}
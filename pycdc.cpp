@@ -1,7 +1,14 @@
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <atomic>
+#include <thread>
 #include "ASTree.h"
+#include "bytecode.h"
+#include "driver.h"
+#include "pyinstaller.h"
 
 #ifdef WIN32
 #  define PATHSEP '\\'
@@ -9,25 +16,104 @@
 #  define PATHSEP '/'
 #endif
 
+/* Decompile every code entry of a PyInstaller bundle.  Entries are spread
+ * over worker threads; with an output directory each entry is written to
+ * <outdir>/<name>.py, otherwise all entries go to stdout in archive order. */
+static int decompyle_pyinstaller(const char* infile, const char* outdir, int jobs)
+{
+    PyInstallerArchive archive(infile);
+    if (!archive.isValid())
+        return 1;
+
+    std::vector<const PyInstallerArchive::Entry*> work;
+    for (const auto& entry : archive.entries()) {
+        if (entry.isCode())
+            work.push_back(&entry);
+    }
+
+    std::vector<std::string> results(outdir ? 0 : work.size());
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    auto worker = [&]() {
+        std::vector<unsigned char> buffer;
+        for (;;) {
+            size_t index = next++;
+            if (index >= work.size())
+                break;
+            const PyInstallerArchive::Entry& entry = *work[index];
+
+            std::ostringstream pyc_output;
+            try {
+                PycModule mod;
+                archive.loadModule(entry, mod, buffer);
+                if (!mod.isValid()) {
+                    fprintf(stderr, "Could not load entry %s\n", entry.name.c_str());
+                    ++failures;
+                    continue;
+                }
+                print_header(pyc_output, entry.name.c_str(), mod);
+                decompyle(mod.code(), &mod, pyc_output);
+            } catch (std::exception& ex) {
+                fprintf(stderr, "Error decompyling %s: %s\n", entry.name.c_str(), ex.what());
+                ++failures;
+                continue;
+            }
+
+            if (outdir) {
+                // Keep hostile entry names from escaping the output directory
+                std::string name = entry.name;
+                for (char& ch : name) {
+                    if (ch == '/' || ch == '\\')
+                        ch = '.';
+                }
+                std::string filename = std::string(outdir) + PATHSEP + name + ".py";
+                std::ofstream out_file(filename, std::ios_base::out);
+                out_file << pyc_output.str();
+                if (out_file.fail()) {
+                    fprintf(stderr, "Error writing file '%s'\n", filename.c_str());
+                    ++failures;
+                }
+            } else {
+                results[index] = pyc_output.str();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+        thread.join();
+
+    for (const auto& text : results)
+        std::cout << text << "\n";
+
+    return failures ? 1 : 0;
+}
+
 int main(int argc, char* argv[])
 {
     const char* infile = nullptr;
+    std::vector<const char*> inputs;
+    bool batch = false;
+    BatchOptions batchOptions;
     bool marshalled = false;
+    bool pyinstaller = false;
+    const char* watchdir = nullptr;
+    int jobs = 0;
+    bool failFast = false;
+    bool failFastDisasm = false;
     const char* version = nullptr;
+    const char* outname = nullptr;
+    ConstLimits limits;
     std::ostream* pyc_output = &std::cout;
     std::ofstream out_file;
 
     for (int arg = 1; arg < argc; ++arg) {
         if (strcmp(argv[arg], "-o") == 0) {
             if (arg + 1 < argc) {
-                const char* filename = argv[++arg];
-                out_file.open(filename, std::ios_base::out);
-                if (out_file.fail()) {
-                    fprintf(stderr, "Error opening file '%s' for writing\n",
-                            filename);
-                    return 1;
-                }
-                pyc_output = &out_file;
+                outname = argv[++arg];
             } else {
                 fputs("Option '-o' requires a filename\n", stderr);
                 return 1;
@@ -41,24 +127,163 @@ int main(int argc, char* argv[])
                 fputs("Option '-v' requires a version\n", stderr);
                 return 1;
             }
+        } else if (strcmp(argv[arg], "--pyinstaller") == 0) {
+            pyinstaller = true;
+        } else if (strcmp(argv[arg], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[arg], "--stats") == 0) {
+            batchOptions.stats = true;
+        } else if (strcmp(argv[arg], "--alloc-stats") == 0) {
+            batchOptions.allocStats = true;
+        } else if (strcmp(argv[arg], "--isolate") == 0) {
+            batchOptions.isolate = true;
+        } else if (strcmp(argv[arg], "--manifest") == 0) {
+            if (arg + 1 < argc) {
+                batchOptions.manifest = argv[++arg];
+            } else {
+                fputs("Option '--manifest' requires a filename\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--pack") == 0) {
+            if (arg + 1 < argc) {
+                batchOptions.pack = argv[++arg];
+            } else {
+                fputs("Option '--pack' requires a filename\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--timeout") == 0) {
+            if (arg + 1 < argc) {
+                batchOptions.timeout = atof(argv[++arg]);
+            } else {
+                fputs("Option '--timeout' requires a number of seconds\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--watch") == 0) {
+            if (arg + 1 < argc) {
+                watchdir = argv[++arg];
+            } else {
+                fputs("Option '--watch' requires a directory\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--fail-fast") == 0) {
+            failFast = true;
+        } else if (strcmp(argv[arg], "--fail-fast-disasm") == 0) {
+            failFast = failFastDisasm = true;
+        } else if (strcmp(argv[arg], "--max-const-bytes") == 0) {
+            if (arg + 1 < argc) {
+                limits.maxBytes = strtoul(argv[++arg], nullptr, 10);
+            } else {
+                fputs("Option '--max-const-bytes' requires a number of bytes\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--max-seq-items") == 0) {
+            if (arg + 1 < argc) {
+                limits.maxItems = strtoul(argv[++arg], nullptr, 10);
+            } else {
+                fputs("Option '--max-seq-items' requires a number of items\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--dump-elided") == 0) {
+            if (arg + 1 < argc) {
+                limits.dumpDir = argv[++arg];
+            } else {
+                fputs("Option '--dump-elided' requires a directory\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "-j") == 0) {
+            if (arg + 1 < argc) {
+                jobs = atoi(argv[++arg]);
+            } else {
+                fputs("Option '-j' requires a number of jobs\n", stderr);
+                return 1;
+            }
         } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
-            fprintf(stderr, "Usage:  %s [options] input.pyc\n\n", argv[0]);
+            fprintf(stderr, "Usage:  %s [options] input.pyc\n", argv[0]);
+            fprintf(stderr, "        %s [options] --batch inputs...\n\n", argv[0]);
             fputs("Options:\n", stderr);
             fputs("  -o <filename>  Write output to <filename> (default: stdout)\n", stderr);
             fputs("  -c             Specify loading a compiled code object. Requires the version to be set\n", stderr);
             fputs("  -v <x.y>       Specify a Python version for loading a compiled code object\n", stderr);
+            fputs("  --pyinstaller  Decompile all modules of a PyInstaller bundle. With -o, the\n"
+                  "                 output is written to one file per module in that directory\n", stderr);
+            fputs("  --batch        Decompile all given files and directories (searched for .pyc\n"
+                  "                 files). With -o, output goes to that directory\n", stderr);
+            fputs("  --stats        Print pipeline statistics after --batch\n", stderr);
+            fputs("  --alloc-stats  Account the memory used by each file and subsystem, for\n"
+                  "                 --stats and the manifest\n", stderr);
+            fputs("  --isolate      Run --batch files in worker processes, so that a file which\n"
+                  "                 crashes or hangs the decompiler only fails that file. A\n"
+                  "                 worker counts as hung after --timeout, or 300 seconds\n", stderr);
+            fputs("  --manifest <file>\n"
+                  "                 Record the result of every --batch file in <file> (JSON\n"
+                  "                 lines), and skip files it lists as done and unchanged\n", stderr);
+            fputs("  --pack <file>  Append the output of all --batch files to the pack <file>\n"
+                  "                 instead of writing one file each (see pycpack)\n", stderr);
+            fputs("  --timeout <s>  Give up on a --batch file after <s> seconds\n", stderr);
+            fputs("  --watch <dir>  Decompile all .pyc files below <dir> into the directory given\n"
+                  "                 with -o, and keep the output up to date as files change\n", stderr);
+            fputs("  --fail-fast    Give up on a function at the first construct that can't be\n"
+                  "                 decompiled, and show only where it failed\n", stderr);
+            fputs("  --fail-fast-disasm\n"
+                  "                 Like --fail-fast, and also show the disassembly of the\n"
+                  "                 function, in comments\n", stderr);
+            fputs("  --max-const-bytes <n>\n"
+                  "                 Show at most <n> bytes of each string constant\n", stderr);
+            fputs("  --max-seq-items <n>\n"
+                  "                 Show at most <n> items of each constant tuple, list, set\n"
+                  "                 or dict\n", stderr);
+            fputs("  --dump-elided <dir>\n"
+                  "                 Write the constants cut short by these limits to <dir>\n", stderr);
+            fputs("  -j <jobs>      Number of threads to use for --pyinstaller and --batch\n"
+                  "                 (default: all cores)\n", stderr);
             fputs("  --help         Show this help text and then exit\n", stderr);
             return 0;
         } else {
             infile = argv[arg];
+            inputs.push_back(infile);
         }
     }
 
+    set_const_limits(limits);
+    decompyle_set_fail_fast(failFast, failFastDisasm);
+
+    if (watchdir) {
+        if (!outname) {
+            fputs("Option '--watch' requires an output directory (-o)\n", stderr);
+            return 1;
+        }
+        return watch_tree(watchdir, outname);
+    }
+
     if (!infile) {
         fputs("No input file specified\n", stderr);
         return 1;
     }
 
+    if (batch) {
+        if (batchOptions.pack && outname) {
+            fputs("Options '--pack' and '-o' can't be used together\n", stderr);
+            return 1;
+        }
+        batchOptions.jobs = jobs;
+        return batch_decompile(inputs, outname, batchOptions);
+    }
+
+    if (pyinstaller) {
+        if (jobs <= 0)
+            jobs = (int)std::thread::hardware_concurrency();
+        return decompyle_pyinstaller(infile, outname, jobs > 0 ? jobs : 1);
+    }
+
+    if (outname) {
+        out_file.open(outname, std::ios_base::out);
+        if (out_file.fail()) {
+            fprintf(stderr, "Error opening file '%s' for writing\n", outname);
+            return 1;
+        }
+        pyc_output = &out_file;
+    }
+
     PycModule mod;
     if (!marshalled) {
         try {
@@ -89,10 +314,7 @@ int main(int argc, char* argv[])
     }
     const char* dispname = strrchr(infile, PATHSEP);
     dispname = (dispname == NULL) ? infile : dispname + 1;
-    *pyc_output << "# Source Generated with AHMADxGEORGE Pycdc\n";
-    formatted_print(*pyc_output, "# File: %s (Python %d.%d%s)\n\n", dispname,
-                    mod.majorVer(), mod.minorVer(),
-                    (mod.majorVer() < 3 && mod.isUnicode()) ? " Unicode" : "");
+    print_header(*pyc_output, dispname, mod);
     try {
         decompyle(mod.code(), &mod, *pyc_output);
     } catch (std::exception& ex) {
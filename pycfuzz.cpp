@@ -0,0 +1,528 @@
+/* Slow-input hunting fuzzer for PycModule loading + decompyle.
+ *
+ * Mutates seed pycs (by default tests/compiled) and runs each mutant
+ * in-process.  Besides crashes and hangs, it flags inputs whose run time or
+ * allocation volume per input byte crosses a threshold, and minimizes those
+ * into small regression cases.  Mutants that get closer to a threshold than
+ * anything seen before are kept as new seeds, steering the search towards
+ * algorithmic blowups rather than just coverage.
+ *
+ * Built with clang and PYCFUZZ_LIBFUZZER defined, this file instead provides
+ * a libFuzzer entry point (crash finding only). */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "ASTree.h"
+
+#ifndef PYCFUZZ_LIBFUZZER
+#include <csignal>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef PYCFUZZ_LIBFUZZER
+/* Allocation accounting, for the duration of one run */
+static bool s_counting = false;
+static size_t s_allocBytes = 0;
+static size_t s_allocLimit = 0;
+static bool s_limitHit = false;
+
+static void* counted_alloc(size_t size)
+{
+    if (s_counting) {
+        if (s_allocLimit && (s_allocBytes > s_allocLimit
+                             || size > s_allocLimit - s_allocBytes)) {
+            // Count the refused request too, so that a single huge
+            // allocation shows up in the per-byte figure
+            s_allocBytes = std::min(s_allocBytes, SIZE_MAX - size) + size;
+            s_limitHit = true;
+            throw std::bad_alloc();
+        }
+        s_allocBytes += size;
+    }
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+#endif
+
+/* Discards output, so printing costs are measured without I/O */
+class NullBuf : public std::streambuf {
+protected:
+    int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+    std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+};
+
+static bool run_input(const unsigned char* data, size_t size)
+{
+    NullBuf nullbuf;
+    std::ostream pyc_output(&nullbuf);
+    try {
+        PycModule mod;
+        mod.loadFromBuffer(data, (int)size);
+        if (mod.isValid() && mod.code() != NULL)
+            decompyle(mod.code(), &mod, pyc_output);
+        return true;
+    } catch (std::exception&) {
+        return false;
+    }
+}
+
+#ifdef PYCFUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    run_input(data, size);
+    return 0;
+}
+
+#else
+
+struct RunStats {
+    double nsPerByte;
+    double allocPerByte;
+    double ms;
+    bool outOfMemory;
+};
+
+struct Options {
+    long maxRuns = -1;
+    unsigned timeout = 10;
+    unsigned seed = 0;
+    double maxNsPerByte = 50000.0;
+    double maxAllocPerByte = 4096.0;
+    double minMs = 10.0;
+    size_t maxAlloc = (size_t)512 << 20;
+    std::string outdir = "fuzz-out";
+};
+
+static Options s_options;
+
+/* State for the fatal signal handlers, which save the current input */
+static const unsigned char* s_current = nullptr;
+static size_t s_currentSize = 0;
+static char s_crashPath[1024];
+static char s_timeoutPath[1024];
+
+static uint64_t fnv1a(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string case_path(const char* kind, const std::vector<unsigned char>& data)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s-%016llx.pyc", kind,
+             (unsigned long long)fnv1a(data.data(), data.size()));
+    return s_options.outdir + "/" + name;
+}
+
+static void write_case(const std::string& path, const std::vector<unsigned char>& data)
+{
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        fprintf(stdout, "Error writing %s\n", path.c_str());
+        return;
+    }
+    fwrite(data.data(), 1, data.size(), out);
+    fclose(out);
+}
+
+static void save_and_die(const char* path, int sig)
+{
+    // Only async-signal-safe calls from here on
+    bool saved = false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        saved = !s_current || write(fd, s_current, s_currentSize) == (ssize_t)s_currentSize;
+        if (close(fd) != 0)
+            saved = false;
+    }
+    static const char savedMsg[] = "\n*** pycfuzz: fatal input saved to ";
+    static const char failedMsg[] = "\n*** pycfuzz: fatal input could not be saved to ";
+    const char* msg = saved ? savedMsg : failedMsg;
+    size_t msgSize = saved ? sizeof(savedMsg) - 1 : sizeof(failedMsg) - 1;
+    if (write(STDOUT_FILENO, msg, msgSize) < 0
+            || write(STDOUT_FILENO, path, strlen(path)) < 0
+            || write(STDOUT_FILENO, "\n", 1) < 0) { }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void crash_handler(int sig) { save_and_die(s_crashPath, sig); }
+static void timeout_handler(int sig) { save_and_die(s_timeoutPath, sig); }
+
+static RunStats measure(const std::vector<unsigned char>& data)
+{
+    snprintf(s_crashPath, sizeof(s_crashPath), "%s", case_path("crash", data).c_str());
+    snprintf(s_timeoutPath, sizeof(s_timeoutPath), "%s", case_path("timeout", data).c_str());
+    s_current = data.data();
+    s_currentSize = data.size();
+
+    s_allocBytes = 0;
+    s_allocLimit = s_options.maxAlloc;
+    s_limitHit = false;
+    alarm(s_options.timeout);
+    auto start = std::chrono::steady_clock::now();
+    s_counting = true;
+    run_input(data.data(), data.size());
+    s_counting = false;
+    auto end = std::chrono::steady_clock::now();
+    alarm(0);
+
+    RunStats stats;
+    double size = data.empty() ? 1.0 : (double)data.size();
+    double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    stats.ms = ns / 1e6;
+    stats.nsPerByte = ns / size;
+    stats.allocPerByte = (double)s_allocBytes / size;
+    stats.outOfMemory = s_limitHit;
+    return stats;
+}
+
+/* Timing is noisy, so use the best of a few runs when it matters */
+static RunStats measure_stable(const std::vector<unsigned char>& data)
+{
+    RunStats best = measure(data);
+    for (int i = 0; i < 2; ++i) {
+        RunStats stats = measure(data);
+        if (stats.nsPerByte < best.nsPerByte) {
+            best.nsPerByte = stats.nsPerByte;
+            best.ms = stats.ms;
+        }
+    }
+    return best;
+}
+
+enum Verdict { VERDICT_OK, VERDICT_SLOW, VERDICT_ALLOC };
+
+static Verdict judge(const RunStats& stats)
+{
+    if (stats.outOfMemory || stats.allocPerByte > s_options.maxAllocPerByte)
+        return VERDICT_ALLOC;
+    if (stats.ms >= s_options.minMs && stats.nsPerByte > s_options.maxNsPerByte)
+        return VERDICT_SLOW;
+    return VERDICT_OK;
+}
+
+/* Delta-debugging style reduction: drop ever smaller chunks as long as the
+ * input keeps the same verdict. */
+static std::vector<unsigned char> minimize(std::vector<unsigned char> data, Verdict verdict)
+{
+    int budget = 2000;
+    for (size_t chunk = data.size() / 2; chunk >= 1 && budget > 0; chunk /= 2) {
+        size_t offset = 0;
+        while (offset < data.size() && budget-- > 0) {
+            std::vector<unsigned char> candidate(data.begin(), data.begin() + offset);
+            candidate.insert(candidate.end(),
+                             data.begin() + std::min(data.size(), offset + chunk), data.end());
+            RunStats stats = (verdict == VERDICT_SLOW) ? measure_stable(candidate)
+                                                       : measure(candidate);
+            if (judge(stats) == verdict)
+                data.swap(candidate);
+            else
+                offset += chunk;
+        }
+    }
+    return data;
+}
+
+class Mutator {
+public:
+    explicit Mutator(unsigned seed) : m_rng(seed) { }
+
+    size_t below(size_t limit) { return limit ? (size_t)(m_rng() % limit) : 0; }
+
+    void mutate(std::vector<unsigned char>& data, const std::vector<unsigned char>& other)
+    {
+        int rounds = 1 + (int)below(4);
+        for (int i = 0; i < rounds; ++i) {
+            // Leave the magic alone most of the time; it's all-or-nothing
+            size_t start = data.size() > 16 && below(8) ? 16 : 0;
+            size_t pos = start + below(data.size() - start);
+            switch (below(7)) {
+            case 0:     // Bit flip
+                if (pos < data.size())
+                    data[pos] ^= (unsigned char)(1u << below(8));
+                break;
+            case 1:     // Interesting byte
+                if (pos < data.size()) {
+                    static const unsigned char bytes[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+                    data[pos] = bytes[below(sizeof(bytes))];
+                }
+                break;
+            case 2:     // Interesting 32-bit length / count
+                if (pos + 4 <= data.size()) {
+                    static const uint32_t values[] = {
+                        0, 1, 0xFF, 0x100, 0x7FFF, 0x10000, 0x7FFFFFFF, 0xFFFFFFFF
+                    };
+                    uint32_t value = values[below(sizeof(values) / sizeof(values[0]))];
+                    for (int b = 0; b < 4; ++b)
+                        data[pos + b] = (unsigned char)(value >> (8 * b));
+                }
+                break;
+            case 3:     // Delete a range
+                if (pos < data.size())
+                    data.erase(data.begin() + pos,
+                               data.begin() + std::min(data.size(), pos + 1 + below(32)));
+                break;
+            case 4:     // Duplicate a range (repeats bytecode patterns)
+                if (pos < data.size()) {
+                    size_t len = std::min(data.size() - pos, 1 + below(64));
+                    std::vector<unsigned char> copy(data.begin() + pos, data.begin() + pos + len);
+                    for (size_t n = 1 + below(16); n > 0; --n)
+                        data.insert(data.begin() + pos, copy.begin(), copy.end());
+                }
+                break;
+            case 5:     // Splice in a range from another input
+                if (!other.empty()) {
+                    size_t from = below(other.size());
+                    size_t len = std::min(other.size() - from, 1 + below(256));
+                    data.insert(data.begin() + std::min(pos, data.size()),
+                                other.begin() + from, other.begin() + from + len);
+                }
+                break;
+            default:    // Random byte
+                if (pos < data.size())
+                    data[pos] = (unsigned char)below(256);
+                break;
+            }
+        }
+        if (data.size() > ((size_t)4 << 20))
+            data.resize((size_t)4 << 20);
+    }
+
+private:
+    std::mt19937 m_rng;
+};
+
+static bool read_file(const std::string& path, std::vector<unsigned char>& data)
+{
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in)
+        return false;
+    data.clear();
+    unsigned char chunk[65536];
+    size_t count;
+    while ((count = fread(chunk, 1, sizeof(chunk), in)) != 0)
+        data.insert(data.end(), chunk, chunk + count);
+    fclose(in);
+    return true;
+}
+
+static void collect_inputs(const std::string& path, std::vector<std::string>& files)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        fprintf(stdout, "Cannot access %s\n", path.c_str());
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (struct dirent* ent = readdir(dir)) {
+        if (ent->d_name[0] != '.')
+            collect_inputs(path + "/" + ent->d_name, files);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+}
+
+static void report(const char* what, const std::string& path, const RunStats& stats,
+                   size_t size)
+{
+    fprintf(stdout, "%-8s %s  (%zu bytes, %.2f ms, %.0f ns/byte, %.0f alloc bytes/byte%s)\n",
+            what, path.c_str(), size, stats.ms, stats.nsPerByte, stats.allocPerByte,
+            stats.outOfMemory ? ", allocation limit hit" : "");
+    fflush(stdout);
+}
+
+/* Run each input once and fail if any of them crosses a threshold */
+static int replay(const std::vector<std::string>& files)
+{
+    int failures = 0;
+    for (const auto& path : files) {
+        std::vector<unsigned char> data;
+        if (!read_file(path, data))
+            continue;
+        RunStats stats = measure_stable(data);
+        Verdict verdict = judge(stats);
+        report(verdict == VERDICT_OK ? "ok" : verdict == VERDICT_SLOW ? "SLOW" : "ALLOC",
+               path, stats, data.size());
+        if (verdict != VERDICT_OK)
+            ++failures;
+    }
+    return failures ? 1 : 0;
+}
+
+static int fuzz(const std::vector<std::string>& files)
+{
+    std::vector<std::vector<unsigned char>> corpus;
+    std::vector<double> scores;
+    for (const auto& path : files) {
+        std::vector<unsigned char> data;
+        if (read_file(path, data) && !data.empty()) {
+            corpus.emplace_back(std::move(data));
+            scores.push_back(0.0);
+        }
+    }
+    if (corpus.empty()) {
+        fputs("No seed inputs\n", stdout);
+        return 1;
+    }
+    fprintf(stdout, "Loaded %zu seeds; writing findings to %s/\n", corpus.size(),
+            s_options.outdir.c_str());
+    fflush(stdout);
+
+    Mutator mutator(s_options.seed);
+    double bestRatio = 0.0;
+    long findings = 0;
+    for (long run = 0; s_options.maxRuns < 0 || run < s_options.maxRuns; ++run) {
+        size_t parent = mutator.below(corpus.size());
+        std::vector<unsigned char> data = corpus[parent];
+        mutator.mutate(data, corpus[mutator.below(corpus.size())]);
+
+        RunStats stats = measure(data);
+        Verdict verdict = judge(stats);
+        if (verdict == VERDICT_SLOW)
+            verdict = judge(stats = measure_stable(data));
+
+        if (verdict != VERDICT_OK) {
+            std::vector<unsigned char> small = minimize(data, verdict);
+            RunStats smallStats = measure_stable(small);
+            std::string path = case_path(verdict == VERDICT_SLOW ? "slow" : "alloc", small);
+            write_case(path, small);
+            report(verdict == VERDICT_SLOW ? "SLOW" : "ALLOC", path, smallStats, small.size());
+            ++findings;
+            continue;
+        }
+
+        // Keep mutants that come closer to a threshold than ever before
+        double ratio = std::max(stats.nsPerByte / s_options.maxNsPerByte,
+                                stats.allocPerByte / s_options.maxAllocPerByte);
+        if (ratio > bestRatio * 1.05 && ratio > scores[parent]) {
+            bestRatio = std::max(bestRatio, ratio);
+            corpus.emplace_back(std::move(data));
+            scores.push_back(ratio);
+        }
+
+        if ((run + 1) % 1000 == 0) {
+            fprintf(stdout, "#%ld  corpus: %zu  findings: %ld  closest: %.1f%% of threshold\n",
+                    run + 1, corpus.size(), findings, bestRatio * 100.0);
+            fflush(stdout);
+        }
+    }
+    return findings ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> inputs;
+    bool replayMode = false;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        bool hasValue = (arg + 1 < argc);
+        if (strcmp(argv[arg], "-n") == 0 && hasValue) {
+            s_options.maxRuns = atol(argv[++arg]);
+        } else if (strcmp(argv[arg], "-t") == 0 && hasValue) {
+            s_options.timeout = (unsigned)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-o") == 0 && hasValue) {
+            s_options.outdir = argv[++arg];
+        } else if (strcmp(argv[arg], "--seed") == 0 && hasValue) {
+            s_options.seed = (unsigned)atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--max-ns-per-byte") == 0 && hasValue) {
+            s_options.maxNsPerByte = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--max-alloc-per-byte") == 0 && hasValue) {
+            s_options.maxAllocPerByte = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--min-ms") == 0 && hasValue) {
+            s_options.minMs = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--max-alloc-mb") == 0 && hasValue) {
+            s_options.maxAlloc = (size_t)atol(argv[++arg]) << 20;
+        } else if (strcmp(argv[arg], "--replay") == 0) {
+            replayMode = true;
+        } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
+            fprintf(stderr, "Usage:  %s [options] [seed files or directories...]\n\n", argv[0]);
+            fputs("Options:\n", stderr);
+            fputs("  -n <runs>                 Stop after <runs> mutated inputs (default: run forever)\n", stderr);
+            fputs("  -t <seconds>              Per-input timeout (default: 10)\n", stderr);
+            fputs("  -o <dir>                  Directory for findings (default: fuzz-out)\n", stderr);
+            fputs("  --seed <n>                Random seed (default: 0)\n", stderr);
+            fputs("  --max-ns-per-byte <n>     Slow input threshold (default: 50000)\n", stderr);
+            fputs("  --max-alloc-per-byte <n>  Allocation threshold (default: 4096)\n", stderr);
+            fputs("  --min-ms <ms>             Never flag runs faster than this (default: 10)\n", stderr);
+            fputs("  --max-alloc-mb <mb>       Abort a run after allocating this much (default: 512)\n", stderr);
+            fputs("  --replay                  Run the given inputs once and fail if any of them\n"
+                  "                            crosses a threshold (for regression cases)\n", stderr);
+            fputs("  --help                    Show this help text and then exit\n", stderr);
+            return 0;
+        } else if (argv[arg][0] == '-') {
+            fprintf(stderr, "Error: Unrecognized argument %s\n", argv[arg]);
+            return 1;
+        } else {
+            inputs.push_back(argv[arg]);
+        }
+    }
+    if (inputs.empty())
+        inputs.push_back("tests/compiled");
+
+    std::vector<std::string> files;
+    for (const auto& path : inputs)
+        collect_inputs(path, files);
+
+    // Deep recursion (e.g. nested tuples) overflows the stack, so the crash
+    // handler needs a stack of its own
+    static char altstack[65536];
+    stack_t ss;
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = altstack;
+    ss.ss_size = sizeof(altstack);
+    sigaltstack(&ss, nullptr);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_ONSTACK;
+    sa.sa_handler = crash_handler;
+    for (int sig : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT })
+        sigaction(sig, &sa, nullptr);
+    sa.sa_handler = timeout_handler;
+    sigaction(SIGALRM, &sa, nullptr);
+
+    // The decompiler reports every problem on stderr; that is expected for
+    // mutated inputs and would drown out the findings.
+    if (!freopen("/dev/null", "w", stderr))
+        fputs("Warning: could not silence stderr\n", stdout);
+
+    // Replays save crashing and hanging inputs too
+    mkdir(s_options.outdir.c_str(), 0755);
+
+    return replayMode ? replay(files) : fuzz(files);
+}
+
+#endif
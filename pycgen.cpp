@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "synthpyc.h"
+
+/* Writes large synthetic pyc files for scaling tests, without needing
+ * the matching version of Python */
+
+static bool write_file(const char* filename, const std::string& data)
+{
+    std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+    out.write(data.data(), data.size());
+    out.close();
+    if (out.fail()) {
+        fprintf(stderr, "Error writing file '%s'\n", filename);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    SynthOptions opts;
+    const char* outfile = nullptr;
+    const char* sourcefile = nullptr;
+
+    struct {
+        const char* option;
+        int* value;
+    } counts[] = {
+        { "--functions", &opts.functions },
+        { "--nesting", &opts.nesting },
+        { "--dict", &opts.dictEntries },
+        { "--string", &opts.stringBytes },
+        { "--elif", &opts.elifChain },
+        { "--try", &opts.tryNesting },
+    };
+
+    for (int arg = 1; arg < argc; ++arg) {
+        bool isCount = false;
+        for (const auto& count : counts) {
+            if (strcmp(argv[arg], count.option) == 0 && arg + 1 < argc) {
+                *count.value = atoi(argv[++arg]);
+                isCount = true;
+            }
+        }
+        if (isCount)
+            continue;
+
+        if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+            outfile = argv[++arg];
+        } else if (strcmp(argv[arg], "--source") == 0 && arg + 1 < argc) {
+            sourcefile = argv[++arg];
+        } else if (strcmp(argv[arg], "-v") == 0 && arg + 1 < argc) {
+            if (sscanf(argv[++arg], "%d.%d", &opts.major, &opts.minor) != 2) {
+                fputs("Unable to parse version string (use the format x.y)\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
+            fprintf(stderr, "Usage:  %s [options] -o output.pyc\n\n", argv[0]);
+            fputs("Options:\n", stderr);
+            fputs("  -o <filename>        Write the pyc to <filename>\n", stderr);
+            fputs("  -v <x.y>             Python version: 2.7, 3.8 or 3.11 (default: 3.11)\n", stderr);
+            fputs("  --source <filename>  Also write the equivalent source to <filename>\n", stderr);
+            fputs("  --functions <n>      Define n small functions\n", stderr);
+            fputs("  --nesting <n>        Nest n if statements\n", stderr);
+            fputs("  --dict <n>           Build a dict literal with n entries\n", stderr);
+            fputs("  --string <n>         Assign a string of n characters\n", stderr);
+            fputs("  --elif <n>           Add an if/elif chain of n comparisons\n", stderr);
+            fputs("  --try <n>            Nest n try/except statements\n", stderr);
+            fputs("  --help               Show this help text and then exit\n", stderr);
+            return 0;
+        } else {
+            fprintf(stderr, "Error: Unrecognized argument %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    if (!outfile) {
+        fputs("No output file specified\n", stderr);
+        return 1;
+    }
+    if (!synth_supported_version(opts.major, opts.minor)) {
+        fprintf(stderr, "Cannot generate code for Python %d.%d\n", opts.major, opts.minor);
+        return 1;
+    }
+
+    std::string source;
+    std::string pyc = synth_pyc(opts, sourcefile ? &source : nullptr);
+    if (!write_file(outfile, pyc))
+        return 1;
+    if (sourcefile && !write_file(sourcefile, source))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include "outpack.h"
+
+#ifdef WIN32
+#include <direct.h>
+#endif
+
+/* Lists and extracts the output packs written by pycdc --batch --pack */
+
+static void list_pack(const PackReader& pack)
+{
+    for (size_t i = 0; i < pack.size(); ++i) {
+        PackEntry entry = pack.entry(i);
+        printf("%-10s %10llu  %016llx  %s\n", pack_status_name(entry.status),
+               (unsigned long long)entry.length, (unsigned long long)entry.hash,
+               entry.name.c_str());
+    }
+}
+
+/* Create every missing directory leading up to path */
+static void make_parent_dirs(const std::string& path)
+{
+    for (size_t slash = path.find_first_of("/\\", 1); slash != std::string::npos;
+            slash = path.find_first_of("/\\", slash + 1)) {
+#ifdef WIN32
+        _mkdir(path.substr(0, slash).c_str());
+#else
+        mkdir(path.substr(0, slash).c_str(), 0777);
+#endif
+    }
+}
+
+/* Names come from the pack, so they must not lead out of outdir */
+static bool safe_name(const std::string& name)
+{
+    if (name.empty() || name[0] == '/' || name[0] == '\\' || name.find(':') != std::string::npos)
+        return false;
+    size_t start = 0;
+    for (;;) {
+        size_t end = name.find_first_of("/\\", start);
+        if (name.compare(start, end == std::string::npos ? std::string::npos : end - start,
+                         "..") == 0)
+            return false;
+        if (end == std::string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+static bool extract_entry(const PackReader& pack, const PackEntry& entry, const char* outdir)
+{
+    if (!safe_name(entry.name)) {
+        fprintf(stderr, "Skipping entry with unsafe name %s\n", entry.name.c_str());
+        return false;
+    }
+    if (entry.length == 0)
+        return true;
+    std::string path = std::string(outdir) + "/" + entry.name;
+    make_parent_dirs(path);
+    FILE* out = fopen(path.c_str(), "wb");
+    bool ok = out && fwrite(pack.data(entry), 1, (size_t)entry.length, out) == entry.length;
+    if (out && fclose(out) != 0)
+        ok = false;
+    if (!ok)
+        fprintf(stderr, "Error writing file '%s'\n", path.c_str());
+    return ok;
+}
+
+static void usage(const char* app)
+{
+    fprintf(stderr, "Usage:  %s list <pack>\n", app);
+    fprintf(stderr, "        %s cat <pack> <name>...\n", app);
+    fprintf(stderr, "        %s extract <pack> <outdir> [<name>...]\n\n", app);
+    fputs("  list      Show the status, size, output hash and name of every entry\n", stderr);
+    fputs("  cat       Write the output of the named entries to stdout\n", stderr);
+    fputs("  extract   Write the output of the named entries, or of all entries, to\n"
+          "            files below <outdir>\n", stderr);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
+        usage(argv[0]);
+        return 0;
+    }
+    std::string command = argc >= 2 ? argv[1] : "";
+    if (argc < 3 || (command != "list" && command != "cat" && command != "extract")
+            || (command == "extract" && argc < 4)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    PackReader pack;
+    try {
+        pack.open(argv[2]);
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error reading pack %s: %s\n", argv[2], ex.what());
+        return 1;
+    }
+
+    int failures = 0;
+    try {
+        if (command == "list") {
+            list_pack(pack);
+        } else if (command == "extract" && argc == 4) {
+            for (size_t i = 0; i < pack.size(); ++i) {
+                if (!extract_entry(pack, pack.entry(i), argv[3]))
+                    ++failures;
+            }
+        } else {
+            int first = (command == "cat") ? 3 : 4;
+            for (int arg = first; arg < argc; ++arg) {
+                long index = pack.find(argv[arg]);
+                if (index < 0) {
+                    fprintf(stderr, "No entry %s in the pack\n", argv[arg]);
+                    ++failures;
+                    continue;
+                }
+                PackEntry entry = pack.entry((size_t)index);
+                if (command == "cat")
+                    fwrite(pack.data(entry), 1, (size_t)entry.length, stdout);
+                else if (!extract_entry(pack, entry, argv[3]))
+                    ++failures;
+            }
+        }
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error reading pack %s: %s\n", argv[2], ex.what());
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "pyc_marshal.h"
+#include "pyc_module.h"
+#include "bytecode.h"
+#include "codeflow.h"
+
+/* Rewrites pyc files without what the interpreter does not need to run
+ * them: docstrings (as python -OO does), line number tables and duplicate
+ * constants */
+
+struct SlimOptions {
+    SlimOptions() : docstrings(true), lineTables(true), share(true) { }
+
+    bool docstrings;    // Strip them
+    bool lineTables;
+    bool share;         // Share equal constants (3.4 ->)
+};
+
+struct SlimStats {
+    SlimStats() : docstrings(), lineTables() { }
+
+    int docstrings, lineTables;
+};
+
+/* Index of the docstring in the constants of code, or -1.  Modules and
+ * classes store it to __doc__ before any other name (except the ones class
+ * bodies start with), and functions keep it in consts[0], which is None if
+ * they have none.  The constant must not be used by any other instruction,
+ * since compilers merge equal constants. */
+static int docstring_index(PycRef<PycCode> code, PycModule* mod,
+                           const std::vector<Instruction>& instructions)
+{
+    int index = -1, storePos = -1;
+    for (size_t i = 1; i < instructions.size(); ++i) {
+        if (instructions[i].opcode != Pyc::STORE_NAME_A)
+            continue;
+        PycRef<PycString> name = code->getName(instructions[i].operand);
+        if (name->isEqual("__doc__")) {
+            if (instructions[i - 1].opcode == Pyc::LOAD_CONST_A) {
+                index = instructions[i - 1].operand;
+                storePos = instructions[i - 1].pos;
+            }
+            break;
+        }
+        if (!name->isEqual("__module__") && !name->isEqual("__qualname__")
+                && !name->isEqual("__firstlineno__"))
+            break;
+    }
+    if (index < 0 && (code->flags() & PycCode::CO_NEWLOCALS) && code->consts()->size() > 0)
+        index = 0;
+    if (index < 0 || index >= code->consts()->size()
+            || code->getConst(index).try_cast<PycString>() == nullptr)
+        return -1;
+
+    for (const auto& inst : instructions) {
+        if (inst.pos != storePos && inst.operand == index
+                && Pyc::GetOpcodeInfo(inst.opcode, mod).operand == Pyc::ARG_CONST)
+            return -1;
+    }
+    return index;
+}
+
+/* A line number table without any line numbers.  Before 3.10, an empty
+ * table puts all the code on the first line; since then, the table has to
+ * cover all of the code, or the interpreter won't find its positions. */
+static std::string empty_line_table(PycRef<PycCode> code, PycModule* mod)
+{
+    std::string table;
+    int size = code->code()->length();
+    if (mod->verCompare(3, 11) >= 0) {
+        // PY_CODE_LOCATION_INFO_NONE entries of up to 8 code units
+        for (int units = size / 2; units > 0; units -= 8)
+            table.push_back((char)(0xF8 | (std::min(units, 8) - 1)));
+    } else if (mod->verCompare(3, 10) >= 0) {
+        // Byte deltas of up to 254 with the line delta -128 (no line)
+        for (; size > 0; size -= 254) {
+            table.push_back((char)std::min(size, 254));
+            table.push_back((char)0x80);
+        }
+    }
+    return table;
+}
+
+static void slim_code(PycRef<PycCode> code, PycModule* mod, const SlimOptions& options,
+                      SlimStats& stats)
+{
+    for (const auto& obj : code->consts().cast<PycSimpleSequence>()->values()) {
+        if (obj.type() == PycObject::TYPE_CODE || obj.type() == PycObject::TYPE_CODE2)
+            slim_code(obj.cast<PycCode>(), mod, options, stats);
+    }
+
+    if (options.docstrings) {
+        int index = docstring_index(code, mod, decode_instructions(code, mod));
+        if (index >= 0) {
+            // The constants may be shared with other code objects
+            PycRef<PycSimpleSequence> consts = code->consts().cast<PycSimpleSequence>();
+            PycTuple::value_t values = consts->values();
+            values[index] = Pyc_None;
+            PycRef<PycTuple> stripped = new PycTuple(consts->type());
+            stripped->setValues(std::move(values));
+            code->setConsts(stripped.cast<PycSequence>());
+            ++stats.docstrings;
+        }
+    }
+
+    if (options.lineTables) {
+        std::string table = empty_line_table(code, mod);
+        if (code->lnTable()->strValue() != table) {
+            PycRef<PycString> stripped = new PycString(PycObject::TYPE_STRING);
+            stripped->setValue(std::move(table));
+            code->setLnTable(stripped);
+            ++stats.lineTables;
+        }
+    }
+}
+
+/* The header is copied as it is, since the source it refers to did not
+ * change */
+static int header_size(PycModule* mod)
+{
+    if (mod->verCompare(3, 7) >= 0)
+        return 16;
+    if (mod->verCompare(3, 3) >= 0)
+        return 12;
+    return 8;
+}
+
+static bool slim_file(const char* infile, const char* outfile, const SlimOptions& options)
+{
+    std::ifstream in(infile, std::ios_base::in | std::ios_base::binary);
+    if (!in) {
+        fprintf(stderr, "Error opening file %s\n", infile);
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    const std::string input = buffer.str();
+
+    std::string output;
+    SlimStats stats;
+    try {
+        PycModule mod;
+        mod.loadFromBuffer(input.data(), (int)input.size());
+        if (!mod.isValid() || mod.code() == nullptr) {
+            fprintf(stderr, "Could not load file %s\n", infile);
+            return false;
+        }
+
+        slim_code(mod.code(), &mod, options, stats);
+
+        PycMarshalWriter writer(mod.majorVer(), mod.minorVer());
+        writer.writeRaw(input.substr(0, header_size(&mod)));
+        if (options.share)
+            writer.shareObjects(mod.code().cast<PycObject>(), true);
+        writer.writeObject(mod.code().cast<PycObject>());
+        output = writer.data();
+
+        // Make sure the result can be read back
+        PycModule check;
+        check.loadFromBuffer(output.data(), (int)output.size());
+        if (check.code() == nullptr)
+            throw std::runtime_error("the rewritten file could not be loaded");
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error slimming %s: %s\n", infile, ex.what());
+        return false;
+    }
+
+    std::ofstream out(outfile, std::ios_base::out | std::ios_base::binary);
+    out.write(output.data(), output.size());
+    out.close();
+    if (out.fail()) {
+        fprintf(stderr, "Error writing file %s\n", outfile);
+        return false;
+    }
+
+    printf("%s: %d -> %d bytes (%d docstrings, %d line tables removed)\n", infile,
+           (int)input.size(), (int)output.size(), stats.docstrings, stats.lineTables);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    SlimOptions options;
+    const char* outfile = nullptr;
+    bool inPlace = false;
+    std::vector<const char*> infiles;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+            outfile = argv[++arg];
+        } else if (strcmp(argv[arg], "--in-place") == 0) {
+            inPlace = true;
+        } else if (strcmp(argv[arg], "--keep-docstrings") == 0) {
+            options.docstrings = false;
+        } else if (strcmp(argv[arg], "--keep-lines") == 0) {
+            options.lineTables = false;
+        } else if (strcmp(argv[arg], "--no-share") == 0) {
+            options.share = false;
+        } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
+            fprintf(stderr, "Usage:  %s [options] input.pyc -o output.pyc\n", argv[0]);
+            fprintf(stderr, "        %s [options] --in-place input.pyc...\n\n", argv[0]);
+            fputs("Options:\n", stderr);
+            fputs("  -o <filename>       Write the slimmed pyc to <filename>\n", stderr);
+            fputs("  --in-place          Overwrite the input files\n", stderr);
+            fputs("  --keep-docstrings   Don't strip docstrings\n", stderr);
+            fputs("  --keep-lines        Don't strip line number tables\n", stderr);
+            fputs("  --no-share          Don't share equal constants (Python 3.4+)\n", stderr);
+            fputs("  --help              Show this help text and then exit\n", stderr);
+            return 0;
+        } else if (argv[arg][0] == '-') {
+            fprintf(stderr, "Error: Unrecognized argument %s\n", argv[arg]);
+            return 1;
+        } else {
+            infiles.push_back(argv[arg]);
+        }
+    }
+
+    if (infiles.empty()) {
+        fputs("No input file specified\n", stderr);
+        return 1;
+    }
+    if (inPlace == (outfile != nullptr) || (outfile && infiles.size() > 1)) {
+        fputs("Specify either -o with one input file, or --in-place\n", stderr);
+        return 1;
+    }
+
+    int failures = 0;
+    for (const char* infile : infiles) {
+        if (!slim_file(infile, inPlace ? infile : outfile, options))
+            ++failures;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+#include "pyinstaller.h"
+#include "pyc_numeric.h"
+#include <cstring>
+#include <climits>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/* == CArchive layout ==
+   The archive is appended to the bootloader and ends with a cookie:
+
+   magic            char[8]     "MEI\014\013\012\013\016"
+   package length   uint32 BE   Length of the whole archive, cookie included
+   TOC offset       uint32 BE   Relative to the start of the archive
+   TOC length       uint32 BE
+   python version   uint32 BE   e.g. 27, 311
+   python library   char[64]    PyInstaller 2.1 ->
+
+   Each TOC entry is:
+
+   entry length     uint32 BE   Including the name padding
+   data offset      uint32 BE   Relative to the start of the archive
+   stored length    uint32 BE
+   raw length       uint32 BE
+   compressed       uint8       zlib
+   type code        char        See PyInstallerArchive::EntryType
+   name             char[]      NUL padded
+*/
+
+static const unsigned char s_cookieMagic[8] = { 'M', 'E', 'I', 014, 013, 012, 013, 016 };
+static const size_t COOKIE_SIZE_2_0 = 24;
+static const size_t COOKIE_SIZE_2_1 = COOKIE_SIZE_2_0 + 64;
+static const size_t TOC_ENTRY_HEADER = 18;
+
+static unsigned int get_be32(const unsigned char* data)
+{
+    return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16)
+         | ((unsigned int)data[2] << 8) | (unsigned int)data[3];
+}
+
+static unsigned int get_le32(const unsigned char* data)
+{
+    return ((unsigned int)data[3] << 24) | ((unsigned int)data[2] << 16)
+         | ((unsigned int)data[1] << 8) | (unsigned int)data[0];
+}
+
+static bool has_pylib_name(const unsigned char* name, size_t length)
+{
+    static const char pattern[] = "python";
+    const size_t plen = sizeof(pattern) - 1;
+    for (size_t start = 0; start + plen <= length && name[start]; ++start) {
+        size_t i = 0;
+        while (i < plen && (name[start + i] | 0x20) == pattern[i])
+            ++i;
+        if (i == plen)
+            return true;
+    }
+    return false;
+}
+
+static void inflate_into(const unsigned char* data, unsigned int length,
+                         unsigned int rawLength, std::vector<unsigned char>& buffer)
+{
+#ifdef HAVE_ZLIB
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+        throw std::runtime_error("Could not initialize zlib");
+
+    buffer.resize(rawLength ? rawLength : (size_t)length * 4 + 64);
+    zs.next_in = const_cast<Bytef*>(data);
+    zs.avail_in = length;
+    size_t produced = 0;
+    for (;;) {
+        if (produced == buffer.size())
+            buffer.resize(buffer.size() * 2);
+        zs.next_out = &buffer[produced];
+        zs.avail_out = (uInt)(buffer.size() - produced);
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        produced = buffer.size() - zs.avail_out;
+        if (ret == Z_STREAM_END)
+            break;
+        if ((ret != Z_OK && ret != Z_BUF_ERROR) || zs.avail_out != 0) {
+            inflateEnd(&zs);
+            throw std::runtime_error("Corrupt or truncated zlib stream");
+        }
+    }
+    inflateEnd(&zs);
+    buffer.resize(produced);
+#else
+    (void)data;
+    (void)length;
+    (void)rawLength;
+    (void)buffer;
+    throw std::runtime_error("Compressed entries require zlib support");
+#endif
+}
+
+PyInstallerArchive::PyInstallerArchive(const char* filename)
+    : m_file(filename), m_valid(false), m_maj(-1), m_min(-1)
+{
+    if (!m_file.isOpen()) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return;
+    }
+    if (!readCArchive()) {
+        fprintf(stderr, "%s is not a PyInstaller archive\n", filename);
+        return;
+    }
+    m_valid = true;
+
+    // PYZ members are appended behind the CArchive entries, so iterate by
+    // index over the entries present before expansion.
+    size_t count = m_entries.size();
+    for (size_t i = 0; i < count; ++i) {
+        if (m_entries[i].type == ENTRY_PYZ)
+            readPyz(m_entries[i]);
+    }
+}
+
+bool PyInstallerArchive::readCArchive()
+{
+    const unsigned char* base = m_file.data();
+    size_t size = m_file.size();
+    if (size < COOKIE_SIZE_2_0)
+        return false;
+
+    // The cookie is normally at the very end, but signing tools may append
+    // data after it, so search backwards through the whole file.
+    size_t cookie = size - sizeof(s_cookieMagic) + 1;
+    while (cookie-- > 0) {
+        if (base[cookie] == s_cookieMagic[0]
+                && memcmp(base + cookie, s_cookieMagic, sizeof(s_cookieMagic)) == 0)
+            break;
+    }
+    if (cookie == (size_t)-1 || cookie + COOKIE_SIZE_2_0 > size)
+        return false;
+
+    size_t cookieSize = COOKIE_SIZE_2_0;
+    if (cookie + COOKIE_SIZE_2_1 <= size
+            && has_pylib_name(base + cookie + COOKIE_SIZE_2_0, 64))
+        cookieSize = COOKIE_SIZE_2_1;
+
+    const unsigned char* cp = base + cookie + sizeof(s_cookieMagic);
+    size_t pkgLength = get_be32(cp);
+    size_t tocOffset = get_be32(cp + 4);
+    size_t tocLength = get_be32(cp + 8);
+    unsigned int pyver = get_be32(cp + 12);
+
+    if (pyver >= 100) {
+        m_maj = pyver / 100;
+        m_min = pyver % 100;
+    } else {
+        m_maj = pyver / 10;
+        m_min = pyver % 10;
+    }
+
+    // The package length covers the archive up to the end of the cookie
+    size_t overlayEnd = cookie + cookieSize;
+    if (pkgLength > overlayEnd)
+        return false;
+    size_t overlay = overlayEnd - pkgLength;
+    if (tocOffset > size - overlay || tocLength > size - overlay - tocOffset)
+        return false;
+
+    const unsigned char* toc = base + overlay + tocOffset;
+    const unsigned char* tocEnd = toc + tocLength;
+    while (toc + TOC_ENTRY_HEADER <= tocEnd) {
+        size_t entryLength = get_be32(toc);
+        if (entryLength < TOC_ENTRY_HEADER || entryLength > (size_t)(tocEnd - toc))
+            break;
+
+        Entry entry;
+        size_t offset = get_be32(toc + 4);
+        entry.length = get_be32(toc + 8);
+        entry.rawLength = get_be32(toc + 12);
+        entry.compressed = (toc[16] != 0);
+        entry.type = toc[17];
+        entry.inPyz = false;
+
+        const char* name = reinterpret_cast<const char*>(toc + TOC_ENTRY_HEADER);
+        size_t nameLength = 0;
+        while (nameLength < entryLength - TOC_ENTRY_HEADER && name[nameLength])
+            ++nameLength;
+        entry.name.assign(name, nameLength);
+        if (entry.name.empty())
+            entry.name = "unnamed_" + std::to_string(m_entries.size());
+
+        if (offset > size - overlay || entry.length > size - overlay - offset) {
+            fprintf(stderr, "Entry %s lies outside of the archive\n", entry.name.c_str());
+        } else {
+            entry.data = base + overlay + offset;
+            m_entries.emplace_back(std::move(entry));
+        }
+        toc += entryLength;
+    }
+
+    return true;
+}
+
+/* pyz is taken by value, since it lives in m_entries, which grows by the
+ * members found here */
+void PyInstallerArchive::readPyz(Entry pyz)
+{
+    const unsigned char* data = pyz.data;
+    size_t length = pyz.length;
+    std::vector<Entry> members;
+    try {
+        if (pyz.compressed) {
+            m_inflated.emplace_back();
+            inflate_into(pyz.data, pyz.length, pyz.rawLength, m_inflated.back());
+            data = m_inflated.back().data();
+            length = m_inflated.back().size();
+        }
+
+        // "PYZ\0", the pyc magic of the bundled interpreter, then the TOC offset
+        if (length < 12 || memcmp(data, "PYZ\0", 4) != 0)
+            throw std::runtime_error("Bad PYZ magic");
+
+        PycModule tocMod;
+        tocMod.setVersion(get_le32(data + 4));
+        if (!tocMod.isValid())
+            throw std::runtime_error("Unsupported Python version");
+        m_maj = tocMod.majorVer();
+        m_min = tocMod.minorVer();
+
+        size_t tocOffset = get_be32(data + 8);
+        if (tocOffset >= length || length - tocOffset > INT_MAX)
+            throw std::runtime_error("Bad TOC offset");
+        PycBuffer in(data + tocOffset, (int)(length - tocOffset));
+        PycRef<PycObject> toc = LoadObject(&in, &tocMod);
+
+        // The TOC is a dict (PyInstaller < 3.5) or a list of pairs, mapping
+        // the module name to (is_package / type code, offset, length)
+        std::vector<std::pair<PycRef<PycObject>, PycRef<PycObject>>> items;
+        if (toc.type() == PycObject::TYPE_DICT) {
+            for (const auto& item : toc.cast<PycDict>()->values())
+                items.emplace_back(std::get<0>(item), std::get<1>(item));
+        } else {
+            for (const auto& item : toc.cast<PycSimpleSequence>()->values()) {
+                PycRef<PycSequence> pair = item.cast<PycSequence>();
+                items.emplace_back(pair->get(0), pair->get(1));
+            }
+        }
+
+        for (const auto& item : items) {
+            PycRef<PycSequence> info = item.second.cast<PycSequence>();
+            int kind = info->get(0).cast<PycInt>()->value();
+            size_t offset = (unsigned int)info->get(1).cast<PycInt>()->value();
+            size_t entryLength = (unsigned int)info->get(2).cast<PycInt>()->value();
+
+            Entry entry;
+            entry.name = item.first.cast<PycString>()->strValue();
+            if (kind == 0)
+                entry.type = ENTRY_MODULE;
+            else if (kind == 1)
+                entry.type = ENTRY_PKG;
+            else
+                continue;   // Data files and namespace packages (PyInstaller 6)
+
+            if (offset > length || entryLength > length - offset) {
+                fprintf(stderr, "PYZ member %s lies outside of the archive\n",
+                        entry.name.c_str());
+                continue;
+            }
+            entry.compressed = true;
+            entry.inPyz = true;
+            entry.data = data + offset;
+            entry.length = (unsigned int)entryLength;
+            entry.rawLength = 0;
+            members.emplace_back(std::move(entry));
+        }
+    } catch (std::exception& ex) {
+        fprintf(stderr, "Error reading PYZ archive %s: %s\n", pyz.name.c_str(), ex.what());
+    }
+    // Members read before an error are still listed
+    m_entries.insert(m_entries.end(), std::make_move_iterator(members.begin()),
+                     std::make_move_iterator(members.end()));
+}
+
+void PyInstallerArchive::extract(const Entry& entry, std::vector<unsigned char>& buffer) const
+{
+    if (entry.compressed)
+        inflate_into(entry.data, entry.length, entry.rawLength, buffer);
+    else
+        buffer.assign(entry.data, entry.data + entry.length);
+}
+
+void PyInstallerArchive::loadModule(const Entry& entry, PycModule& mod,
+                                    std::vector<unsigned char>& buffer) const
+{
+    const unsigned char* data = entry.data;
+    size_t length = entry.length;
+    if (entry.compressed) {
+        extract(entry, buffer);
+        data = buffer.data();
+        length = buffer.size();
+    }
+    if (length > INT_MAX)
+        throw std::runtime_error("Entry too large");
+
+    // Depending on the PyInstaller version, modules may still carry their
+    // pyc header.  A bare marshalled code object never has "\r\n" here.
+    if (length >= 16 && data[2] == '\r' && data[3] == '\n')
+        mod.loadFromBuffer(data, (int)length);
+    else
+        mod.loadFromMarshalledBuffer(data, (int)length, m_maj, m_min);
+}
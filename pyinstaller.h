@@ -0,0 +1,74 @@
+#ifndef _PYC_PYINSTALLER_H
+#define _PYC_PYINSTALLER_H
+
+#include "data.h"
+#include "pyc_module.h"
+#include <list>
+#include <string>
+#include <vector>
+
+/* Reader for PyInstaller bundles: the CArchive appended to the bootloader
+ * executable, and the PYZ archive(s) stored inside it.  The bundle is
+ * memory-mapped, and entries are handed to PycModule straight from memory
+ * (inflating them first if needed) instead of being extracted to disk. */
+class PyInstallerArchive {
+public:
+    enum EntryType {
+        // CArchive type codes
+        ENTRY_MODULE = 'm',
+        ENTRY_PKG = 'M',
+        ENTRY_SCRIPT = 's',
+        ENTRY_PYZ = 'z',
+        ENTRY_ZIPFILE = 'Z',
+        ENTRY_BINARY = 'b',
+        ENTRY_DATA = 'x',
+        ENTRY_OPTION = 'o',
+        ENTRY_SPLASH = 'l',
+    };
+
+    struct Entry {
+        std::string name;
+        int type;                   // EntryType
+        bool compressed;
+        bool inPyz;                 // Member of a PYZ archive (always zlib)
+        const unsigned char* data;
+        unsigned int length;        // Stored length
+        unsigned int rawLength;     // Uncompressed length; 0 if unknown
+
+        bool isCode() const
+        {
+            return type == ENTRY_MODULE || type == ENTRY_PKG || type == ENTRY_SCRIPT;
+        }
+    };
+
+    PyInstallerArchive(const char* filename);
+
+    bool isValid() const { return m_valid; }
+
+    /* Python version the bundle was built for */
+    int majorVer() const { return m_maj; }
+    int minorVer() const { return m_min; }
+
+    /* CArchive entries, followed by the members of every PYZ archive */
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    /* Store the (inflated) contents of an entry in buffer.  The buffer may be
+     * reused across calls to avoid reallocation. */
+    void extract(const Entry& entry, std::vector<unsigned char>& buffer) const;
+
+    /* Load a code entry into mod.  Throws on malformed input. */
+    void loadModule(const Entry& entry, PycModule& mod,
+                    std::vector<unsigned char>& buffer) const;
+
+private:
+    bool readCArchive();
+    void readPyz(Entry pyz);
+
+    PycMappedFile m_file;
+    bool m_valid;
+    int m_maj, m_min;
+    std::vector<Entry> m_entries;
+    std::list<std::vector<unsigned char>> m_inflated;   // Compressed PYZs
+};
+
+#endif
@@ -0,0 +1,615 @@
+#include "synthpyc.h"
+#include "pyc_marshal.h"
+#include "codeflow.h"
+#include "bytecode.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+bool synth_supported_version(int major, int minor)
+{
+    return (major == 2 && minor == 7) || (major == 3 && (minor == 8 || minor == 11));
+}
+
+namespace {
+
+/* Byte of each Pyc::Opcode in one version */
+class OpcodeBytes {
+public:
+    OpcodeBytes(int major, int minor) : m_bytes(Pyc::PYC_LAST_OPCODE, -1)
+    {
+        for (int byte = 0; byte < 256; ++byte) {
+            int opcode = Pyc::ByteToOpcode(major, minor, byte);
+            if (opcode != Pyc::PYC_INVALID_OPCODE && m_bytes[opcode] < 0)
+                m_bytes[opcode] = byte;
+        }
+    }
+
+    int operator[](int opcode) const
+    {
+        if (m_bytes[opcode] < 0) {
+            throw std::logic_error(std::string(Pyc::OpcodeName(opcode))
+                                   + " does not exist in this version");
+        }
+        return m_bytes[opcode];
+    }
+
+private:
+    std::vector<int> m_bytes;
+};
+
+struct CodeInfo {
+    int argCount;
+    int flags;
+    std::vector<std::string> localNames;
+    std::string name;
+    int firstLine;
+};
+
+/* Assembler for the bytecode of one code object, with labels for jump
+ * targets and (since 3.11) a stack of exception handlers covering the
+ * instructions as they are emitted */
+class CodeBuilder {
+public:
+    CodeBuilder(PycModule* mod, const OpcodeBytes& bytes) : m_mod(mod), m_bytes(bytes) { }
+
+    void emit(int opcode, int operand = 0) { add(opcode, operand, -1); }
+    void jump(int opcode, int label) { add(opcode, 0, label); }
+
+    int label()
+    {
+        m_labels.push_back(-1);
+        return (int)m_labels.size() - 1;
+    }
+
+    void bind(int label) { m_labels[label] = (int)m_ops.size(); }
+
+    void pushHandler(int label, int depth, bool lasti)
+    {
+        m_handlers.push_back({ label, depth, lasti });
+        m_handlerStack.push_back((int)m_handlers.size() - 1);
+    }
+
+    void popHandler() { m_handlerStack.pop_back(); }
+
+    int addConst(const std::string& marshalled)
+    {
+        auto it = m_constIndex.find(marshalled);
+        if (it != m_constIndex.end())
+            return it->second;
+        m_consts.push_back(marshalled);
+        m_constIndex[marshalled] = (int)m_consts.size() - 1;
+        return (int)m_consts.size() - 1;
+    }
+
+    int constNone()
+    {
+        PycMarshalWriter out(m_mod->majorVer(), m_mod->minorVer());
+        out.writeNone();
+        return addConst(out.data());
+    }
+
+    int constInt(long long value)
+    {
+        PycMarshalWriter out(m_mod->majorVer(), m_mod->minorVer());
+        out.writeInt(value);
+        return addConst(out.data());
+    }
+
+    int constText(const std::string& value)
+    {
+        PycMarshalWriter out(m_mod->majorVer(), m_mod->minorVer());
+        out.writeText(value);
+        return addConst(out.data());
+    }
+
+    int name(const std::string& value)
+    {
+        auto it = m_nameIndex.find(value);
+        if (it != m_nameIndex.end())
+            return it->second;
+        m_names.push_back(value);
+        m_nameIndex[value] = (int)m_names.size() - 1;
+        return (int)m_names.size() - 1;
+    }
+
+    std::string marshal(const CodeInfo& info);
+
+private:
+    struct Op {
+        int opcode, operand;
+        int label;      // Jump target, or -1
+        int handler;    // Index in m_handlers, or -1
+    };
+
+    struct Handler {
+        int label, depth;
+        bool lasti;
+    };
+
+    void add(int opcode, int operand, int label)
+    {
+        m_ops.push_back({ opcode, operand, label,
+                          m_handlerStack.empty() ? -1 : m_handlerStack.back() });
+    }
+
+    int caches(int opcode) const { return Pyc::GetOpcodeInfo(opcode, m_mod).caches; }
+    int size(int opcode, int operand) const;
+    int jumpOperand(int opcode, int end, int target) const;
+    void assemble(std::string& code, std::vector<ExceptionTableEntry>& handlers);
+
+    PycModule* m_mod;
+    const OpcodeBytes& m_bytes;
+    std::vector<Op> m_ops;
+    std::vector<int> m_labels;      // Index of the instruction each label is bound to
+    std::vector<Handler> m_handlers;
+    std::vector<int> m_handlerStack;
+    std::vector<std::string> m_consts;  // Marshalled
+    std::map<std::string, int> m_constIndex;
+    std::vector<std::string> m_names;
+    std::map<std::string, int> m_nameIndex;
+};
+
+/* Bytes taken by an instruction, including EXTENDED_ARG and CACHE entries */
+int CodeBuilder::size(int opcode, int operand) const
+{
+    if (m_mod->verCompare(3, 6) >= 0) {
+        int units = 1;
+        for (unsigned int rest = (unsigned int)operand >> 8; rest != 0; rest >>= 8)
+            ++units;
+        return 2 * (units + caches(opcode));
+    }
+    if (opcode < Pyc::PYC_HAVE_ARG)
+        return 1;
+    return (operand > 0xFFFF) ? 6 : 3;
+}
+
+/* Operand for a jump ending at end (not counting its CACHE entries) to
+ * target, in whichever direction and unit the opcode uses */
+int CodeBuilder::jumpOperand(int opcode, int end, int target) const
+{
+    int base = Pyc::JumpTarget(opcode, 0, end, m_mod);
+    int unit = std::abs(Pyc::JumpTarget(opcode, 1, end, m_mod) - base);
+    int distance = (Pyc::GetOpcodeInfo(opcode, m_mod).operand == Pyc::ARG_JUMP_BACK)
+                 ? base - target : target - base;
+    if (distance < 0 || distance % unit != 0)
+        throw std::logic_error(std::string("Cannot encode jump of ") + Pyc::OpcodeName(opcode));
+    return distance / unit;
+}
+
+void CodeBuilder::assemble(std::string& code, std::vector<ExceptionTableEntry>& handlers)
+{
+    // Jump operands and instruction sizes depend on each other, so repeat
+    // the layout until it stops changing (sizes only ever grow)
+    std::vector<int> operands(m_ops.size());
+    std::vector<int> pos(m_ops.size() + 1, 0);
+    for (size_t i = 0; i < m_ops.size(); ++i)
+        operands[i] = m_ops[i].operand;
+    for (bool changed = true; changed; ) {
+        for (size_t i = 0; i < m_ops.size(); ++i)
+            pos[i + 1] = pos[i] + size(m_ops[i].opcode, operands[i]);
+
+        changed = false;
+        for (size_t i = 0; i < m_ops.size(); ++i) {
+            const Op& op = m_ops[i];
+            if (op.label < 0)
+                continue;
+            int end = pos[i + 1] - 2 * caches(op.opcode);
+            int operand = jumpOperand(op.opcode, end, pos[m_labels[op.label]]);
+            if (operand != operands[i]) {
+                operands[i] = operand;
+                changed = true;
+            }
+        }
+    }
+
+    code.clear();
+    code.reserve(pos.back());
+    for (size_t i = 0; i < m_ops.size(); ++i) {
+        int opcode = m_ops[i].opcode;
+        unsigned int operand = (unsigned int)operands[i];
+        if (m_mod->verCompare(3, 6) >= 0) {
+            int shift = (size(opcode, operands[i]) / 2 - caches(opcode) - 1) * 8;
+            for (; shift > 0; shift -= 8) {
+                code.push_back((char)m_bytes[Pyc::EXTENDED_ARG_A]);
+                code.push_back((char)((operand >> shift) & 0xFF));
+            }
+            code.push_back((char)m_bytes[opcode]);
+            code.push_back((char)(operand & 0xFF));
+            if (caches(opcode) > 0)
+                code.append(2 * caches(opcode), (char)m_bytes[Pyc::CACHE]);
+        } else {
+            if (operand > 0xFFFF) {
+                code.push_back((char)m_bytes[Pyc::EXTENDED_ARG_A]);
+                code.push_back((char)((operand >> 16) & 0xFF));
+                code.push_back((char)((operand >> 24) & 0xFF));
+            }
+            code.push_back((char)m_bytes[opcode]);
+            if (opcode >= Pyc::PYC_HAVE_ARG) {
+                code.push_back((char)(operand & 0xFF));
+                code.push_back((char)((operand >> 8) & 0xFF));
+            }
+        }
+    }
+
+    // One entry per run of instructions with the same handler
+    handlers.clear();
+    for (size_t i = 0; i < m_ops.size(); ) {
+        int handler = m_ops[i].handler;
+        size_t start = i;
+        while (i < m_ops.size() && m_ops[i].handler == handler)
+            ++i;
+        if (handler < 0)
+            continue;
+        const Handler& info = m_handlers[handler];
+        handlers.push_back({ pos[start], pos[i], pos[m_labels[info.label]],
+                             info.depth, info.lasti });
+    }
+}
+
+static void write_exception_varint(std::string& out, int value, int mark)
+{
+    int shift = 0;
+    while ((value >> shift) >= 64)
+        shift += 6;
+    for (; shift > 0; shift -= 6) {
+        out.push_back((char)(mark | 0x40 | ((value >> shift) & 0x3F)));
+        mark = 0;
+    }
+    out.push_back((char)(mark | (value & 0x3F)));
+}
+
+std::string CodeBuilder::marshal(const CodeInfo& info)
+{
+    std::string code;
+    std::vector<ExceptionTableEntry> handlers;
+    assemble(code, handlers);
+
+    // The same analysis pycdas --stack-depth shows
+    StackDepth depth = analyze_stack_depth(decode_instructions(code.data(), (int)code.size(), m_mod),
+                                           handlers, m_mod);
+    if (!depth.bounded || depth.underflowPos >= 0)
+        throw std::logic_error("Generated code of " + info.name + " has an invalid stack");
+
+    std::string exceptTable;
+    for (const auto& entry : handlers) {
+        write_exception_varint(exceptTable, entry.start / 2, 0x80);
+        write_exception_varint(exceptTable, (entry.end - entry.start) / 2, 0);
+        write_exception_varint(exceptTable, entry.target / 2, 0);
+        write_exception_varint(exceptTable, (entry.depth << 1) | (entry.lasti ? 1 : 0), 0);
+    }
+
+    PycCodeCounts counts;
+    counts.argCount = info.argCount;
+    counts.numLocals = (int)info.localNames.size();
+    counts.stackSize = depth.maxDepth;
+    counts.flags = info.flags;
+    counts.firstLine = info.firstLine;
+
+    PycMarshalWriter out(m_mod->majorVer(), m_mod->minorVer());
+    auto writeNames = [&out](const std::vector<std::string>& names) {
+        out.writeTupleHeader((int)names.size());
+        for (const auto& name : names)
+            out.writeText(name);
+    };
+    out.writeCode(counts, [&](PycCodeField field) {
+        switch (field) {
+        case CODE_BYTES:
+            out.writeBytes(code);
+            break;
+        case CODE_CONSTS:
+            out.writeTupleHeader((int)m_consts.size());
+            for (const auto& value : m_consts)
+                out.writeRaw(value);
+            break;
+        case CODE_NAMES:
+            writeNames(m_names);
+            break;
+        case CODE_LOCAL_NAMES:
+            writeNames(info.localNames);
+            break;
+        case CODE_LOCAL_KINDS:
+            out.writeBytes(std::string(info.localNames.size(), (char)0x20));    // CO_FAST_LOCAL
+            break;
+        case CODE_FREE_VARS:
+        case CODE_CELL_VARS:
+            out.writeTupleHeader(0);
+            break;
+        case CODE_FILE_NAME:
+            out.writeText("<synth>");
+            break;
+        case CODE_NAME:
+        case CODE_QUAL_NAME:
+            out.writeText(info.name);
+            break;
+        case CODE_LN_TABLE:
+            out.writeBytes(std::string());
+            break;
+        case CODE_EXCEPT_TABLE:
+            out.writeBytes(exceptTable);
+            break;
+        }
+    });
+    return out.data();
+}
+
+class Generator {
+public:
+    Generator(const SynthOptions& opts, std::string* source)
+        : m_opts(opts), m_bytes(opts.major, opts.minor), m_source(source), m_line(0)
+    {
+        m_mod.setVersion(PycModule::versionMagic(opts.major, opts.minor));
+        m_hasExceptionTable = m_mod.verCompare(3, 11) >= 0;
+        m_jumpIfFalse = m_hasExceptionTable ? Pyc::POP_JUMP_FORWARD_IF_FALSE_A
+                                            : Pyc::POP_JUMP_IF_FALSE_A;
+    }
+
+    std::string module();
+
+private:
+    void line(int indent, const std::string& text)
+    {
+        ++m_line;
+        if (m_source) {
+            m_source->append(4 * indent, ' ');
+            *m_source += text;
+            m_source->push_back('\n');
+        }
+    }
+
+    void begin(CodeBuilder& code)
+    {
+        if (m_hasExceptionTable)
+            code.emit(Pyc::RESUME_A, 0);
+    }
+
+    void store(CodeBuilder& code, const std::string& name, long long value)
+    {
+        code.emit(Pyc::LOAD_CONST_A, code.constInt(value));
+        code.emit(Pyc::STORE_NAME_A, code.name(name));
+    }
+
+    void functions(CodeBuilder& code);
+    void nesting(CodeBuilder& code);
+    void dict(CodeBuilder& code);
+    void string(CodeBuilder& code);
+    void elifChain(CodeBuilder& code);
+    void tryNesting(CodeBuilder& code);
+
+    const SynthOptions& m_opts;
+    OpcodeBytes m_bytes;
+    PycModule m_mod;
+    bool m_hasExceptionTable;
+    int m_jumpIfFalse;
+    std::string* m_source;
+    int m_line;
+};
+
+static std::string format(const char* fmt, long long value)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), fmt, value);
+    return buffer;
+}
+
+void Generator::functions(CodeBuilder& code)
+{
+    for (int i = 0; i < m_opts.functions; ++i) {
+        std::string name = format("f%lld", i);
+        CodeInfo info = { 2, PycCode::CO_OPTIMIZED | PycCode::CO_NEWLOCALS, { "a", "b" },
+                          name, m_line + 1 };
+        if (!m_hasExceptionTable)
+            info.flags |= PycCode::CO_NOFREE;
+        line(0, "def " + name + "(a, b):");
+        line(1, format("return a + b * %lld", i));
+
+        CodeBuilder func(&m_mod, m_bytes);
+        begin(func);
+        func.constNone();   // No docstring
+        func.emit(Pyc::LOAD_FAST_A, 0);
+        func.emit(Pyc::LOAD_FAST_A, 1);
+        func.emit(Pyc::LOAD_CONST_A, func.constInt(i));
+        if (m_hasExceptionTable) {
+            func.emit(Pyc::BINARY_OP_A, 5);     // *
+            func.emit(Pyc::BINARY_OP_A, 0);     // +
+        } else {
+            func.emit(Pyc::BINARY_MULTIPLY);
+            func.emit(Pyc::BINARY_ADD);
+        }
+        func.emit(Pyc::RETURN_VALUE);
+
+        code.emit(Pyc::LOAD_CONST_A, code.addConst(func.marshal(info)));
+        if (m_mod.verCompare(3, 3) >= 0 && !m_hasExceptionTable)
+            code.emit(Pyc::LOAD_CONST_A, code.constText(name));     // Qualified name
+        code.emit(Pyc::MAKE_FUNCTION_A, 0);
+        code.emit(Pyc::STORE_NAME_A, code.name(name));
+    }
+}
+
+void Generator::nesting(CodeBuilder& code)
+{
+    int end = code.label();
+    for (int i = 0; i < m_opts.nesting; ++i) {
+        std::string name = format("x%lld", i);
+        line(i, "if " + name + ":");
+        code.emit(Pyc::LOAD_NAME_A, code.name(name));
+        code.jump(m_jumpIfFalse, end);
+    }
+    line(m_opts.nesting, "y = 1");
+    store(code, "y", 1);
+    code.bind(end);
+}
+
+void Generator::dict(CodeBuilder& code)
+{
+    std::string text = "d = {";
+    for (int i = 0; i < m_opts.dictEntries; ++i) {
+        if (i > 0)
+            text += ", ";
+        text += format("'k%lld': ", i) + format("%lld", i);
+    }
+    line(0, text + "}");
+
+    if (m_mod.majorVer() < 3) {
+        code.emit(Pyc::BUILD_MAP_A, std::min(m_opts.dictEntries, 0xFFFF));
+        for (int i = 0; i < m_opts.dictEntries; ++i) {
+            code.emit(Pyc::LOAD_CONST_A, code.constInt(i));
+            code.emit(Pyc::LOAD_CONST_A, code.constText(format("k%lld", i)));
+            code.emit(Pyc::STORE_MAP);
+        }
+    } else {
+        PycMarshalWriter keys(m_mod.majorVer(), m_mod.minorVer());
+        keys.writeTupleHeader(m_opts.dictEntries);
+        for (int i = 0; i < m_opts.dictEntries; ++i) {
+            code.emit(Pyc::LOAD_CONST_A, code.constInt(i));
+            keys.writeText(format("k%lld", i));
+        }
+        code.emit(Pyc::LOAD_CONST_A, code.addConst(keys.data()));
+        code.emit(Pyc::BUILD_CONST_KEY_MAP_A, m_opts.dictEntries);
+    }
+    code.emit(Pyc::STORE_NAME_A, code.name("d"));
+}
+
+void Generator::string(CodeBuilder& code)
+{
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz";
+    std::string value(m_opts.stringBytes, ' ');
+    for (int i = 0; i < m_opts.stringBytes; ++i)
+        value[i] = alphabet[i % 26];
+    line(0, "s = '" + value + "'");
+
+    code.emit(Pyc::LOAD_CONST_A, code.constText(value));
+    code.emit(Pyc::STORE_NAME_A, code.name("s"));
+}
+
+void Generator::elifChain(CodeBuilder& code)
+{
+    int end = code.label();
+    for (int i = 0; i < m_opts.elifChain; ++i) {
+        line(0, format(i == 0 ? "if x == %lld:" : "elif x == %lld:", i));
+        line(1, format("y = %lld", i));
+
+        int next = code.label();
+        code.emit(Pyc::LOAD_NAME_A, code.name("x"));
+        code.emit(Pyc::LOAD_CONST_A, code.constInt(i));
+        code.emit(Pyc::COMPARE_OP_A, 2);    // ==
+        code.jump(m_jumpIfFalse, next);
+        store(code, "y", i);
+        code.jump(Pyc::JUMP_FORWARD_A, end);
+        code.bind(next);
+    }
+    line(0, "else:");
+    line(1, "y = -1");
+    store(code, "y", -1);
+    code.bind(end);
+}
+
+void Generator::tryNesting(CodeBuilder& code)
+{
+    std::vector<int> handlers;
+    for (int i = 0; i < m_opts.tryNesting; ++i) {
+        line(i, "try:");
+        handlers.push_back(code.label());
+        if (m_hasExceptionTable) {
+            code.pushHandler(handlers.back(), 0, false);
+            code.emit(Pyc::NOP);
+        } else if (m_mod.majorVer() < 3) {
+            code.jump(Pyc::SETUP_EXCEPT_A, handlers.back());
+        } else {
+            code.jump(Pyc::SETUP_FINALLY_A, handlers.back());
+        }
+    }
+    line(m_opts.tryNesting, "z = 1");
+    store(code, "z", 1);
+
+    // except ValueError: pass, innermost first
+    for (int i = m_opts.tryNesting - 1; i >= 0; --i) {
+        line(i, "except ValueError:");
+        line(i + 1, "pass");
+
+        int end = code.label();
+        int reraise = code.label();
+        if (m_hasExceptionTable) {
+            int cleanup = code.label();
+            code.popHandler();
+            code.jump(Pyc::JUMP_FORWARD_A, end);
+            code.bind(handlers[i]);
+            code.pushHandler(cleanup, 1, true);
+            code.emit(Pyc::PUSH_EXC_INFO);
+            code.emit(Pyc::LOAD_NAME_A, code.name("ValueError"));
+            code.emit(Pyc::CHECK_EXC_MATCH);
+            code.jump(m_jumpIfFalse, reraise);
+            code.emit(Pyc::POP_TOP);
+            code.popHandler();
+            code.emit(Pyc::POP_EXCEPT);
+            code.jump(Pyc::JUMP_FORWARD_A, end);
+            code.bind(reraise);
+            code.pushHandler(cleanup, 1, true);
+            code.emit(Pyc::RERAISE_A, 0);
+            code.popHandler();
+            code.bind(cleanup);
+            code.emit(Pyc::COPY_A, 3);
+            code.emit(Pyc::POP_EXCEPT);
+            code.emit(Pyc::RERAISE_A, 1);
+        } else {
+            code.emit(Pyc::POP_BLOCK);
+            code.jump(Pyc::JUMP_FORWARD_A, end);
+            code.bind(handlers[i]);
+            code.emit(Pyc::DUP_TOP);
+            code.emit(Pyc::LOAD_NAME_A, code.name("ValueError"));
+            code.emit(Pyc::COMPARE_OP_A, 10);   // Exception match
+            code.jump(m_jumpIfFalse, reraise);
+            code.emit(Pyc::POP_TOP);
+            code.emit(Pyc::POP_TOP);
+            code.emit(Pyc::POP_TOP);
+            if (m_mod.majorVer() >= 3)
+                code.emit(Pyc::POP_EXCEPT);
+            code.jump(Pyc::JUMP_FORWARD_A, end);
+            code.bind(reraise);
+            code.emit(Pyc::END_FINALLY);
+        }
+        code.bind(end);
+    }
+}
+
+std::string Generator::module()
+{
+    CodeBuilder code(&m_mod, m_bytes);
+    begin(code);
+    if (m_opts.functions > 0)
+        functions(code);
+    if (m_opts.nesting > 0)
+        nesting(code);
+    if (m_opts.dictEntries > 0)
+        dict(code);
+    if (m_opts.stringBytes > 0)
+        string(code);
+    if (m_opts.elifChain > 0)
+        elifChain(code);
+    if (m_opts.tryNesting > 0)
+        tryNesting(code);
+    code.emit(Pyc::LOAD_CONST_A, code.constNone());
+    code.emit(Pyc::RETURN_VALUE);
+
+    CodeInfo info = { 0, m_hasExceptionTable ? 0 : PycCode::CO_NOFREE, { }, "<module>", 1 };
+    PycMarshalWriter out(m_mod.majorVer(), m_mod.minorVer());
+    out.writePycHeader();
+    out.writeRaw(code.marshal(info));
+    return out.data();
+}
+
+}
+
+std::string synth_pyc(const SynthOptions& opts, std::string* source)
+{
+    if (!synth_supported_version(opts.major, opts.minor))
+        throw std::invalid_argument("Unsupported version for generated code");
+    if (source)
+        source->clear();
+
+    Generator generator(opts, source);
+    return generator.module();
+}
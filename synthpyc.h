@@ -0,0 +1,34 @@
+#ifndef _PYC_SYNTHPYC_H
+#define _PYC_SYNTHPYC_H
+
+#include <string>
+
+/* Size of each construct in a generated module.  Each one is a separate
+ * top-level statement (or group of them), and is left out when zero. */
+struct SynthOptions {
+    SynthOptions()
+        : major(3), minor(11), functions(0), nesting(0), dictEntries(0),
+          stringBytes(0), elifChain(0), tryNesting(0) { }
+
+    int major, minor;
+    int functions;      // def f<i>(a, b): return a + b * <i>
+    int nesting;        // if x0: if x1: ... y = 1
+    int dictEntries;    // d = {'k0': 0, 'k1': 1, ...}
+    int stringBytes;    // s = 'abcd...'
+    int elifChain;      // if x == 0: y = 0 / elif x == 1: y = 1 / ... / else: y = -1
+    int tryNesting;     // try: try: ... z = 1 / except ValueError: pass
+};
+
+/* Whether synth_pyc() can generate code for this version */
+bool synth_supported_version(int major, int minor);
+
+/* Assembles a pyc file of the module described by opts, laid out the way
+ * CPython compiles it, without needing that version of Python.  If source
+ * is not null, it receives the equivalent Python source.
+ *
+ * Versions before 3.11 only run up to 20 nested try blocks (CO_MAXBLOCKS),
+ * though the pyc is still well-formed with more.
+ * Throws std::invalid_argument for unsupported versions. */
+std::string synth_pyc(const SynthOptions& opts, std::string* source = nullptr);
+
+#endif
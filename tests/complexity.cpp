@@ -0,0 +1,246 @@
+/* Complexity regression test.
+ *
+ * Decompiles generated modules (see synthpyc.h) of doubling size, for each
+ * construct and Python version, and fits the growth exponent of the time
+ * and peak allocated memory: 1 means linear, 2 quadratic.  Fixed-size tests
+ * don't show quadratic behaviour, but this does.  Exits with 1 if any
+ * exponent is above its limit.
+ *
+ * Sizes are measured as input plus output bytes, since some output is
+ * inherently quadratic in the construct count (every line of n nested
+ * blocks is indented by up to n levels).
+ *
+ *   complexity_test [--steps <n>] [--max-time-exponent <x>]
+ *                   [--max-alloc-exponent <x>] [filter...]
+ *
+ * Only cases whose name (e.g. "elif/3.8") contains one of the filters are
+ * run. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include "ASTree.h"
+#include "synthpyc.h"
+
+/* Peak tracking of live allocated bytes; the test runs on a single thread */
+static size_t s_liveBytes = 0;
+static size_t s_peakBytes = 0;
+
+/* Each block starts with its size, so that it can be subtracted when freed */
+static const size_t HEADER_SIZE = 16;
+
+static void* tracked_alloc(size_t size)
+{
+    void* block = malloc(size + HEADER_SIZE);
+    if (!block)
+        throw std::bad_alloc();
+    *(size_t*)block = size;
+    s_liveBytes += size;
+    if (s_liveBytes > s_peakBytes)
+        s_peakBytes = s_liveBytes;
+    return (char*)block + HEADER_SIZE;
+}
+
+static void tracked_free(void* ptr)
+{
+    if (!ptr)
+        return;
+    void* block = (char*)ptr - HEADER_SIZE;
+    s_liveBytes -= *(size_t*)block;
+    free(block);
+}
+
+void* operator new(size_t size) { return tracked_alloc(size); }
+void* operator new[](size_t size) { return tracked_alloc(size); }
+void operator delete(void* ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { tracked_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { tracked_free(ptr); }
+
+/* Counts and discards the decompiled source */
+class CountingBuf : public std::streambuf {
+public:
+    CountingBuf() : m_count() { }
+
+    size_t count() const { return m_count; }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        ++m_count;
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+        m_count += (size_t)count;
+        return count;
+    }
+
+private:
+    size_t m_count;
+};
+
+struct Construct {
+    const char* name;
+    int SynthOptions::* count;
+    int firstSize;          // Large enough that fixed costs don't dominate
+};
+
+static const Construct s_constructs[] = {
+    { "functions", &SynthOptions::functions,   250 },
+    { "nesting",   &SynthOptions::nesting,     100 },
+    { "dict",      &SynthOptions::dictEntries, 1000 },
+    { "string",    &SynthOptions::stringBytes, 1 << 16 },
+    { "elif",      &SynthOptions::elifChain,   125 },
+    { "try",       &SynthOptions::tryNesting,   40 },
+};
+
+static const int s_versions[][2] = { { 2, 7 }, { 3, 8 }, { 3, 11 } };
+
+struct Sample {
+    double bytes;       // Input and output
+    double seconds;
+    double peakBytes;
+};
+
+/* Best time of several runs (the least disturbed one), and the peak of
+ * the memory allocated by loading and decompiling */
+static Sample measure(const std::string& pyc)
+{
+    using clock = std::chrono::steady_clock;
+
+    Sample sample = { 0, 1e30, 0 };
+    double total = 0;
+    for (int run = 0; run < 5 || (total < 0.2 && run < 1000); ++run) {
+        CountingBuf counter;
+        std::ostream output(&counter);
+        size_t baseline = s_liveBytes;
+        s_peakBytes = baseline;
+        auto start = clock::now();
+        {
+            PycModule mod;
+            mod.loadFromBuffer(pyc.data(), (int)pyc.size());
+            decompyle(mod.code(), &mod, output);
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        total += seconds;
+        if (seconds < sample.seconds)
+            sample.seconds = seconds;
+        sample.bytes = (double)(pyc.size() + counter.count());
+        sample.peakBytes = (double)(s_peakBytes - baseline);
+    }
+    return sample;
+}
+
+/* Least-squares slope of log(y) against log(x) */
+static double growth_exponent(const std::vector<double>& x, const std::vector<double>& y)
+{
+    double n = (double)x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+        double lx = std::log(x[i]), ly = std::log(y[i]);
+        sx += lx;
+        sy += ly;
+        sxx += lx * lx;
+        sxy += lx * ly;
+    }
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+int main(int argc, char* argv[])
+{
+    int steps = 5;
+    double maxTimeExponent = 1.4;
+    double maxAllocExponent = 1.2;
+    std::vector<std::string> filters;
+
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "--steps") == 0 && arg + 1 < argc) {
+            steps = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "--max-time-exponent") == 0 && arg + 1 < argc) {
+            maxTimeExponent = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--max-alloc-exponent") == 0 && arg + 1 < argc) {
+            maxAllocExponent = atof(argv[++arg]);
+        } else if (strcmp(argv[arg], "--help") == 0 || strcmp(argv[arg], "-h") == 0) {
+            fprintf(stderr, "Usage:  %s [options] [filter...]\n\n", argv[0]);
+            fputs("Options:\n", stderr);
+            fputs("  --steps <n>               Number of doublings of each size (default: 5)\n", stderr);
+            fputs("  --max-time-exponent <x>   Fail if time grows faster than size^x\n", stderr);
+            fputs("                            (default: 1.4)\n", stderr);
+            fputs("  --max-alloc-exponent <x>  Fail if peak memory grows faster than size^x\n", stderr);
+            fputs("                            (default: 1.2)\n", stderr);
+            fputs("  --help                    Show this help text and then exit\n", stderr);
+            return 0;
+        } else if (argv[arg][0] == '-') {
+            fprintf(stderr, "Error: Unrecognized argument %s\n", argv[arg]);
+            return 1;
+        } else {
+            filters.push_back(argv[arg]);
+        }
+    }
+    if (steps < 3) {
+        fputs("At least 3 steps are needed to fit an exponent\n", stderr);
+        return 1;
+    }
+
+    // The decompiler reports incomplete output on stderr; that is expected
+    // for some of the generated constructs
+#ifdef WIN32
+    const char* nullDevice = "NUL";
+#else
+    const char* nullDevice = "/dev/null";
+#endif
+    if (!freopen(nullDevice, "w", stderr))
+        fputs("Warning: could not silence stderr\n", stdout);
+
+    printf("%-16s %10s %12s %12s %8s %8s\n", "case", "max count", "max time",
+           "max memory", "time^", "memory^");
+
+    int failures = 0;
+    for (const auto& version : s_versions) {
+        for (const auto& construct : s_constructs) {
+            char name[64];
+            snprintf(name, sizeof(name), "%s/%d.%d", construct.name, version[0], version[1]);
+            bool selected = filters.empty();
+            for (const auto& filter : filters)
+                selected = selected || strstr(name, filter.c_str()) != nullptr;
+            if (!selected)
+                continue;
+
+            std::vector<double> bytes, times, peaks;
+            for (int step = 0; step < steps; ++step) {
+                SynthOptions opts;
+                opts.major = version[0];
+                opts.minor = version[1];
+                opts.*construct.count = construct.firstSize << step;
+
+                Sample sample = measure(synth_pyc(opts));
+                bytes.push_back(sample.bytes);
+                times.push_back(sample.seconds);
+                peaks.push_back(sample.peakBytes);
+            }
+
+            double timeExponent = growth_exponent(bytes, times);
+            double allocExponent = growth_exponent(bytes, peaks);
+            bool failed = timeExponent > maxTimeExponent || allocExponent > maxAllocExponent;
+            printf("%-16s %10d %10.2fms %10.0fKB %8.2f %8.2f%s\n", name,
+                   construct.firstSize << (steps - 1),
+                   times.back() * 1000, peaks.back() / 1024, timeExponent, allocExponent,
+                   failed ? "  FAILED" : "");
+            fflush(stdout);
+            if (failed)
+                ++failures;
+        }
+    }
+
+    if (failures) {
+        printf("%d case(s) grew faster than the limits\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+# The compiled module is hand-assembled: the unreachable JUMP_FORWARD after
+# "return 1" jumps into the middle of an instruction, and the unreachable
+# "return None" at the end is replaced with invalid opcodes.  Both dead
+# ranges must be skipped, including the second one after the first was
+# stepped over by the RETURN_VALUE handler.
+def f(x, y):
+    if x:
+        return 1
+    else:
+        a = 2
+    if y:
+        return 3
+    else:
+        return 4
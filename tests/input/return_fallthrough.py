@@ -0,0 +1,21 @@
+# The statement after an if block that ends in a return or raise must keep
+# its first instruction, which the jump out of the block targets.
+def f(a):
+    if a:
+        return
+    x = 2
+    return x
+
+def g(a):
+    if a:
+        return 1
+    else:
+        y = 3
+    x = 2
+    return x + y
+
+def h(a):
+    if a:
+        raise ValueError
+    x = 2
+    return x
@@ -0,0 +1,210 @@
+#!/usr/bin/env python3
+
+"""
+Round trips over tests/compiled that check the formats pycdc writes itself:
+
+  slim  pycslim --keep-docstrings --keep-lines must not change the output of
+        pycdc for any module (this exercises the marshal writer)
+  pack  a --batch --pack run must hold the same outputs as a run into an
+        output directory, and a rerun with the manifest must skip them all;
+        a run appending to a pack that is killed after writing some
+        records must leave them to be recovered by the next run
+
+Usage: roundtrip.py {slim|pack} <directory of the built tools>
+"""
+
+import os
+import sys
+import glob
+import time
+import shutil
+import signal
+import struct
+import tempfile
+import subprocess
+
+TEST_DIR = os.path.dirname(os.path.realpath(__file__))
+COMPILED_DIR = os.path.join(TEST_DIR, 'compiled')
+
+
+def run(args, cwd=None):
+    return subprocess.run(args, cwd=cwd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+
+def check_slim(tools, workdir):
+    pycdc = os.path.join(tools, 'pycdc')
+    pycslim = os.path.join(tools, 'pycslim')
+    slimdir = os.path.join(workdir, 'slim')
+    os.makedirs(slimdir)
+
+    fails = 0
+    pyc_files = sorted(glob.glob(os.path.join(COMPILED_DIR, '*.pyc')))
+    for pyc_file in pyc_files:
+        name = os.path.basename(pyc_file)
+        slim_file = os.path.join(slimdir, name)
+        proc = run([pycslim, '--keep-docstrings', '--keep-lines', pyc_file, '-o', slim_file])
+        if proc.returncode != 0:
+            print('{}: pycslim failed\n{}'.format(name, proc.stderr.decode(errors='replace')))
+            fails += 1
+            continue
+
+        # Run both from their own directory, so messages name the same file
+        expect = run([pycdc, name], cwd=COMPILED_DIR)
+        actual = run([pycdc, name], cwd=slimdir)
+        if (expect.returncode, expect.stdout, expect.stderr) \
+                != (actual.returncode, actual.stdout, actual.stderr):
+            print('{}: pycdc output differs after pycslim'.format(name))
+            fails += 1
+
+    print('slim: {} of {} modules round-tripped'.format(len(pyc_files) - fails, len(pyc_files)))
+    return fails
+
+
+def check_pack(tools, workdir):
+    pycdc = os.path.join(tools, 'pycdc')
+    pycpack = os.path.join(tools, 'pycpack')
+    pack = os.path.join(workdir, 'out.pack')
+    manifest = os.path.join(workdir, 'results.jsonl')
+    outdir = os.path.join(workdir, 'out')
+
+    run([pycdc, '--batch', COMPILED_DIR, '-o', outdir])
+    proc = run([pycdc, '--batch', COMPILED_DIR, '--pack', pack, '--manifest', manifest])
+    if not os.path.exists(pack):
+        print('pack: no pack written\n{}'.format(proc.stderr.decode(errors='replace')))
+        return 1
+
+    expect = sorted(os.path.relpath(os.path.join(root, name), outdir).replace(os.sep, '/')
+                    for root, _, names in os.walk(outdir) for name in names)
+    listing = run([pycpack, 'list', pack]).stdout.decode(errors='replace')
+    names = sorted(line.split(None, 3)[3] for line in listing.splitlines())
+    if names != expect:
+        print('pack: entries differ from the output directory')
+        print('  missing: {}'.format(sorted(set(expect) - set(names))))
+        print('  extra:   {}'.format(sorted(set(names) - set(expect))))
+        return 1
+
+    fails = 0
+    for name in names:
+        with open(os.path.join(outdir, name), 'rb') as out_file:
+            if run([pycpack, 'cat', pack, name]).stdout != out_file.read():
+                print('{}: pack entry differs from the output file'.format(name))
+                fails += 1
+
+    proc = run([pycdc, '--batch', COMPILED_DIR, '--pack', pack, '--manifest', manifest])
+    skipped = 'Skipping {} files already done'.format(len(names))
+    if skipped not in proc.stderr.decode(errors='replace'):
+        print('pack: rerun did not skip all {} files'.format(len(names)))
+        fails += 1
+    if run([pycpack, 'list', pack]).stdout.decode(errors='replace') != listing:
+        print('pack: rerun changed the pack')
+        fails += 1
+
+    if hasattr(os, 'mkfifo'):
+        fails += check_pack_crash(tools, workdir)
+
+    print('pack: {} of {} entries round-tripped'.format(len(names) - fails, len(names)))
+    return fails
+
+
+def pack_names(pycpack, pack):
+    listing = run([pycpack, 'list', pack]).stdout.decode(errors='replace')
+    return sorted(line.split(None, 3)[3] for line in listing.splitlines())
+
+
+def write_pack(path, entries):
+    """ Writes a complete pack (see outpack.h) of (name, data) pairs """
+    with open(path, 'wb') as pack:
+        pack.write(b'PYCPACK\n' + struct.pack('<II', 1, 0))
+        index = []
+        for name, data in entries:
+            name = name.encode()
+            pack.write(struct.pack('<QQII', len(data), 0, 0, len(name)) + name)
+            index.append((name, pack.tell(), len(data)))
+            pack.write(data)
+        index_offset = pack.tell()
+        for name, offset, length in sorted(index):
+            pack.write(struct.pack('<QQQII', offset, length, 0, 0, len(name)))
+        pack.write(struct.pack('<QQ', index_offset, len(index)) + b'PYCPKIDX')
+    return index_offset
+
+
+def check_pack_crash(tools, workdir):
+    """
+    Appends two modules with as much output as the writer buffers to a pack
+    whose index is larger than that, and kills pycdc once they are flushed.
+    A FIFO among the inputs keeps the run from finishing before that.
+    """
+    pycdc = os.path.join(tools, 'pycdc')
+    pycpack = os.path.join(tools, 'pycpack')
+    indir = os.path.join(workdir, 'crash-in')
+    outdir = os.path.join(workdir, 'crash-out')
+    pack = os.path.join(workdir, 'crash.pack')
+    os.makedirs(indir)
+    string_size = 5 << 19
+    big_names = ['big1.py', 'big2.py']
+    for name in big_names:
+        run([os.path.join(tools, 'pycgen'), '--string', str(string_size),
+             '-o', os.path.join(indir, name + 'c')])
+    run([pycdc, '--batch', indir, '-o', outdir])
+
+    names = ['m{:06}.py'.format(i) for i in range(200000)]
+    index_offset = write_pack(pack, [(name, b'pass\n') for name in names])
+
+    # Wait until the output is well past the start of the old index
+    def read_probe():
+        with open(pack, 'rb') as pack_file:
+            pack_file.seek(index_offset + 2 * string_size - (1 << 20))
+            return pack_file.read(16)
+    old_probe = read_probe()
+    fifo = os.path.join(indir, 'stuck.pyc')
+    os.mkfifo(fifo)
+    proc = subprocess.Popen([pycdc, '--batch', indir, '--pack', pack],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    deadline = time.time() + 60
+    while read_probe() in (old_probe, b'') and proc.poll() is None and time.time() < deadline:
+        time.sleep(0.01)
+    proc.send_signal(signal.SIGKILL)
+    proc.wait()
+    os.unlink(fifo)
+
+    # The killed run must not leave the old index for readers to trust
+    listing = run([pycpack, 'list', pack])
+    if listing.returncode == 0 or b'Corrupt' in listing.stderr:
+        print('pack: killed run left a stale index')
+        return 1
+
+    # The next run recovers the whole records, and writes a new index
+    taildir = os.path.join(workdir, 'crash-tail')
+    os.makedirs(taildir)
+    shutil.copy(os.path.join(COMPILED_DIR, 'swap.3.11.pyc'), taildir)
+    run([pycdc, '--batch', taildir, '--pack', pack])
+    recovered = pack_names(pycpack, pack)
+    big = [name for name in big_names if name in recovered]
+    if not big or recovered != sorted(names + big + ['swap.3.11.py']):
+        print('pack: records of the killed run were not recovered')
+        return 1
+    fails = 0
+    for name in big:
+        with open(os.path.join(outdir, name), 'rb') as out_file:
+            if run([pycpack, 'cat', pack, name]).stdout != out_file.read():
+                print('{}: recovered pack entry differs from the output file'.format(name))
+                fails += 1
+    return fails
+
+
+def main():
+    checks = { 'slim': check_slim, 'pack': check_pack }
+    if len(sys.argv) != 3 or sys.argv[1] not in checks:
+        print('Usage: {} {{slim|pack}} <tools directory>'.format(sys.argv[0]))
+        sys.exit(2)
+
+    workdir = tempfile.mkdtemp(prefix='pycdc-roundtrip-')
+    try:
+        fails = checks[sys.argv[1]](os.path.realpath(sys.argv[2]), workdir)
+    finally:
+        shutil.rmtree(workdir)
+    if fails:
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()